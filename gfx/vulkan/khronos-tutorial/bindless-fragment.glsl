@@ -0,0 +1,28 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragUv;
+
+layout(location = 0) out vec4 outColor;
+
+// Same as material-fragment.glsl, just every material at once
+layout(std430, binding = 0) readonly buffer Material {
+	vec4 tint;
+	uint textureIndex;
+} materials[];
+layout(binding = 1) uniform texture2D textures[];
+layout(binding = 2) uniform sampler samp;
+
+layout(push_constant) uniform Params {
+	uint unis;
+	uint material;
+} params;
+
+// The indices come from push constants, so they're the same for the whole draw and don't need nonuniformEXT
+void main() {
+	vec4 tint = materials[params.material].tint;
+	uint textureIndex = materials[params.material].textureIndex;
+	vec3 texel = texture(sampler2D(textures[textureIndex], samp), fragUv).rgb;
+	outColor = vec4(mix(fragColor, tint.rgb, 0.5) * texel, 1.0);
+}
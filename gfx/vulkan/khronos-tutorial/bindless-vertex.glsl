@@ -0,0 +1,39 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragUv; // Across the triangle's bounding square, for material textures
+
+struct Unis {
+	float time;
+	float scale;
+	vec2 offset;
+};
+
+// Buffer 0 is the whole uniform ring, the rest are materials for bindless-fragment.glsl
+layout(std430, binding = 0) readonly buffer Uniforms {
+	Unis unis[];
+} buffers[];
+
+layout(push_constant) uniform Params {
+	uint unis;
+	uint material;
+} params;
+
+// Same as in vertex.glsl, ID 0 picks where its uniforms come from, which this doesn't need
+layout(constant_id = 1) const float TIME_SCALE = 3.14;
+layout(constant_id = 2) const bool BLUE_PULSE = true;
+
+void main() {
+	Unis uni = buffers[0].unis[params.unis];
+	float t = TIME_SCALE * uni.time;
+	mat2 rot = mat2(cos(t), -sin(t), sin(t), cos(t)); 
+	gl_Position = vec4(uni.offset + uni.scale * (rot * inPosition), 0.0, 1.0);
+	fragColor = inColor;
+	if (BLUE_PULSE)
+		fragColor.b = sin(t);
+	fragUv = inPosition + 0.5;
+}
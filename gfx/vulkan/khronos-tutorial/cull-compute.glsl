@@ -0,0 +1,46 @@
+#version 450
+
+layout(local_size_x = 64) in;
+
+struct Instance {
+	vec2 offset;
+	float scale;
+	float phase;
+};
+
+layout(std430, binding = 0) readonly buffer Instances {
+	Instance instances[];
+};
+
+layout(std430, binding = 1) writeonly buffer Visible {
+	uint visible[];
+};
+
+// VkDrawIndexedIndirectCommand, with instanceCount zeroed before the dispatch
+layout(std430, binding = 2) buffer Draw {
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+} draw;
+
+// Must match CullParams in khronos-tutorial.c
+layout(push_constant) uniform Params {
+	vec4 planes[4]; // World space, xy is the normal pointing inside and w the distance
+	float radius; // Of the mesh before the instance scale
+	uint count;
+} params;
+
+void main() {
+	uint i = gl_GlobalInvocationID.x;
+	if (i >= params.count)
+		return;
+	Instance inst = instances[i];
+	float r = params.radius * inst.scale;
+	for (int p = 0; p < 4; p++) {
+		if (dot(params.planes[p].xy, inst.offset) + params.planes[p].w < -r)
+			return;
+	}
+	visible[atomicAdd(draw.instanceCount, 1)] = i;
+}
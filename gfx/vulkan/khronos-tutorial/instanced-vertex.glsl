@@ -0,0 +1,44 @@
+#version 450
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
+layout(location = 0) out vec3 fragColor;
+
+// The culled pipeline only draws what cull-compute.glsl left in visible
+layout(constant_id = 0) const bool CULLED = false;
+// Same as in vertex.glsl
+layout(constant_id = 1) const float TIME_SCALE = 3.14;
+layout(constant_id = 2) const bool BLUE_PULSE = true;
+
+layout(binding = 0) uniform Unis {
+	float time;
+	float scale;
+	vec2 offset;
+} uni;
+
+struct Instance {
+	vec2 offset;
+	float scale;
+	float phase;
+};
+
+layout(std430, binding = 1) readonly buffer Instances {
+	Instance instances[];
+};
+
+layout(std430, binding = 2) readonly buffer Visible {
+	uint visible[];
+};
+
+void main() {
+	Instance inst = instances[CULLED ? visible[gl_InstanceIndex] : gl_InstanceIndex];
+	float t = TIME_SCALE * (uni.time + inst.phase);
+	mat2 rot = mat2(cos(t), -sin(t), sin(t), cos(t));
+	// Instances are placed in the world, and the camera in the uniforms takes them to clip space
+	vec2 world = inst.offset + inst.scale * (rot * inPosition);
+	gl_Position = vec4(uni.offset + uni.scale * world, 0.0, 1.0);
+	fragColor = inColor;
+	if (BLUE_PULSE)
+		fragColor.b = sin(t);
+}
@@ -11,19 +11,60 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_vulkan.h>
 #include <vulkan/vulkan.h>
+#include <shaderc/shaderc.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stddef.h>
 #include <stdbool.h>
 #include <stdint.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <math.h>
 
 #ifndef ARRAYSIZE
 #define ARRAYSIZE(a) (sizeof(a) / sizeof(*a))
 #endif
 
-#define MAX_FRAMES_IN_FLIGHT 2
+// Arrays are sized for the deepest --frames-in-flight, opts.framesInFlight is what's used
+#define MAX_FRAMES_IN_FLIGHT 4
 #define WIDTH 640
 #define HEIGHT 480
 #define APP_SHORT_NAME "KhrTut"
+// How many offscreen images stand in for the swapchain in headless mode
+#define OFFSCREEN_IMAGES_COUNT (MAX_FRAMES_IN_FLIGHT + 1)
+#define PIPELINE_CACHE_FILE "pipeline.cache"
+// Uploads are copied through this many chunks of host visible memory
+#define STAGING_CHUNK_SIZE ((VkDeviceSize)4 << 20)
+#define STAGING_CHUNKS_COUNT 4
+// Keeps the index count of a subdivided mesh in 32 bits
+#define MAX_MESH_SUBDIVISIONS 16384
+#define MAX_WORKERS 64
+// Timestamp pairs per frame, enough for a batch per worker and then some
+#define MAX_GPU_SCOPES (MAX_WORKERS + 16)
+// Past this, hardly anyone has the sample counts and nobody can see the difference
+#define MAX_MSAA_SAMPLES 8
+// How long --pipeline-variants sticks with each one
+#define VARIANT_FRAMES 16
+// The descriptor indexing arrays, every material's buffer and texture, plus the uniform ring as buffer 0
+#define BINDLESS_MAX_MATERIALS 4096
+#define BINDLESS_MAX_BUFFERS (BINDLESS_MAX_MATERIALS + 1)
+#define BINDLESS_MAX_TEXTURES BINDLESS_MAX_MATERIALS
+// Loop count the overdraw layers' fragment shader can be specialized to
+#define MAX_SHADE_ITERATIONS 1024
+// Streamed material textures are powers of two in between
+#define STREAM_MIN_SIZE 16
+#define TEXTURE_MAX_SIZE 1024
 
 #define eprintf(...) fprintf(stderr, __VA_ARGS__)
 
@@ -31,11 +72,17 @@ static uint32_t clampu32(uint32_t x, uint32_t l, uint32_t h)
 {
 	return x < l ? l : (x > h ? h : x);
 }
+static uint32_t maxu32(uint32_t x, uint32_t y)
+{
+	return x > y ? x : y;
+}
+
 static uint32_t minu32(uint32_t x, uint32_t y)
 {
 	return x < y ? x : y;
 }
 
+// The whole file in one malloc, which only --bench-load still does to compare against mapFile
 static void *readfile(const char *fname, size_t *len_p) {
 	FILE *fp = fopen(fname, "rb");
 	if (fp == NULL)
@@ -44,227 +91,5799 @@ static void *readfile(const char *fname, size_t *len_p) {
 	size_t lenmax = UINT16_MAX;
 	void *mem = malloc(lenmax);
 
-	size_t i = 0;
-	int err = -1;
-	if (mem != NULL) {
-		while (i < lenmax) {
-			size_t lenread = fread(mem, 1, lenmax - i, fp);
-			if (lenread == 0)
-				break;
-			i += lenread;
-		}
-		err = ferror(fp);
-		fclose(fp);
+	size_t i = 0;
+	int err = -1;
+	while (mem != NULL) {
+		size_t lenread = fread((char *)mem + i, 1, lenmax - i, fp);
+		i += lenread;
+		if (lenread == 0)
+			break;
+		if (i == lenmax) {
+			void *grown = lenmax * 2 > lenmax ? realloc(mem, lenmax * 2) : NULL;
+			if (grown == NULL) {
+				free(mem);
+				mem = NULL;
+				break;
+			}
+			mem = grown;
+			lenmax *= 2;
+		}
+	}
+	if (mem != NULL)
+		err = ferror(fp);
+	fclose(fp);
+	if (err != 0) {
+		free(mem);
+		mem = NULL;
+	}
+	*len_p = i;
+	return mem;
+}
+
+/*
+ * Files come in mapped, so SPIR-V or anything else goes from the page
+ * cache straight into a create call or a staging copy without a malloc
+ * and a copy in between, whatever the size. Unmap it once whatever it was
+ * handed to has its own copy. Empty files map to NULL with len 0.
+ */
+struct MappedFile
+{
+	void *data;
+	size_t len;
+};
+
+static int mapFile(const char *path, struct MappedFile *file)
+{
+	memset(file, 0, sizeof(*file));
+#ifdef _WIN32
+	// Sharing everything so editors can still save over it while it's open
+	HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+		return 1;
+	LARGE_INTEGER size;
+	// Too big for the address space is a failure, stream it instead
+	int err = !GetFileSizeEx(handle, &size) || size.QuadPart != (LONGLONG)(size_t)size.QuadPart;
+	if (!err && size.QuadPart > 0)
+	{
+		// The view keeps the mapping alive on its own
+		HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping != NULL)
+		{
+			file->data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);
+		}
+		err = file->data == NULL;
+	}
+	file->len = err ? 0 : (size_t)size.QuadPart;
+	CloseHandle(handle);
+	return err;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 1;
+	struct stat st;
+	int err = fstat(fd, &st) != 0 || st.st_size != (off_t)(size_t)st.st_size;
+	if (!err && st.st_size > 0)
+	{
+		file->data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		err = file->data == MAP_FAILED;
+		if (err)
+			file->data = NULL;
+	}
+	file->len = err ? 0 : (size_t)st.st_size;
+	close(fd);
+	return err;
+#endif
+}
+
+static void unmapFile(struct MappedFile *file)
+{
+	if (file->data != NULL)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(file->data);
+#else
+		munmap(file->data, file->len);
+#endif
+	}
+	memset(file, 0, sizeof(*file));
+}
+
+// A malloc'd copy for things that outlive the load, since editors on Windows can't save over a mapped file
+static void *copyFile(const char *path, size_t *len)
+{
+	struct MappedFile file;
+	if (0 != mapFile(path, &file))
+		return NULL;
+	void *copy = malloc(file.len ? file.len : 1);
+	if (copy != NULL && file.len)
+		memcpy(copy, file.data, file.len);
+	*len = file.len;
+	unmapFile(&file);
+	return copy;
+}
+
+// The most memory the process has had resident so far
+static double peakRssMiB(void)
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return (double)counters.PeakWorkingSetSize / 1048576.0;
+#else
+	struct rusage usage;
+	if (0 != getrusage(RUSAGE_SELF, &usage))
+		return 0;
+	return (double)usage.ru_maxrss / 1024.0; // KiB on Linux
+#endif
+}
+
+static double nowMs(void)
+{
+	return (double)SDL_GetPerformanceCounter() * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+/*
+ * A growable list of measurements (usually milliseconds) so that
+ * benchmarks can report percentiles instead of just an average.
+ */
+struct Samples
+{
+	double *values;
+	uint32_t count;
+	uint32_t capacity;
+};
+
+static void samplesPush(struct Samples *samples, double value)
+{
+	if (samples->count == samples->capacity)
+	{
+		uint32_t capacity = samples->capacity ? samples->capacity * 2 : 256;
+		double *values = realloc(samples->values, capacity * sizeof(*values));
+		if (values == NULL)
+			return;
+		samples->values = values;
+		samples->capacity = capacity;
+	}
+	samples->values[samples->count++] = value;
+}
+
+static void samplesReset(struct Samples *samples)
+{
+	samples->count = 0;
+}
+
+static int cmpDouble(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static double samplesPercentile(const double *sorted, uint32_t count, double p)
+{
+	if (count == 0)
+		return 0;
+	uint32_t i = (uint32_t)(p * (count - 1) + 0.5);
+	return sorted[i];
+}
+
+// Sorts the samples in place, so only call this once you're done pushing
+static void samplesReport(const char *name, struct Samples *samples)
+{
+	uint32_t n = samples->count;
+	if (n == 0)
+	{
+		printf("%-24s n=0\n", name);
+		return;
+	}
+	double sum = 0;
+	for (uint32_t i = 0; i < n; i++)
+		sum += samples->values[i];
+	qsort(samples->values, n, sizeof(*samples->values), cmpDouble);
+	printf("%-24s n=%u mean=%.3f p50=%.3f p90=%.3f p99=%.3f max=%.3f\n",
+		name, n, sum / n,
+		samplesPercentile(samples->values, n, 0.50),
+		samplesPercentile(samples->values, n, 0.90),
+		samplesPercentile(samples->values, n, 0.99),
+		samples->values[n - 1]);
+}
+
+// How the CPU waits on the graphics queue, see FrameSync
+enum SyncScheme
+{
+	SYNC_FENCES,
+	SYNC_TIMELINE, // Needs Vulkan 1.2
+	SYNC_SCHEMES_COUNT,
+};
+static const char *syncSchemeNames[SYNC_SCHEMES_COUNT] = { "fences", "timeline" };
+
+// How frames get drawn to their image, see DynamicRendering
+enum RenderingPath
+{
+	RENDERING_PASS,
+	RENDERING_DYNAMIC, // Needs Vulkan 1.3
+	RENDERING_PATHS_COUNT,
+};
+static const char *renderingPathNames[RENDERING_PATHS_COUNT] = { "pass", "dynamic" };
+
+// Indexed by VkPresentModeKHR, which numbers these from 0
+static const char *presentModeNames[] = { "immediate", "mailbox", "fifo" };
+
+// How each draw finds its uniforms
+enum UniformScheme
+{
+	UNIFORMS_RING, // One dynamic uniform buffer, a slice per draw
+	UNIFORMS_BUFFERS, // A buffer and descriptor set per draw per frame in flight
+	UNIFORMS_TRANSIENT, // The ring's slices, with a descriptor set per draw allocated and written every frame
+	UNIFORMS_PUSH, // Push constants, no buffer at all
+	UNIFORMS_STORAGE, // One storage buffer, indexed by gl_InstanceIndex
+	UNIFORM_SCHEMES_COUNT,
+};
+static const char *uniformSchemeNames[UNIFORM_SCHEMES_COUNT] = { "ring", "buffers", "transient", "push", "storage" };
+
+// How the objects get drawn
+enum DrawMode
+{
+	DRAW_PER_DRAW, // A draw call per object
+	DRAW_INSTANCED, // One instanced draw, per-instance data in a storage buffer
+	DRAW_INDIRECT, // Like instanced, but the draw parameters come from a GPU buffer
+	DRAW_CULLED, // Like indirect, but a compute pass culls the instances and writes the parameters
+	DRAW_OVERDRAW, // Not objects, full-screen layers stacked back to front, see Overdraw
+	DRAW_MODES_COUNT,
+};
+static const char *drawModeNames[DRAW_MODES_COUNT] = { "per-draw", "instanced", "indirect", "culled", "overdraw" };
+
+// Command line options. Defaults are the windowed behaviour from before.
+struct Options
+{
+	bool headless;
+	uint32_t frames; // 0 means run until the window is closed
+	uint32_t width;
+	uint32_t height;
+	const char *pipelineCachePath; // NULL means don't persist the pipeline cache
+	uint32_t draws;
+	enum UniformScheme uniformScheme;
+	bool benchUniforms;
+	enum DrawMode drawMode;
+	bool benchInstances;
+	uint32_t threads; // Worker threads recording secondary command buffers, 0 for none
+	bool benchThreads;
+	uint32_t meshSubdivisions;
+	bool transferQueue; // Upload on a transfer-only queue family if there is one
+	const char *gpuCsvPath; // NULL to skip dumping GPU times
+	VkPresentModeKHR presentMode;
+	uint32_t framesInFlight; // How many frames the CPU can get ahead of the GPU
+	bool benchResize;
+	enum SyncScheme sync;
+	bool benchSync;
+	bool asyncCompute; // Cull on a compute-only queue family if there is one
+	bool benchAsync;
+	enum RenderingPath rendering;
+	bool depthPrepass; // Lay down the overdraw scene's depth before shading any of it
+	bool benchOverdraw;
+	uint32_t samples; // MSAA samples per pixel, 1 for none
+	bool hotReload; // Recompile vertex.glsl and fragment.glsl when they change
+	const char *benchLoadPath; // NULL to skip the file loading benchmark
+	bool pipelineVariants; // Keep asking for pipelines the per-draw scene hasn't used yet
+	uint32_t materials; // Per-draw scene only, 0 for none
+	bool bindless; // Bind every material at once through descriptor indexing
+	bool benchBindless;
+	uint32_t textureSize; // Of the materials' textures at full detail
+	uint32_t textureBudgetMiB; // For streaming them, 0 for half what VK_EXT_memory_budget says is left
+	uint32_t shadeIterations; // Of the overdraw layers' fragment shader loop
+	bool wobble; // Warp the overdraw layers' pattern over time
+	bool uniformBranching; // Overdraw layers read the two above from push constants instead of having them specialized in
+	bool benchSpecialization;
+	float timeScale; // Radians a second the triangles turn, folded into vertex.glsl and bindless-vertex.glsl
+	bool bluePulse; // Blue follows the spin instead of the vertex colors, folded in the same way
+} opts =
+{
+	.headless = false,
+	.frames = 0,
+	.width = WIDTH,
+	.height = HEIGHT,
+	.pipelineCachePath = PIPELINE_CACHE_FILE,
+	.draws = 0, // 1, or 10000 when sweeping threads
+	.uniformScheme = UNIFORMS_RING,
+	.benchUniforms = false,
+	.drawMode = DRAW_PER_DRAW,
+	.benchInstances = false,
+	.threads = 0,
+	.benchThreads = false,
+	.meshSubdivisions = 1,
+	.transferQueue = true,
+	.gpuCsvPath = NULL,
+	.presentMode = VK_PRESENT_MODE_FIFO_KHR,
+	.framesInFlight = 2,
+	.benchResize = false,
+	.sync = SYNC_FENCES,
+	.benchSync = false,
+	.asyncCompute = false,
+	.benchAsync = false,
+	.rendering = RENDERING_PASS,
+	.depthPrepass = false,
+	.benchOverdraw = false,
+	.samples = 1,
+	.hotReload = false,
+	.benchLoadPath = NULL,
+	.pipelineVariants = false,
+	.materials = 0, // 1 with --bindless
+	.bindless = false,
+	.benchBindless = false,
+	.textureSize = 256,
+	.textureBudgetMiB = 0,
+	.shadeIterations = 64,
+	.wobble = true,
+	.uniformBranching = false,
+	.benchSpecialization = false,
+	.timeScale = 3.14f,
+	.bluePulse = true,
+};
+
+static void usage(const char *argv0)
+{
+	eprintf("Usage: %s [options]\n", argv0);
+	eprintf("\t--headless       Render to offscreen images without a window or swapchain\n");
+	eprintf("\t--frames N       Quit after N frames (headless defaults to 1000)\n");
+	eprintf("\t--size WxH       Render target size (default %ux%u)\n", WIDTH, HEIGHT);
+	eprintf("\t--pipeline-cache PATH  Where to persist the pipeline cache (default %s)\n", PIPELINE_CACHE_FILE);
+	eprintf("\t--no-pipeline-cache    Always compile pipelines from scratch\n");
+	eprintf("\t--draws N        Draw N objects a frame, each with its own uniforms (default 1, 10000 with --bench-threads, %u with --bench-bindless, 4 with --bench-specialization)\n",
+		BINDLESS_MAX_MATERIALS);
+	eprintf("\t--uniforms ring|buffers|transient|push|storage  Where per-draw uniforms live (default ring)\n");
+	eprintf("\t--bench-uniforms Sweep draw counts for every uniform scheme, --frames (default 300) each\n");
+	eprintf("\t--threads N      Record draws into secondary command buffers on N worker threads (default 0, max %u)\n", MAX_WORKERS);
+	eprintf("\t--bench-threads  Sweep worker thread counts up to the core count, --frames (default 300) each\n");
+	eprintf("\t--draw-mode per-draw|instanced|indirect|culled|overdraw  How the objects get drawn, overdraw draws --draws full-screen layers (default per-draw)\n");
+	eprintf("\t--bench-instances Sweep object counts from 1 to 1M for every draw mode, --frames (default 300) each\n");
+	eprintf("\t--mesh-subdivisions N  Cut the triangle into N^2 triangles for a bigger upload (default 1, max %u)\n", MAX_MESH_SUBDIVISIONS);
+	eprintf("\t--no-transfer-queue    Upload on the graphics queue even if there's a transfer-only one\n");
+	eprintf("\t--gpu-csv PATH   Write every frame's GPU timestamp scopes to PATH as CSV\n");
+	eprintf("\t--present-mode immediate|mailbox|fifo  Falls back to fifo if the surface can't (default fifo)\n");
+	eprintf("\t--frames-in-flight N  Let the CPU get up to N frames ahead of the GPU (default 2, max %u)\n", MAX_FRAMES_IN_FLIGHT);
+	eprintf("\t--bench-resize   Keep resizing the window for --frames (default 300) and report the worst frame\n");
+	eprintf("\t--sync fences|timeline  How the CPU waits on the GPU, timeline needs Vulkan 1.2 (default fences)\n");
+	eprintf("\t--bench-sync     Run with both sync schemes, --frames (default 300) each, and compare CPU wait time\n");
+	eprintf("\t--async-compute  Cull on a compute-only queue family alongside graphics, if there is one\n");
+	eprintf("\t--bench-async    Sweep culled instance counts with culling on each queue, --frames (default 300) each\n");
+	eprintf("\t--rendering pass|dynamic  Render passes and framebuffers, or dynamic rendering which needs Vulkan 1.3 (default pass)\n");
+	eprintf("\t--depth-prepass  Draw the overdraw layers' depth first, then shade only what's on top\n");
+	eprintf("\t--bench-overdraw Sweep overdraw layer counts with and without the depth pre-pass, --frames (default 300) each\n");
+	eprintf("\t--msaa 1|2|4|8   Samples per pixel, lowered to what the device can do (default 1)\n");
+	eprintf("\t--hot-reload     Recompile vertex.glsl and fragment.glsl in the background when they change\n");
+	eprintf("\t--bench-load PATH  Upload PATH streamed, mapped and read whole, and report time and peak RSS for each\n");
+	eprintf("\t--pipeline-variants  Switch the per-draw scene to a new pipeline variant every %u frames, compiled in the background\n", VARIANT_FRAMES);
+	eprintf("\t--materials N    Spread the per-draw scene over N materials, each a storage buffer and a texture (default 0, max %u)\n",
+		BINDLESS_MAX_MATERIALS);
+	eprintf("\t--bindless       Bind every material at once with descriptor indexing, instead of a set per material\n");
+	eprintf("\t--bench-bindless Sweep material counts with and without --bindless, --frames (default 300) each\n");
+	eprintf("\t--texture-size N Materials' textures are NxN at full detail, a power of two from %u to %u (default 256)\n",
+		STREAM_MIN_SIZE, TEXTURE_MAX_SIZE);
+	eprintf("\t--texture-budget MiB  Stream the materials' mips within MiB of VRAM (default half of what's left, or a quarter of the heap)\n");
+	eprintf("\t--shade-iterations N  Loop N times in the overdraw layers' fragment shader (default 64, max %u)\n", MAX_SHADE_ITERATIONS);
+	eprintf("\t--no-wobble      Leave the overdraw layers' pattern still\n");
+	eprintf("\t--uniform-branching   Branch on the two above at runtime in the overdraw layers, instead of specializing them in\n");
+	eprintf("\t--bench-specialization  Sweep shader loop counts and wobble, specialized and branching, over --draws (default 4) overdraw layers, --frames (default 300) each\n");
+	eprintf("\t--time-scale X   Triangles turn X radians a second, specialized into their vertex shaders (default 3.14)\n");
+	eprintf("\t--no-blue-pulse  Keep the triangles' vertex colors instead of pulsing blue with the spin\n");
+}
+
+// Index of val in names, or -1
+static int parseName(const char *val, const char **names, int namesCount)
+{
+	for (int i = 0; val && i < namesCount; i++)
+	{
+		if (!strcmp(val, names[i]))
+			return i;
+	}
+	return -1;
+}
+
+// The whole of val as a finite number, or false and *out is left alone
+static bool parseFloat(const char *val, float *out)
+{
+	char *end;
+	float f = val ? strtof(val, &end) : 0.0f;
+	if (!val || end == val || *end != '\0' || !isfinite(f))
+		return false;
+	*out = f;
+	return true;
+}
+
+static int parseArgs(int argc, char **argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+		if (!strcmp(arg, "--headless"))
+		{
+			opts.headless = true;
+		}
+		else if (!strcmp(arg, "--frames") && val)
+		{
+			opts.frames = (uint32_t)strtoul(val, NULL, 0);
+			i++;
+		}
+		else if (!strcmp(arg, "--size") && val
+			&& sscanf(val, "%ux%u", &opts.width, &opts.height) == 2
+			&& opts.width && opts.height)
+		{
+			i++;
+		}
+		else if (!strcmp(arg, "--pipeline-cache") && val)
+		{
+			opts.pipelineCachePath = val;
+			i++;
+		}
+		else if (!strcmp(arg, "--no-pipeline-cache"))
+		{
+			opts.pipelineCachePath = NULL;
+		}
+		else if (!strcmp(arg, "--draws") && val && (opts.draws = (uint32_t)strtoul(val, NULL, 0)))
+		{
+			i++;
+		}
+		else if (!strcmp(arg, "--uniforms") && parseName(val, uniformSchemeNames, UNIFORM_SCHEMES_COUNT) >= 0)
+		{
+			opts.uniformScheme = (enum UniformScheme)parseName(val, uniformSchemeNames, UNIFORM_SCHEMES_COUNT);
+			i++;
+		}
+		else if (!strcmp(arg, "--bench-uniforms"))
+		{
+			opts.benchUniforms = true;
+		}
+		else if (!strcmp(arg, "--threads") && val
+			&& (opts.threads = (uint32_t)strtoul(val, NULL, 0)) <= MAX_WORKERS)
+		{
+			i++;
+		}
+		else if (!strcmp(arg, "--bench-threads"))
+		{
+			opts.benchThreads = true;
+		}
+		else if (!strcmp(arg, "--draw-mode") && parseName(val, drawModeNames, DRAW_MODES_COUNT) >= 0)
+		{
+			opts.drawMode = (enum DrawMode)parseName(val, drawModeNames, DRAW_MODES_COUNT);
+			i++;
+		}
+		else if (!strcmp(arg, "--bench-instances"))
+		{
+			opts.benchInstances = true;
+		}
+		else if (!strcmp(arg, "--mesh-subdivisions") && val
+			&& (opts.meshSubdivisions = (uint32_t)strtoul(val, NULL, 0))
+			&& opts.meshSubdivisions <= MAX_MESH_SUBDIVISIONS)
+		{
+			i++;
+		}
+		else if (!strcmp(arg, "--no-transfer-queue"))
+		{
+			opts.transferQueue = false;
+		}
+		else if (!strcmp(arg, "--gpu-csv") && val)
+		{
+			opts.gpuCsvPath = val;
+			i++;
+		}
+		else if (!strcmp(arg, "--present-mode") && parseName(val, presentModeNames, (int)ARRAYSIZE(presentModeNames)) >= 0)
+		{
+			opts.presentMode = (VkPresentModeKHR)parseName(val, presentModeNames, (int)ARRAYSIZE(presentModeNames));
+			i++;
+		}
+		else if (!strcmp(arg, "--frames-in-flight") && val
+			&& (opts.framesInFlight = (uint32_t)strtoul(val, NULL, 0))
+			&& opts.framesInFlight <= MAX_FRAMES_IN_FLIGHT)
+		{
+			i++;
+		}
+		else if (!strcmp(arg, "--bench-resize"))
+		{
+			opts.benchResize = true;
+		}
+		else if (!strcmp(arg, "--sync") && parseName(val, syncSchemeNames, SYNC_SCHEMES_COUNT) >= 0)
+		{
+			opts.sync = (enum SyncScheme)parseName(val, syncSchemeNames, SYNC_SCHEMES_COUNT);
+			i++;
+		}
+		else if (!strcmp(arg, "--bench-sync"))
+		{
+			opts.benchSync = true;
+		}
+		else if (!strcmp(arg, "--async-compute"))
+		{
+			opts.asyncCompute = true;
+		}
+		else if (!strcmp(arg, "--bench-async"))
+		{
+			opts.benchAsync = true;
+		}
+		else if (!strcmp(arg, "--rendering") && parseName(val, renderingPathNames, RENDERING_PATHS_COUNT) >= 0)
+		{
+			opts.rendering = (enum RenderingPath)parseName(val, renderingPathNames, RENDERING_PATHS_COUNT);
+			i++;
+		}
+		else if (!strcmp(arg, "--depth-prepass"))
+		{
+			opts.depthPrepass = true;
+		}
+		else if (!strcmp(arg, "--bench-overdraw"))
+		{
+			opts.benchOverdraw = true;
+		}
+		else if (!strcmp(arg, "--msaa") && val
+			&& (opts.samples = (uint32_t)strtoul(val, NULL, 0))
+			&& opts.samples <= MAX_MSAA_SAMPLES && !(opts.samples & (opts.samples - 1)))
+		{
+			i++;
+		}
+		else if (!strcmp(arg, "--hot-reload"))
+		{
+			opts.hotReload = true;
+		}
+		else if (!strcmp(arg, "--bench-load") && val)
+		{
+			opts.benchLoadPath = val;
+			i++;
+		}
+		else if (!strcmp(arg, "--pipeline-variants"))
+		{
+			opts.pipelineVariants = true;
+		}
+		else if (!strcmp(arg, "--materials") && val
+			&& (opts.materials = (uint32_t)strtoul(val, NULL, 0)) <= BINDLESS_MAX_MATERIALS)
+		{
+			i++;
+		}
+		else if (!strcmp(arg, "--bindless"))
+		{
+			opts.bindless = true;
+		}
+		else if (!strcmp(arg, "--bench-bindless"))
+		{
+			opts.benchBindless = true;
+		}
+		else if (!strcmp(arg, "--texture-size") && val
+			&& (opts.textureSize = (uint32_t)strtoul(val, NULL, 0)) >= STREAM_MIN_SIZE
+			&& opts.textureSize <= TEXTURE_MAX_SIZE && !(opts.textureSize & (opts.textureSize - 1)))
+		{
+			i++;
+		}
+		else if (!strcmp(arg, "--shade-iterations") && val
+			&& (opts.shadeIterations = (uint32_t)strtoul(val, NULL, 0)) && opts.shadeIterations <= MAX_SHADE_ITERATIONS)
+		{
+			i++;
+		}
+		else if (!strcmp(arg, "--no-wobble"))
+		{
+			opts.wobble = false;
+		}
+		else if (!strcmp(arg, "--time-scale") && parseFloat(val, &opts.timeScale))
+		{
+			i++;
+		}
+		else if (!strcmp(arg, "--no-blue-pulse"))
+		{
+			opts.bluePulse = false;
+		}
+		else if (!strcmp(arg, "--uniform-branching"))
+		{
+			opts.uniformBranching = true;
+		}
+		else if (!strcmp(arg, "--bench-specialization"))
+		{
+			opts.benchSpecialization = true;
+		}
+		else if (!strcmp(arg, "--texture-budget") && val && (opts.textureBudgetMiB = (uint32_t)strtoul(val, NULL, 0)))
+		{
+			i++;
+		}
+		else
+		{
+			eprintf("Bad argument: %s\n", arg);
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (opts.draws == 0)
+		opts.draws = opts.benchThreads ? 10000 : opts.benchBindless ? BINDLESS_MAX_MATERIALS : opts.benchSpecialization ? 4 : 1;
+	if (opts.bindless && opts.materials == 0)
+		opts.materials = 1;
+	if (opts.benchResize && opts.headless)
+	{
+		eprintf("Can't resize a window that isn't there!\n");
+		return 1;
+	}
+	if ((opts.benchUniforms || opts.benchThreads || opts.benchInstances || opts.benchResize || opts.benchSync || opts.benchAsync
+		|| opts.benchOverdraw || opts.benchBindless || opts.benchSpecialization) && opts.frames == 0)
+		opts.frames = 300;
+	if (opts.headless && opts.frames == 0)
+		opts.frames = 1000;
+	return 0;
+}
+
+// The overdraw scene's pipelines, see Overdraw
+enum OverdrawPipeline
+{
+	OVERDRAW_COLOR, // Depth tested and written, so every layer in front shades again
+	OVERDRAW_PREPASS, // Depth only, no fragment shader
+	OVERDRAW_AFTER_PREPASS, // Only shades what's equal to the pre-pass's depth
+	OVERDRAW_PIPELINES_COUNT,
+};
+
+// We love globals here
+VkPresentModeKHR vkPresentModeDesired = VK_PRESENT_MODE_FIFO_KHR;
+VkPhysicalDevice vkPhysDevice = 0;
+VkPhysicalDeviceProperties vkPhysProps = { 0 };
+uint32_t vkApiVersion = VK_API_VERSION_1_0; // What the instance was created with
+bool vkMemoryBudget = false; // VK_EXT_memory_budget is on
+VkDevice vkDevice = 0;
+VkSwapchainKHR vkSwapchain = 0;
+VkImage *vkSwapchainImages = 0;
+uint32_t vkSwapchainImagesCount = 0;
+VkImageView *vkSwapchainImageViews = 0;
+VkFramebuffer *vkFramebuffers = 0;
+struct GpuAlloc *vkOffscreenMemories = 0; // Headless only, backing vkSwapchainImages
+// One depth buffer for everyone, frames in flight take turns with it
+VkFormat vkDepthFormat = VK_FORMAT_UNDEFINED;
+VkImage vkDepthImage = 0;
+VkImageView vkDepthView = 0;
+// Same for the multisampled color, which gets resolved into the frame's image. 0 without MSAA.
+VkSampleCountFlagBits vkSamples = VK_SAMPLE_COUNT_1_BIT;
+VkImage vkMsaaImage = 0;
+VkImageView vkMsaaView = 0;
+VkExtent2D vkExtentDesired = { 0 };
+VkRenderPass vkRenderPass = 0;
+VkDescriptorSetLayout vkUniformLayouts[UNIFORM_SCHEMES_COUNT] = { 0 };
+VkPipelineLayout vkPipelineLayouts[UNIFORM_SCHEMES_COUNT] = { 0 };
+VkPipeline vkGraphicsPipelines[UNIFORM_SCHEMES_COUNT] = { 0 };
+VkPipeline vkVariantPipeline = 0; // Drawn with instead of vkGraphicsPipelines when it's there
+VkDescriptorSetLayout vkInstancedLayout = 0;
+VkPipelineLayout vkInstancedPipelineLayout = 0;
+VkPipeline vkInstancedPipelines[2] = { 0 }; // Indexed by whether instances are culled
+VkDescriptorSetLayout vkCullLayout = 0;
+VkPipelineLayout vkCullPipelineLayout = 0;
+VkPipeline vkCullPipeline = 0;
+VkPipelineLayout vkOverdrawPipelineLayout = 0;
+VkPipeline vkOverdrawPipelines[OVERDRAW_PIPELINES_COUNT] = { 0 };
+VkSampler vkMaterialSampler = 0; // Immutable in both material layouts
+VkDescriptorSetLayout vkMaterialLayout = 0;
+VkPipelineLayout vkMaterialPipelineLayout = 0; // The ring's uniforms, then the material
+VkPipeline vkMaterialPipeline = 0;
+VkDescriptorSetLayout vkBindlessLayout = 0; // These three are 0 without descriptor indexing
+VkPipelineLayout vkBindlessPipelineLayout = 0;
+VkPipeline vkBindlessPipeline = 0;
+uint32_t descriptorBinds = 0; // vkCmdBindDescriptorSets calls for the per-draw scene in the last frame recorded
+VkPipelineCache vkPipelineCache = 0;
+
+static uint32_t findMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags properties)
+{
+	VkPhysicalDeviceMemoryProperties vkPhysDevMemProps;
+	vkGetPhysicalDeviceMemoryProperties(vkPhysDevice, &vkPhysDevMemProps);
+	for (uint32_t i = 0; i < vkPhysDevMemProps.memoryTypeCount; i++)
+	{
+		if ((memoryTypeBits & (1u << i))
+			&& (vkPhysDevMemProps.memoryTypes[i].propertyFlags & properties) == properties)
+			return i;
+	}
+	return UINT32_MAX;
+}
+
+/*
+ * Device memory sub-allocator. vkAllocateMemory is slow and drivers only
+ * promise maxMemoryAllocationCount (often 4096) allocations, so we grab big
+ * blocks per memory type and carve them up with a buddy allocator.
+ *
+ * Every block is a complete binary tree over GPU_MIN_ALLOC sized units.
+ * longest[node] is the order + 1 of the biggest free run under that node
+ * (0 means nothing free), so both allocating and freeing are a single walk
+ * between the root and one node. Allocations are naturally aligned to
+ * their rounded-up size which takes care of memory requirement alignment
+ * and nonCoherentAtomSize (at most 256 bytes per the spec) for free.
+ *
+ * Not thread safe, only call this from the main thread.
+ */
+#define GPU_MIN_ALLOC_SHIFT 8
+#define GPU_MIN_ALLOC ((VkDeviceSize)1 << GPU_MIN_ALLOC_SHIFT)
+#define GPU_MAX_ORDER 17 // 32 MiB blocks
+#define GPU_BLOCK_SIZE (GPU_MIN_ALLOC << GPU_MAX_ORDER)
+
+struct GpuBlock
+{
+	VkDeviceMemory memory;
+	void *mapped;
+	uint8_t *longest;
+	uint32_t memoryType;
+	uint32_t maxOrder;
+	// Only set when bufferImageGranularity forces us to keep them apart
+	bool optimal;
+};
+
+struct GpuAlloc
+{
+	VkDeviceMemory memory;
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	void *mapped; // NULL unless the memory type is host visible
+	uint32_t memoryType;
+	uint32_t block; // UINT32_MAX for dedicated allocations
+	uint32_t order;
+};
+
+struct GpuAllocator
+{
+	struct GpuBlock *blocks;
+	uint32_t blocksCount;
+	uint32_t blocksCapacity;
+	VkPhysicalDeviceMemoryProperties memProps;
+	bool splitOptimal;
+	// Stats. Requested is what callers asked for, reserved is after rounding up.
+	VkDeviceSize bytesRequested;
+	VkDeviceSize bytesReserved;
+	VkDeviceSize bytesDeviceMemory;
+	uint32_t deviceAllocations;
+	uint32_t liveAllocations;
+} gpuAllocator = { 0 };
+
+// Behind vkDepthImage and vkMsaaImage, up there with the others it wouldn't know what a GpuAlloc is
+struct GpuAlloc vkDepthMemory = { 0 };
+struct GpuAlloc vkMsaaMemory = { 0 };
+
+static void gpuAllocatorInit(void)
+{
+	vkGetPhysicalDeviceMemoryProperties(vkPhysDevice, &gpuAllocator.memProps);
+	// Buddy nodes never share a page smaller than the smallest node
+	gpuAllocator.splitOptimal = vkPhysProps.limits.bufferImageGranularity > GPU_MIN_ALLOC;
+	eprintf("GPU allocator: %u memory types, bufferImageGranularity %llu, nonCoherentAtomSize %llu\n",
+		gpuAllocator.memProps.memoryTypeCount,
+		(unsigned long long)vkPhysProps.limits.bufferImageGranularity,
+		(unsigned long long)vkPhysProps.limits.nonCoherentAtomSize);
+}
+
+static uint32_t gpuOrderFor(VkDeviceSize size)
+{
+	uint32_t order = 0;
+	while ((GPU_MIN_ALLOC << order) < size)
+		order++;
+	return order;
+}
+
+static void gpuBuddyFixup(uint8_t *longest, uint32_t node, uint32_t maxOrder)
+{
+	uint32_t depth = 0;
+	for (uint32_t i = node; i; i = (i - 1) / 2)
+		depth++;
+	while (node)
+	{
+		node = (node - 1) / 2;
+		depth--;
+		uint8_t nodeOrder = (uint8_t)(maxOrder - depth);
+		uint8_t l = longest[2 * node + 1], r = longest[2 * node + 2];
+		// Both halves completely free means the buddies merge back together
+		if (l == nodeOrder && r == nodeOrder)
+			longest[node] = nodeOrder + 1;
+		else
+			longest[node] = l > r ? l : r;
+	}
+}
+
+static bool gpuBuddyAlloc(struct GpuBlock *block, uint32_t order, VkDeviceSize *offset)
+{
+	if (block->longest[0] < order + 1)
+		return false;
+	uint32_t node = 0;
+	uint32_t depth = 0;
+	while (block->maxOrder - depth != order)
+	{
+		uint32_t left = 2 * node + 1;
+		node = block->longest[left] >= order + 1 ? left : left + 1;
+		depth++;
+	}
+	block->longest[node] = 0;
+	gpuBuddyFixup(block->longest, node, block->maxOrder);
+	VkDeviceSize units = ((VkDeviceSize)node + 1 - ((VkDeviceSize)1 << depth)) << order;
+	*offset = units << GPU_MIN_ALLOC_SHIFT;
+	return true;
+}
+
+static void gpuBuddyFree(struct GpuBlock *block, VkDeviceSize offset, uint32_t order)
+{
+	uint32_t depth = block->maxOrder - order;
+	uint32_t node = (uint32_t)((offset >> GPU_MIN_ALLOC_SHIFT) >> order) + (1u << depth) - 1;
+	block->longest[node] = (uint8_t)(order + 1);
+	gpuBuddyFixup(block->longest, node, block->maxOrder);
+}
+
+static bool gpuMemoryTypeMappable(uint32_t memoryType)
+{
+	return gpuAllocator.memProps.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+}
+
+static int gpuAllocateDeviceMemory(uint32_t memoryType, VkDeviceSize size, VkDeviceMemory *memory, void **mapped)
+{
+	VkMemoryAllocateInfo vkmaInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.allocationSize = size,
+		.memoryTypeIndex = memoryType,
+	};
+	*mapped = NULL;
+	if (VK_SUCCESS != vkAllocateMemory(vkDevice, &vkmaInfo, 0, memory))
+		return 1;
+	// Host visible memory stays mapped for its whole life
+	if (gpuMemoryTypeMappable(memoryType)
+		&& VK_SUCCESS != vkMapMemory(vkDevice, *memory, 0, VK_WHOLE_SIZE, 0, mapped))
+	{
+		vkFreeMemory(vkDevice, *memory, 0);
+		return 1;
+	}
+	gpuAllocator.bytesDeviceMemory += size;
+	gpuAllocator.deviceAllocations++;
+	return 0;
+}
+
+static int gpuAllocFromType(uint32_t memoryType, const VkMemoryRequirements *reqs, bool optimal, struct GpuAlloc *out)
+{
+	VkDeviceSize size = reqs->size > reqs->alignment ? reqs->size : reqs->alignment;
+	if (!(gpuAllocator.memProps.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+		&& size < vkPhysProps.limits.nonCoherentAtomSize)
+		size = vkPhysProps.limits.nonCoherentAtomSize;
+	optimal = optimal && gpuAllocator.splitOptimal;
+	out->memoryType = memoryType;
+	out->size = reqs->size;
+
+	// Too big to share a block with anything, just give it its own memory
+	if (size > GPU_BLOCK_SIZE)
+	{
+		if (gpuAllocateDeviceMemory(memoryType, reqs->size, &out->memory, &out->mapped))
+			return 1;
+		out->offset = 0;
+		out->block = UINT32_MAX;
+		out->order = 0;
+		gpuAllocator.bytesRequested += reqs->size;
+		gpuAllocator.bytesReserved += reqs->size;
+		gpuAllocator.liveAllocations++;
+		return 0;
+	}
+
+	uint32_t order = gpuOrderFor(size);
+	uint32_t blockIdx;
+	VkDeviceSize offset = 0;
+	for (blockIdx = 0; blockIdx < gpuAllocator.blocksCount; blockIdx++)
+	{
+		struct GpuBlock *block = &gpuAllocator.blocks[blockIdx];
+		if (block->memory && block->memoryType == memoryType && block->optimal == optimal
+			&& order <= block->maxOrder && gpuBuddyAlloc(block, order, &offset))
+			break;
+	}
+	if (blockIdx == gpuAllocator.blocksCount)
+	{
+		if (gpuAllocator.blocksCount == gpuAllocator.blocksCapacity)
+		{
+			uint32_t capacity = gpuAllocator.blocksCapacity ? gpuAllocator.blocksCapacity * 2 : 16;
+			struct GpuBlock *blocks = realloc(gpuAllocator.blocks, capacity * sizeof(*blocks));
+			if (blocks == NULL)
+				return 1;
+			gpuAllocator.blocks = blocks;
+			gpuAllocator.blocksCapacity = capacity;
+		}
+		struct GpuBlock *block = &gpuAllocator.blocks[blockIdx];
+		memset(block, 0, sizeof(*block));
+		block->memoryType = memoryType;
+		block->optimal = optimal;
+		// Small heaps (lazily allocated ones especially) might not fit a whole block
+		for (block->maxOrder = GPU_MAX_ORDER; block->maxOrder >= order; block->maxOrder--)
+		{
+			if (!gpuAllocateDeviceMemory(memoryType, GPU_MIN_ALLOC << block->maxOrder, &block->memory, &block->mapped))
+				break;
+			if (block->maxOrder == 0)
+				return 1;
+		}
+		if (block->memory == VK_NULL_HANDLE)
+			return 1;
+		uint32_t nodes = (2u << block->maxOrder) - 1;
+		if (!(block->longest = malloc(nodes)))
+		{
+			vkFreeMemory(vkDevice, block->memory, 0);
+			return 1;
+		}
+		for (uint32_t depth = 0, node = 0; depth <= block->maxOrder; depth++)
+		{
+			for (uint32_t i = 0; i < (1u << depth); i++)
+				block->longest[node++] = (uint8_t)(block->maxOrder - depth + 1);
+		}
+		gpuAllocator.blocksCount++;
+		gpuBuddyAlloc(block, order, &offset);
+	}
+
+	struct GpuBlock *block = &gpuAllocator.blocks[blockIdx];
+	out->memory = block->memory;
+	out->offset = offset;
+	out->mapped = block->mapped ? (char *)block->mapped + offset : NULL;
+	out->block = blockIdx;
+	out->order = order;
+	gpuAllocator.bytesRequested += reqs->size;
+	gpuAllocator.bytesReserved += GPU_MIN_ALLOC << order;
+	gpuAllocator.liveAllocations++;
+	return 0;
+}
+
+/*
+ * Picks the first memory type with all the required flags, trying with the
+ * preferred flags as well first. Optimal is for optimally tiled images.
+ */
+static int gpuAlloc(const VkMemoryRequirements *reqs, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, bool optimal, struct GpuAlloc *out)
+{
+	uint32_t types[2] =
+	{
+		findMemoryType(reqs->memoryTypeBits, required | preferred),
+		findMemoryType(reqs->memoryTypeBits, required),
+	};
+	for (uint32_t i = 0; i < ARRAYSIZE(types); i++)
+	{
+		if (i > 0 && types[i] == types[i - 1])
+			continue;
+		if (types[i] != UINT32_MAX && !gpuAllocFromType(types[i], reqs, optimal, out))
+			return 0;
+	}
+	eprintf("Out of device memory for %llu bytes (types %08x, flags %08x)\n",
+		(unsigned long long)reqs->size, reqs->memoryTypeBits, required);
+	return 1;
+}
+
+static void gpuFree(struct GpuAlloc *alloc)
+{
+	if (alloc->memory == VK_NULL_HANDLE)
+		return;
+	gpuAllocator.bytesRequested -= alloc->size;
+	gpuAllocator.liveAllocations--;
+	if (alloc->block == UINT32_MAX)
+	{
+		gpuAllocator.bytesReserved -= alloc->size;
+		gpuAllocator.bytesDeviceMemory -= alloc->size;
+		gpuAllocator.deviceAllocations--;
+		vkFreeMemory(vkDevice, alloc->memory, 0);
+	}
+	else
+	{
+		gpuAllocator.bytesReserved -= GPU_MIN_ALLOC << alloc->order;
+		gpuBuddyFree(&gpuAllocator.blocks[alloc->block], alloc->offset, alloc->order);
+	}
+	memset(alloc, 0, sizeof(*alloc));
+}
+
+static int gpuAllocBuffer(VkBuffer buffer, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, struct GpuAlloc *out)
+{
+	VkMemoryRequirements vkMemReqs;
+	vkGetBufferMemoryRequirements(vkDevice, buffer, &vkMemReqs);
+	if (gpuAlloc(&vkMemReqs, required, preferred, false, out))
+		return 1;
+	if (VK_SUCCESS != vkBindBufferMemory(vkDevice, buffer, out->memory, out->offset))
+	{
+		gpuFree(out);
+		return 1;
+	}
+	return 0;
+}
+
+static int gpuAllocImage(VkImage image, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, struct GpuAlloc *out)
+{
+	VkMemoryRequirements vkMemReqs;
+	vkGetImageMemoryRequirements(vkDevice, image, &vkMemReqs);
+	if (gpuAlloc(&vkMemReqs, required, preferred, true, out))
+		return 1;
+	if (VK_SUCCESS != vkBindImageMemory(vkDevice, image, out->memory, out->offset))
+	{
+		gpuFree(out);
+		return 1;
+	}
+	return 0;
+}
+
+// Makes host writes visible to the device when the memory isn't coherent
+static void gpuFlush(const struct GpuAlloc *alloc, VkDeviceSize offset, VkDeviceSize size)
+{
+	if (gpuAllocator.memProps.memoryTypes[alloc->memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+		return;
+	VkDeviceSize atom = vkPhysProps.limits.nonCoherentAtomSize;
+	VkDeviceSize start = (alloc->offset + offset) / atom * atom;
+	VkDeviceSize end = (alloc->offset + offset + size + atom - 1) / atom * atom;
+	VkMappedMemoryRange range =
+	{
+		.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+		.memory = alloc->memory,
+		.offset = start,
+		.size = end - start,
+	};
+	// Rounding the end up can't run past our buddy node, but it can past a dedicated allocation
+	if (alloc->block == UINT32_MAX && end > alloc->size)
+		range.size = VK_WHOLE_SIZE;
+	vkFlushMappedMemoryRanges(vkDevice, 1, &range);
+}
+
+static void gpuAllocatorReport(void)
+{
+	printf("gpu memory: %u device allocations, %u live sub-allocations in %u blocks\n",
+		gpuAllocator.deviceAllocations, gpuAllocator.liveAllocations, gpuAllocator.blocksCount);
+	printf("gpu memory: %.2f MiB allocated, %.2f MiB used, %.2f MiB wasted to rounding, %.2f MiB free\n",
+		gpuAllocator.bytesDeviceMemory / 1048576.0,
+		gpuAllocator.bytesRequested / 1048576.0,
+		(gpuAllocator.bytesReserved - gpuAllocator.bytesRequested) / 1048576.0,
+		(gpuAllocator.bytesDeviceMemory - gpuAllocator.bytesReserved) / 1048576.0);
+}
+
+/*
+ * Objects that frames still on the GPU might be using, so they can't be
+ * destroyed yet. Each is tagged with how many frames had been submitted
+ * when it was queued, and destroyed once all of those frames' fences have
+ * signaled. Buffers and images give their memory back at the same time.
+ */
+enum DeletionType
+{
+	DELETE_BUFFER,
+	DELETE_IMAGE,
+	DELETE_IMAGE_VIEW,
+	DELETE_FRAMEBUFFER,
+	DELETE_PIPELINE,
+	DELETE_DESCRIPTOR_POOL,
+	DELETE_SWAPCHAIN,
+};
+
+struct Deletion
+{
+	enum DeletionType type;
+	union
+	{
+		VkBuffer buffer;
+		VkImage image;
+		VkImageView imageView;
+		VkFramebuffer framebuffer;
+		VkPipeline pipeline;
+		VkDescriptorPool descriptorPool;
+		VkSwapchainKHR swapchain;
+	} handle;
+	struct GpuAlloc memory; // Buffers and images only, memory.memory is 0 without any
+	uint32_t frame; // Every frame before this one might still use it
+	double queuedMs;
+};
+
+struct DeletionQueue
+{
+	struct Deletion *items; // In the order they were queued
+	uint32_t count;
+	uint32_t capacity;
+	// Stats
+	uint32_t peak;
+	uint32_t reclaimed;
+	struct Samples reclaimMs; // From queued to destroyed
+} deletions = { 0 };
+
+static void destroyDeletion(struct Deletion *deletion)
+{
+	switch (deletion->type)
+	{
+	case DELETE_BUFFER:
+		vkDestroyBuffer(vkDevice, deletion->handle.buffer, 0);
+		break;
+	case DELETE_IMAGE:
+		vkDestroyImage(vkDevice, deletion->handle.image, 0);
+		break;
+	case DELETE_IMAGE_VIEW:
+		vkDestroyImageView(vkDevice, deletion->handle.imageView, 0);
+		break;
+	case DELETE_FRAMEBUFFER:
+		vkDestroyFramebuffer(vkDevice, deletion->handle.framebuffer, 0);
+		break;
+	case DELETE_PIPELINE:
+		vkDestroyPipeline(vkDevice, deletion->handle.pipeline, 0);
+		break;
+	case DELETE_DESCRIPTOR_POOL:
+		vkDestroyDescriptorPool(vkDevice, deletion->handle.descriptorPool, 0);
+		break;
+	case DELETE_SWAPCHAIN:
+		vkDestroySwapchainKHR(vkDevice, deletion->handle.swapchain, 0);
+		break;
+	}
+	if (deletion->memory.memory)
+		gpuFree(&deletion->memory);
+}
+
+static void deferDeletion(struct Deletion deletion)
+{
+	if (deletions.count == deletions.capacity)
+	{
+		uint32_t capacity = deletions.capacity ? deletions.capacity * 2 : 64;
+		struct Deletion *items = realloc(deletions.items, capacity * sizeof(*items));
+		if (items == NULL)
+		{
+			// A stall beats a leak
+			eprintf("No memory to defer a deletion, so waiting on the device instead!\n");
+			vkDeviceWaitIdle(vkDevice);
+			destroyDeletion(&deletion);
+			return;
+		}
+		deletions.items = items;
+		deletions.capacity = capacity;
+	}
+	deletion.queuedMs = nowMs();
+	deletions.items[deletions.count++] = deletion;
+	deletions.peak = maxu32(deletions.peak, deletions.count);
+}
+
+// Takes the memory too, if there is any
+static void deferBuffer(VkBuffer buffer, struct GpuAlloc *memory, uint32_t frame)
+{
+	struct Deletion deletion = { .type = DELETE_BUFFER, .handle.buffer = buffer, .frame = frame };
+	if (memory)
+		deletion.memory = *memory;
+	deferDeletion(deletion);
+}
+
+static void deferImage(VkImage image, struct GpuAlloc *memory, uint32_t frame)
+{
+	struct Deletion deletion = { .type = DELETE_IMAGE, .handle.image = image, .frame = frame };
+	if (memory)
+		deletion.memory = *memory;
+	deferDeletion(deletion);
+}
+
+static void deferImageView(VkImageView imageView, uint32_t frame)
+{
+	deferDeletion((struct Deletion){ .type = DELETE_IMAGE_VIEW, .handle.imageView = imageView, .frame = frame });
+}
+
+static void deferFramebuffer(VkFramebuffer framebuffer, uint32_t frame)
+{
+	deferDeletion((struct Deletion){ .type = DELETE_FRAMEBUFFER, .handle.framebuffer = framebuffer, .frame = frame });
+}
+
+static void deferPipeline(VkPipeline pipeline, uint32_t frame)
+{
+	deferDeletion((struct Deletion){ .type = DELETE_PIPELINE, .handle.pipeline = pipeline, .frame = frame });
+}
+
+static void deferDescriptorPool(VkDescriptorPool descriptorPool, uint32_t frame)
+{
+	deferDeletion((struct Deletion){ .type = DELETE_DESCRIPTOR_POOL, .handle.descriptorPool = descriptorPool, .frame = frame });
+}
+
+static void deferSwapchain(VkSwapchainKHR swapchain, uint32_t frame)
+{
+	deferDeletion((struct Deletion){ .type = DELETE_SWAPCHAIN, .handle.swapchain = swapchain, .frame = frame });
+}
+
+// Call with the first frame that might still be on the GPU
+static void processDeletions(uint32_t firstPending)
+{
+	double now = nowMs();
+	uint32_t kept = 0;
+	for (uint32_t i = 0; i < deletions.count; i++)
+	{
+		struct Deletion *deletion = &deletions.items[i];
+		if (deletion->frame > firstPending)
+		{
+			deletions.items[kept++] = *deletion;
+			continue;
+		}
+		destroyDeletion(deletion);
+		samplesPush(&deletions.reclaimMs, now - deletion->queuedMs);
+		deletions.reclaimed++;
+	}
+	deletions.count = kept;
+}
+
+// Sorts the samples, like samplesReport()
+static void deletionsReport(void)
+{
+	printf("deletion queue: %u waiting, %u at most, %u reclaimed\n", deletions.count, deletions.peak, deletions.reclaimed);
+	samplesReport("reclaim latency (ms)", &deletions.reclaimMs);
+}
+
+/*
+ * Descriptor sets come out of a list of pools that grows whenever the ones
+ * it has run out, instead of a pool sized by hand for exactly what goes in
+ * it. Every pool has room for DESCRIPTOR_POOL_SETS sets of any mix of the
+ * types in descriptorPoolRatios. Sets are never freed one at a time, the
+ * whole list is reset at once, and the pools stay around for next time.
+ * The per-frame lists get reset as soon as their frame's fence signals.
+ */
+#define DESCRIPTOR_POOL_SETS 1024
+// Sets per vkAllocateDescriptorSets call
+#define DESCRIPTOR_BATCH 64
+
+// Descriptors per set, on average
+static const VkDescriptorPoolSize descriptorPoolRatios[] =
+{
+	{ .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .descriptorCount = 1 },
+	{ .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, .descriptorCount = 1 },
+	{ .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 3 },
+	{ .type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, .descriptorCount = 1 },
+	{ .type = VK_DESCRIPTOR_TYPE_SAMPLER, .descriptorCount = 1 },
+};
+
+struct DescriptorPools
+{
+	VkDescriptorPool *pools;
+	uint32_t count;
+	uint32_t capacity;
+	uint32_t current; // Everything before this one is full
+};
+// Reset by the frame loop, after the slot's fence and before anything allocates from it
+struct DescriptorPools frameDescriptorPools[MAX_FRAMES_IN_FLIGHT] = { 0 };
+
+static int descriptorPoolsGrow(struct DescriptorPools *pools)
+{
+	if (pools->count == pools->capacity)
+	{
+		uint32_t capacity = pools->capacity ? pools->capacity * 2 : 4;
+		VkDescriptorPool *grown = realloc(pools->pools, capacity * sizeof(*grown));
+		if (grown == NULL)
+		{
+			eprintf("Out of memory for descriptor pools!\n");
+			return 1;
+		}
+		pools->pools = grown;
+		pools->capacity = capacity;
+	}
+	VkDescriptorPoolSize vkDescPoolSizes[ARRAYSIZE(descriptorPoolRatios)];
+	for (uint32_t i = 0; i < ARRAYSIZE(vkDescPoolSizes); i++)
+	{
+		vkDescPoolSizes[i] = descriptorPoolRatios[i];
+		vkDescPoolSizes[i].descriptorCount *= DESCRIPTOR_POOL_SETS;
+	}
+	VkDescriptorPoolCreateInfo vkdpcInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.poolSizeCount = ARRAYSIZE(vkDescPoolSizes),
+		.pPoolSizes = vkDescPoolSizes,
+		.maxSets = DESCRIPTOR_POOL_SETS,
+	};
+	if (VK_SUCCESS != vkCreateDescriptorPool(vkDevice, &vkdpcInfo, 0, &pools->pools[pools->count]))
+	{
+		eprintf("Failed to create descriptor pool!\n");
+		return 1;
+	}
+	pools->count++;
+	return 0;
+}
+
+// count sets with the same layout, from one thread at a time per list
+static int descriptorPoolsAllocate(struct DescriptorPools *pools, VkDescriptorSetLayout layout, uint32_t count, VkDescriptorSet *sets)
+{
+	VkDescriptorSetLayout vkDescLayouts[DESCRIPTOR_BATCH];
+	for (uint32_t i = 0; i < DESCRIPTOR_BATCH; i++)
+		vkDescLayouts[i] = layout;
+	bool fresh = false;
+	for (uint32_t done = 0; done < count;)
+	{
+		if (pools->current == pools->count)
+		{
+			if (0 != descriptorPoolsGrow(pools))
+				return 1;
+			fresh = true;
+		}
+		VkDescriptorSetAllocateInfo vkdsaInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.descriptorPool = pools->pools[pools->current],
+			.descriptorSetCount = minu32(count - done, DESCRIPTOR_BATCH),
+			.pSetLayouts = vkDescLayouts,
+		};
+		VkResult result = vkAllocateDescriptorSets(vkDevice, &vkdsaInfo, &sets[done]);
+		if ((result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) && !fresh)
+		{
+			// Not enough left in this one for the batch, so it counts as full
+			pools->current++;
+			continue;
+		}
+		if (result != VK_SUCCESS)
+		{
+			eprintf("Failed to allocate descriptor sets! %d\n", result);
+			return 1;
+		}
+		done += vkdsaInfo.descriptorSetCount;
+		fresh = false;
+	}
+	return 0;
+}
+
+// Every set from the list goes with it, so whatever used them has to be done
+static void descriptorPoolsReset(struct DescriptorPools *pools)
+{
+	for (uint32_t i = 0; i < pools->count && i <= pools->current; i++)
+		vkResetDescriptorPool(vkDevice, pools->pools[i], 0);
+	pools->current = 0;
+}
+
+// Frames before frame might still be using the sets
+static void destroyDescriptorPools(struct DescriptorPools *pools, uint32_t frame)
+{
+	for (uint32_t i = 0; i < pools->count; i++)
+		deferDescriptorPool(pools->pools[i], frame);
+	free(pools->pools);
+	memset(pools, 0, sizeof(*pools));
+}
+
+/*
+ * Descriptor writes pile up here and go to the driver in one
+ * vkUpdateDescriptorSets. The buffer and image infos only get pointed at
+ * once they've stopped moving around, in the order the writes used them.
+ */
+struct DescriptorWrites
+{
+	VkWriteDescriptorSet *writes;
+	uint32_t count;
+	uint32_t capacity;
+	VkDescriptorBufferInfo *buffers;
+	uint32_t buffersCount;
+	uint32_t buffersCapacity;
+	VkDescriptorImageInfo *images;
+	uint32_t imagesCount;
+	uint32_t imagesCapacity;
+} descriptorWrites = { 0 };
+
+// Makes room for needed more items in an array of size bytes each
+static int descriptorWritesGrow(void **items, uint32_t *capacity, uint32_t needed, size_t size)
+{
+	uint32_t grownCapacity = *capacity ? *capacity : 256;
+	while (grownCapacity < needed)
+		grownCapacity *= 2;
+	if (grownCapacity == *capacity)
+		return 0;
+	void *grown = realloc(*items, grownCapacity * size);
+	if (grown == NULL)
+	{
+		eprintf("Out of memory for descriptor writes!\n");
+		return 1;
+	}
+	*items = grown;
+	*capacity = grownCapacity;
+	return 0;
+}
+
+static bool descriptorTypeIsImage(VkDescriptorType type)
+{
+	return type == VK_DESCRIPTOR_TYPE_SAMPLER
+		|| type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+		|| type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE
+		|| type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE
+		|| type == VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+}
+
+static int descriptorWritePush(VkDescriptorSet set, uint32_t binding, uint32_t element, VkDescriptorType type, uint32_t count)
+{
+	if (0 != descriptorWritesGrow((void **)&descriptorWrites.writes, &descriptorWrites.capacity,
+		descriptorWrites.count + 1, sizeof(*descriptorWrites.writes)))
+		return 1;
+	descriptorWrites.writes[descriptorWrites.count++] = (VkWriteDescriptorSet)
+	{
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = set,
+		.dstBinding = binding,
+		.dstArrayElement = element,
+		.descriptorType = type,
+		.descriptorCount = count,
+	};
+	return 0;
+}
+
+// From element on in binding, rolling over into the next bindings if count runs past the end of it
+static int descriptorWriteBuffers(VkDescriptorSet set, uint32_t binding, uint32_t element, VkDescriptorType type,
+	const VkDescriptorBufferInfo *buffers, uint32_t count)
+{
+	if (0 != descriptorWritesGrow((void **)&descriptorWrites.buffers, &descriptorWrites.buffersCapacity,
+		descriptorWrites.buffersCount + count, sizeof(*buffers)))
+		return 1;
+	memcpy(&descriptorWrites.buffers[descriptorWrites.buffersCount], buffers, count * sizeof(*buffers));
+	descriptorWrites.buffersCount += count;
+	return descriptorWritePush(set, binding, element, type, count);
+}
+
+// Like descriptorWriteBuffers()
+static int descriptorWriteImages(VkDescriptorSet set, uint32_t binding, uint32_t element, VkDescriptorType type,
+	const VkDescriptorImageInfo *images, uint32_t count)
+{
+	if (0 != descriptorWritesGrow((void **)&descriptorWrites.images, &descriptorWrites.imagesCapacity,
+		descriptorWrites.imagesCount + count, sizeof(*images)))
+		return 1;
+	memcpy(&descriptorWrites.images[descriptorWrites.imagesCount], images, count * sizeof(*images));
+	descriptorWrites.imagesCount += count;
+	return descriptorWritePush(set, binding, element, type, count);
+}
+
+static void descriptorWritesFlush(void)
+{
+	uint32_t buffer = 0;
+	uint32_t image = 0;
+	for (uint32_t i = 0; i < descriptorWrites.count; i++)
+	{
+		VkWriteDescriptorSet *write = &descriptorWrites.writes[i];
+		if (descriptorTypeIsImage(write->descriptorType))
+		{
+			write->pImageInfo = &descriptorWrites.images[image];
+			image += write->descriptorCount;
+		}
+		else
+		{
+			write->pBufferInfo = &descriptorWrites.buffers[buffer];
+			buffer += write->descriptorCount;
+		}
+	}
+	if (descriptorWrites.count)
+		vkUpdateDescriptorSets(vkDevice, descriptorWrites.count, descriptorWrites.writes, 0, 0);
+	descriptorWrites.count = 0;
+	descriptorWrites.buffersCount = 0;
+	descriptorWrites.imagesCount = 0;
+}
+
+// Per-draw uniforms. This has to match Unis in vertex.glsl and bindless-vertex.glsl, std140, std430 and push constants alike.
+struct Unis
+{
+	float time;
+	float scale;
+	float offset[2];
+};
+
+/*
+ * The one set bindless draws bind, out of its own pool since only
+ * update-after-bind pools can have update-after-bind sets. Buffer 0 is
+ * the uniform ring, read as a storage buffer, and the materials' buffers
+ * and textures fill in the arrays from there. There's a set per frame in
+ * flight so streamed textures can be swapped in while other frames are
+ * still on the GPU, everything else is written between phases, and
+ * partially bound means whatever's stale in the rest of the arrays is fine
+ * as long as no draw indexes it.
+ */
+struct Bindless
+{
+	bool supported; // Descriptor indexing, with room for the arrays
+	VkDescriptorPool pool;
+	VkDescriptorSet sets[MAX_FRAMES_IN_FLIGHT];
+} bindless = { 0 };
+
+/*
+ * Uniforms for every draw of every frame in flight.
+ *
+ * The ring scheme is one persistently mapped buffer split into a region
+ * per frame in flight. Every draw has its own slice of its frame's region,
+ * and binds the one descriptor set with the slice as a dynamic offset,
+ * so more draws cost neither allocations nor descriptor writes. Slices
+ * are found by draw index rather than a bump pointer so that recording
+ * threads don't have to share one. A region is free again once that
+ * frame's fence has signalled.
+ *
+ * The buffers scheme is how this used to work, a buffer, allocation and
+ * descriptor set per frame in flight, just multiplied by the draw count.
+ * It's only still here to benchmark against.
+ *
+ * The transient scheme is the ring's buffer with how a renderer that binds
+ * per material would do it: every draw gets a set of its own every frame,
+ * out of that frame's descriptor pools, pointing straight at its slice.
+ * It's there to see what allocating and writing thousands of sets a frame
+ * costs.
+ *
+ * The push scheme records every draw's uniforms into the command buffer
+ * with vkCmdPushConstants, so there's nothing to write to memory or bind
+ * per draw. The storage scheme packs the ring's slices tight, binds the
+ * one set once, and every draw passes its slice as firstInstance for the
+ * shader to index by gl_InstanceIndex. The shader is the same for all of
+ * them, with a specialization constant picking where it reads from. The
+ * blocks it doesn't read from still have to be bound to something, so
+ * every scheme's sets have the buffer as storage at binding 1 too, and
+ * the push and storage schemes keep a ring buffer behind binding 0.
+ */
+struct Uniforms
+{
+	enum UniformScheme scheme;
+	uint32_t draws;
+	uint32_t columns; // Draws are laid out on a columns x columns grid
+	struct DescriptorPools descriptors;
+	// Ring has one of each, buffers has one per draw per frame in flight, and transient has the sets of buffers and the buffer of ring
+	VkBuffer *buffers;
+	struct GpuAlloc *memories;
+	VkDescriptorSet *sets;
+	uint32_t buffersCount;
+	uint32_t setsCount;
+	// Ring only, offsets are from the start of the buffer
+	VkDeviceSize ringStride; // sizeof(struct Unis) rounded up to minUniformBufferOffsetAlignment
+	VkDeviceSize ringFrameSize;
+} uniforms = { 0 };
+
+// Binding 1 of the uniform sets, all of buffer that a storage buffer descriptor can reach
+static VkDescriptorBufferInfo uniformsStorageInfo(VkBuffer buffer)
+{
+	VkDeviceSize size = uniforms.scheme == UNIFORMS_BUFFERS ? sizeof(struct Unis) : uniforms.ringFrameSize * opts.framesInFlight;
+	VkDeviceSize range = vkPhysProps.limits.maxStorageBufferRange;
+	return (VkDescriptorBufferInfo){ .buffer = buffer, .offset = 0, .range = size < range ? size : range };
+}
+
+static int createUniforms(enum UniformScheme scheme, uint32_t draws)
+{
+	memset(&uniforms, 0, sizeof(uniforms));
+	uniforms.scheme = scheme;
+	uniforms.draws = draws;
+	while (uniforms.columns * uniforms.columns < draws)
+		uniforms.columns++;
+	uniforms.setsCount = scheme == UNIFORMS_BUFFERS || scheme == UNIFORMS_TRANSIENT ? draws * opts.framesInFlight : 1;
+	uniforms.buffersCount = scheme == UNIFORMS_BUFFERS ? uniforms.setsCount : 1;
+	// The spec promises a power of two. Only slices bound as uniform buffers need aligning.
+	VkDeviceSize alignment = scheme == UNIFORMS_RING || scheme == UNIFORMS_TRANSIENT ? vkPhysProps.limits.minUniformBufferOffsetAlignment : 1;
+	uniforms.ringStride = (sizeof(struct Unis) + alignment - 1) & ~(alignment - 1);
+	uniforms.ringFrameSize = uniforms.ringStride * draws;
+	if (!(uniforms.buffers = calloc(uniforms.buffersCount, sizeof(*uniforms.buffers)))
+		|| !(uniforms.memories = calloc(uniforms.buffersCount, sizeof(*uniforms.memories)))
+		|| !(uniforms.sets = calloc(uniforms.setsCount, sizeof(*uniforms.sets))))
+	{
+		eprintf("Out of memory for %u draws worth of uniforms!\n", draws);
+		return 1;
+	}
+
+	for (uint32_t i = 0; i < uniforms.buffersCount; i++)
+	{
+		VkBufferCreateInfo vkbcInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			// Every scheme's sets have it at binding 1 as well, and the bindless set reads the ring as buffer 0
+			.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			.size = scheme == UNIFORMS_BUFFERS ? sizeof(struct Unis) : uniforms.ringFrameSize * opts.framesInFlight,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.flags = 0,
+		};
+		if (VK_SUCCESS != vkCreateBuffer(vkDevice, &vkbcInfo, 0, &uniforms.buffers[i]))
+		{
+			eprintf("Unable to create uniform buffer!\n");
+			return 1;
+		}
+		// Coherent so nobody has to remember to flush after poking the uniforms in
+		if (gpuAllocBuffer(uniforms.buffers[i], VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &uniforms.memories[i]))
+		{
+			eprintf("Booooooo! Failed to map uniform buffer memories!\n");
+			return 1;
+		}
+	}
+
+	// Now the descriptors for the buffers. Ughhhhhhhhhhhhhhhhhhhh...
+	if (scheme == UNIFORMS_TRANSIENT)
+		return 0;
+	if (0 != descriptorPoolsAllocate(&uniforms.descriptors, vkUniformLayouts[scheme], uniforms.setsCount, uniforms.sets))
+		return 1;
+	for (uint32_t i = 0; i < uniforms.setsCount; i++)
+	{
+		// The dynamic offset gets added to this one for the ring
+		VkDescriptorBufferInfo bufInfo =
+		{
+			.buffer = uniforms.buffers[i],
+			.offset = 0,
+			.range = sizeof(struct Unis),
+		};
+		VkDescriptorBufferInfo storageInfo = uniformsStorageInfo(uniforms.buffers[i]);
+		if (0 != descriptorWriteBuffers(uniforms.sets[i], 0, 0,
+			scheme == UNIFORMS_RING ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &bufInfo, 1)
+			|| 0 != descriptorWriteBuffers(uniforms.sets[i], 1, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &storageInfo, 1))
+			return 1;
+	}
+	descriptorWritesFlush();
+	return 0;
+}
+
+// Gives every draw of the frame its set, once the frame's fence has signalled and its pools are reset
+static int uniformsBeginFrame(uint32_t inFlight)
+{
+	if (uniforms.scheme != UNIFORMS_TRANSIENT)
+		return 0;
+	VkDescriptorSet *sets = &uniforms.sets[inFlight * uniforms.draws];
+	if (0 != descriptorPoolsAllocate(&frameDescriptorPools[inFlight], vkUniformLayouts[UNIFORMS_TRANSIENT], uniforms.draws, sets))
+		return 1;
+	for (uint32_t draw = 0; draw < uniforms.draws; draw++)
+	{
+		VkDescriptorBufferInfo bufInfo =
+		{
+			.buffer = uniforms.buffers[0],
+			.offset = inFlight * uniforms.ringFrameSize + draw * uniforms.ringStride,
+			.range = sizeof(struct Unis),
+		};
+		VkDescriptorBufferInfo storageInfo = uniformsStorageInfo(uniforms.buffers[0]);
+		if (0 != descriptorWriteBuffers(sets[draw], 0, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &bufInfo, 1)
+			|| 0 != descriptorWriteBuffers(sets[draw], 1, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &storageInfo, 1))
+			return 1;
+	}
+	descriptorWritesFlush();
+	return 0;
+}
+
+// Frames before frame might still be reading them
+static void destroyUniforms(uint32_t frame)
+{
+	destroyDescriptorPools(&uniforms.descriptors, frame);
+	for (uint32_t i = 0; i < uniforms.buffersCount; i++)
+		deferBuffer(uniforms.buffers[i], &uniforms.memories[i], frame);
+	free(uniforms.buffers);
+	free(uniforms.memories);
+	free(uniforms.sets);
+	memset(&uniforms, 0, sizeof(uniforms));
+}
+
+/*
+ * Where the uniforms of this draw go, and the descriptor set and dynamic
+ * offset to bind them with. The frame in flight's fence has to have
+ * signalled already. Safe to call from any thread. Not for the push
+ * scheme, which has nowhere for them to go.
+ */
+static struct Unis *uniformsForDraw(uint32_t inFlight, uint32_t draw, VkDescriptorSet *set, uint32_t *dynamicOffset)
+{
+	uint32_t i = inFlight * uniforms.draws + draw;
+	if (uniforms.scheme == UNIFORMS_BUFFERS)
+	{
+		*set = uniforms.sets[i];
+		*dynamicOffset = 0;
+		return uniforms.memories[i].mapped;
+	}
+	// The transient sets point at the slice already
+	uint32_t offset = (uint32_t)(inFlight * uniforms.ringFrameSize + draw * uniforms.ringStride);
+	*set = uniforms.scheme == UNIFORMS_TRANSIENT ? uniforms.sets[i] : uniforms.sets[0];
+	*dynamicOffset = uniforms.scheme == UNIFORMS_RING ? offset : 0;
+	return (struct Unis *)((char *)uniforms.memories[0].mapped + offset);
+}
+
+/*
+ * How the CPU keeps up with the graphics queue. With fences, everything
+ * that needs waiting on gets its own fence, which has to be reset before
+ * every submit. With a timeline, every submit to the graphics queue,
+ * frames and upload ownership acquires alike, signals the next value of
+ * one timeline semaphore. Waiting on any of them is waiting for that
+ * value, and values only go up, so there's nothing to reset.
+ *
+ * The transfer queue keeps its fences. Its submits would have to signal
+ * the same timeline in an order the graphics queue can't promise, and
+ * stagingFinish() waits for them right away anyways. Async culling keeps
+ * its binary semaphores for the same reason: a value it signals has to
+ * land after every lower one, so the next frame's culling would have to
+ * wait out all of this frame's graphics work, which is the overlap it's
+ * there for. The frame's value still covers it, since the graphics
+ * submit that signals it waits on the culling first.
+ */
+struct FrameSync
+{
+	enum SyncScheme scheme;
+	VkSemaphore timeline; // 0 when the device can't
+	uint64_t timelineValue; // The last value submitted
+	PFN_vkWaitSemaphores waitSemaphores;
+} frameSync = { 0 };
+
+static int createFrameSync(bool timelineSupported)
+{
+	memset(&frameSync, 0, sizeof(frameSync));
+	if (!timelineSupported)
+		return 0;
+	VkSemaphoreTypeCreateInfo vkstcInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+		.initialValue = 0,
+	};
+	VkSemaphoreCreateInfo vksemcInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		.pNext = &vkstcInfo,
+	};
+	frameSync.waitSemaphores = (PFN_vkWaitSemaphores)vkGetDeviceProcAddr(vkDevice, "vkWaitSemaphores");
+	if (!frameSync.waitSemaphores || VK_SUCCESS != vkCreateSemaphore(vkDevice, &vksemcInfo, 0, &frameSync.timeline))
+	{
+		eprintf("Failed to create the timeline semaphore!\n");
+		return 1;
+	}
+	return 0;
+}
+
+// Waits on whatever syncSubmit() handed back, which is the fence or the value depending on the scheme
+static void syncWait(VkFence fence, uint64_t value)
+{
+	if (frameSync.scheme == SYNC_FENCES)
+	{
+		vkWaitForFences(vkDevice, 1, &fence, VK_TRUE, UINT64_MAX);
+		return;
+	}
+	VkSemaphoreWaitInfo vkswInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+		.semaphoreCount = 1,
+		.pSemaphores = &frameSync.timeline,
+		.pValues = &value,
+	};
+	frameSync.waitSemaphores(vkDevice, &vkswInfo, UINT64_MAX);
+}
+
+/*
+ * Submits a single batch to the graphics queue. With fences, the fence gets
+ * reset and signaled. With the timeline, the batch also signals the next
+ * value, which goes in *value.
+ */
+static VkResult syncSubmit(VkQueue queue, const VkSubmitInfo *submitInfo, VkFence fence, uint64_t *value)
+{
+	if (frameSync.scheme == SYNC_FENCES)
+	{
+		vkResetFences(vkDevice, 1, &fence);
+		return vkQueueSubmit(queue, 1, submitInfo, fence);
+	}
+	// The timeline goes after whatever binary semaphores there are, which ignore their values
+	VkSemaphore signals[2];
+	uint64_t values[ARRAYSIZE(signals)] = { 0 };
+	uint32_t signalsCount = submitInfo->signalSemaphoreCount;
+	if (signalsCount >= ARRAYSIZE(signals))
+		return VK_ERROR_INITIALIZATION_FAILED;
+	memcpy(signals, submitInfo->pSignalSemaphores, signalsCount * sizeof(*signals));
+	*value = ++frameSync.timelineValue;
+	signals[signalsCount] = frameSync.timeline;
+	values[signalsCount++] = *value;
+	VkTimelineSemaphoreSubmitInfo vktssInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.signalSemaphoreValueCount = signalsCount,
+		.pSignalSemaphoreValues = values,
+	};
+	VkSubmitInfo vkSubmitInfo = *submitInfo;
+	vkSubmitInfo.pNext = &vktssInfo;
+	vkSubmitInfo.signalSemaphoreCount = signalsCount;
+	vkSubmitInfo.pSignalSemaphores = signals;
+	return vkQueueSubmit(queue, 1, &vkSubmitInfo, VK_NULL_HANDLE);
+}
+
+/*
+ * A ring of host visible staging chunks that uploads get copied through.
+ * Each chunk has its own command buffer and fence, so the CPU can fill
+ * the next chunk while the copy out of the last one is still running.
+ * The copies go on a transfer-only queue family when the device has one,
+ * those are usually DMA engines that can run alongside graphics.
+ */
+struct StagingRing
+{
+	VkBuffer buffer;
+	struct GpuAlloc memory;
+	uint32_t queueFamily;
+	VkQueue queue;
+	VkCommandPool pool;
+	VkCommandBuffer commandBuffers[STAGING_CHUNKS_COUNT];
+	VkFence fences[STAGING_CHUNKS_COUNT];
+	uint32_t next;
+	uint64_t bytesUploaded;
+	// Graphics side of queue family ownership transfers
+	VkCommandBuffer acquireCommandBuffer;
+	VkFence acquireFence;
+	uint64_t acquireValue; // Instead of the fence with the timeline
+} staging = { 0 };
+
+static int createStagingRing(uint32_t queueFamily)
+{
+	staging.queueFamily = queueFamily;
+	vkGetDeviceQueue(vkDevice, queueFamily, 0, &staging.queue);
+	VkBufferCreateInfo vkbcInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		.size = STAGING_CHUNK_SIZE * STAGING_CHUNKS_COUNT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+	if (VK_SUCCESS != vkCreateBuffer(vkDevice, &vkbcInfo, 0, &staging.buffer)
+		|| gpuAllocBuffer(staging.buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging.memory))
+	{
+		eprintf("Failed to create the staging buffer!\n");
+		return 1;
+	}
+	VkCommandPoolCreateInfo vkpcInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+		.queueFamilyIndex = queueFamily,
+	};
+	if (VK_SUCCESS != vkCreateCommandPool(vkDevice, &vkpcInfo, 0, &staging.pool))
+	{
+		eprintf("Failed to create the staging command pool!\n");
+		return 1;
+	}
+	VkCommandBufferAllocateInfo vkcbaInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = staging.pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = STAGING_CHUNKS_COUNT,
+	};
+	if (VK_SUCCESS != vkAllocateCommandBuffers(vkDevice, &vkcbaInfo, staging.commandBuffers))
+	{
+		eprintf("Failed to allocate the staging command buffers!\n");
+		return 1;
+	}
+	VkFenceCreateInfo vkfcInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		.flags = VK_FENCE_CREATE_SIGNALED_BIT,
+	};
+	for (uint32_t i = 0; i < STAGING_CHUNKS_COUNT; i++)
+	{
+		if (VK_SUCCESS != vkCreateFence(vkDevice, &vkfcInfo, 0, &staging.fences[i]))
+		{
+			eprintf("Failed to create the staging fences!\n");
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Waits for the next chunk to be free and starts recording into its command buffer
+static VkCommandBuffer stagingBeginChunk(uint32_t *chunk)
+{
+	*chunk = staging.next++ % STAGING_CHUNKS_COUNT;
+	VkCommandBuffer commandBuffer = staging.commandBuffers[*chunk];
+	vkWaitForFences(vkDevice, 1, &staging.fences[*chunk], VK_TRUE, UINT64_MAX);
+	vkResetFences(vkDevice, 1, &staging.fences[*chunk]);
+	vkResetCommandBuffer(commandBuffer, 0);
+	VkCommandBufferBeginInfo vkcbbInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+	if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffer, &vkcbbInfo))
+	{
+		eprintf("Beginning staging command buffer failed!\n");
+		return VK_NULL_HANDLE;
+	}
+	return commandBuffer;
+}
+
+static int stagingSubmitChunk(uint32_t chunk)
+{
+	VkSubmitInfo vkSubmitInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &staging.commandBuffers[chunk],
+	};
+	if (VK_SUCCESS != vkEndCommandBuffer(staging.commandBuffers[chunk])
+		|| VK_SUCCESS != vkQueueSubmit(staging.queue, 1, &vkSubmitInfo, staging.fences[chunk]))
+	{
+		eprintf("Failed to submit staging copy!\n");
+		return 1;
+	}
+	return 0;
+}
+
+// Copies size bytes from src to dst at dstOffset, a chunk at a time
+static int stagingUpload(VkBuffer dst, VkDeviceSize dstOffset, const void *src, VkDeviceSize size)
+{
+	while (size > 0)
+	{
+		uint32_t chunk;
+		VkCommandBuffer commandBuffer = stagingBeginChunk(&chunk);
+		if (commandBuffer == VK_NULL_HANDLE)
+			return 1;
+		VkDeviceSize len = size < STAGING_CHUNK_SIZE ? size : STAGING_CHUNK_SIZE;
+		VkDeviceSize srcOffset = chunk * STAGING_CHUNK_SIZE;
+		memcpy((char *)staging.memory.mapped + srcOffset, src, (size_t)len);
+		gpuFlush(&staging.memory, srcOffset, len);
+		VkBufferCopy region =
+		{
+			.srcOffset = srcOffset,
+			.dstOffset = dstOffset,
+			.size = len,
+		};
+		vkCmdCopyBuffer(commandBuffer, staging.buffer, dst, 1, &region);
+		if (0 != stagingSubmitChunk(chunk))
+			return 1;
+		src = (const char *)src + len;
+		dstOffset += len;
+		size -= len;
+		staging.bytesUploaded += len;
+	}
+	return 0;
+}
+
+// The rest of stagingFinish, with room for a barrier per buffer that the caller frees however this goes
+static int stagingFinishBarriers(VkBufferMemoryBarrier *barriers, const VkBuffer *buffers, uint32_t buffersCount,
+	VkPipelineStageFlags dstStage, VkAccessFlags dstAccess, uint32_t graphicsFamily, VkCommandPool graphicsPool, bool concurrent)
+{
+	bool ownershipTransfer = staging.queueFamily != graphicsFamily;
+	for (uint32_t i = 0; i < buffersCount; i++)
+	{
+		barriers[i] = (VkBufferMemoryBarrier)
+		{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			// A release's destination access is ignored
+			.dstAccessMask = ownershipTransfer ? 0 : dstAccess,
+			.srcQueueFamilyIndex = ownershipTransfer && !concurrent ? staging.queueFamily : VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = ownershipTransfer && !concurrent ? graphicsFamily : VK_QUEUE_FAMILY_IGNORED,
+			.buffer = buffers[i],
+			.offset = 0,
+			.size = VK_WHOLE_SIZE,
+		};
+	}
+
+	uint32_t chunk;
+	VkCommandBuffer commandBuffer = stagingBeginChunk(&chunk);
+	if (commandBuffer == VK_NULL_HANDLE)
+		return 1;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		ownershipTransfer ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : dstStage,
+		0, 0, 0, buffersCount, barriers, 0, 0);
+	if (0 != stagingSubmitChunk(chunk))
+		return 1;
+	vkWaitForFences(vkDevice, STAGING_CHUNKS_COUNT, staging.fences, VK_TRUE, UINT64_MAX);
+
+	if (ownershipTransfer)
+	{
+		for (uint32_t i = 0; i < buffersCount; i++)
+		{
+			barriers[i].srcAccessMask = 0;
+			barriers[i].dstAccessMask = dstAccess;
+		}
+		VkCommandBufferAllocateInfo vkcbaInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.commandPool = graphicsPool,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = 1,
+		};
+		VkFenceCreateInfo vkfcInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+			.flags = VK_FENCE_CREATE_SIGNALED_BIT,
+		};
+		if (staging.acquireCommandBuffer == VK_NULL_HANDLE
+			&& (VK_SUCCESS != vkAllocateCommandBuffers(vkDevice, &vkcbaInfo, &staging.acquireCommandBuffer)
+				|| VK_SUCCESS != vkCreateFence(vkDevice, &vkfcInfo, 0, &staging.acquireFence)))
+		{
+			eprintf("Failed to create the ownership acquire command buffer!\n");
+			return 1;
+		}
+		// Only the last acquire can still be around, and it's long done by the time anyone uploads again
+		syncWait(staging.acquireFence, staging.acquireValue);
+		vkResetCommandBuffer(staging.acquireCommandBuffer, 0);
+		VkCommandBufferBeginInfo vkcbbInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		};
+		if (VK_SUCCESS != vkBeginCommandBuffer(staging.acquireCommandBuffer, &vkcbbInfo))
+		{
+			eprintf("Failed to begin the ownership acquire!\n");
+			return 1;
+		}
+		vkCmdPipelineBarrier(staging.acquireCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage,
+			0, 0, 0, buffersCount, barriers, 0, 0);
+		VkSubmitInfo vkSubmitInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.commandBufferCount = 1,
+			.pCommandBuffers = &staging.acquireCommandBuffer,
+		};
+		VkQueue graphicsQueue;
+		vkGetDeviceQueue(vkDevice, graphicsFamily, 0, &graphicsQueue);
+		if (VK_SUCCESS != vkEndCommandBuffer(staging.acquireCommandBuffer)
+			|| VK_SUCCESS != syncSubmit(graphicsQueue, &vkSubmitInfo, staging.acquireFence, &staging.acquireValue))
+		{
+			eprintf("Failed to submit the ownership acquire!\n");
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Waits for every upload so far to land and makes the buffers readable by
+ * dstStage/dstAccess on the graphics queue family.
+ *
+ * With a separate transfer family, the exclusive buffers have to be
+ * released by it and acquired by graphics. That's done once per buffer
+ * here, batched into one barrier on each side, rather than per chunk.
+ * The acquire is submitted without waiting, queue submission order already
+ * puts it before any frame that draws with the buffers.
+ * Concurrent buffers don't change hands, but still get the same two
+ * barriers with the queue families ignored.
+ */
+static int stagingFinish(const VkBuffer *buffers, uint32_t buffersCount, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess,
+	uint32_t graphicsFamily, VkCommandPool graphicsPool, bool concurrent)
+{
+	VkBufferMemoryBarrier *barriers = malloc(buffersCount * sizeof(*barriers));
+	if (barriers == NULL)
+	{
+		eprintf("Out of memory for staging barriers!\n");
+		return 1;
+	}
+	int err = stagingFinishBarriers(barriers, buffers, buffersCount, dstStage, dstAccess, graphicsFamily, graphicsPool, concurrent);
+	free(barriers);
+	return err;
+}
+
+// stagingUpload in pieces that fit dst, each one over the last
+static int stagingUploadWrapped(VkBuffer dst, VkDeviceSize dstSize, const void *src, VkDeviceSize size)
+{
+	for (VkDeviceSize offset = 0; offset < size; offset += dstSize)
+	{
+		if (0 != stagingUpload(dst, 0, (const char *)src + (size_t)offset, size - offset < dstSize ? size - offset : dstSize))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Like stagingUploadWrapped, but fp is read straight into the staging
+ * chunks until it runs dry, so the ring is the only buffer the file ever
+ * passes through, however big it is. dstSize has to be a whole number of chunks.
+ */
+static int stagingUploadStream(VkBuffer dst, VkDeviceSize dstSize, FILE *fp, uint64_t *total)
+{
+	*total = 0;
+	for (;;)
+	{
+		uint32_t chunk;
+		VkCommandBuffer commandBuffer = stagingBeginChunk(&chunk);
+		if (commandBuffer == VK_NULL_HANDLE)
+			return 1;
+		VkDeviceSize srcOffset = chunk * STAGING_CHUNK_SIZE;
+		size_t len = fread((char *)staging.memory.mapped + srcOffset, 1, (size_t)STAGING_CHUNK_SIZE, fp);
+		// The chunk was begun and its fence reset, so it goes in empty to signal it again
+		if (len == 0)
+			return stagingSubmitChunk(chunk) || ferror(fp);
+		gpuFlush(&staging.memory, srcOffset, len);
+		VkBufferCopy region =
+		{
+			.srcOffset = srcOffset,
+			.dstOffset = *total % dstSize,
+			.size = len,
+		};
+		vkCmdCopyBuffer(commandBuffer, staging.buffer, dst, 1, &region);
+		if (0 != stagingSubmitChunk(chunk))
+			return 1;
+		*total += len;
+		staging.bytesUploaded += len;
+	}
+}
+
+/*
+ * --bench-load PATH: uploads PATH to the GPU the three ways there are and
+ * reports the time and peak RSS for each. Stream reads into the staging
+ * ring, map copies into it from the mapped pages, and read is the old
+ * readfile, the whole file in a malloc first. Peak RSS never comes back
+ * down, so they go from the smallest footprint to the biggest.
+ */
+#define LOAD_WINDOW_SIZE (STAGING_CHUNK_SIZE * 16) // Uploads wrap around in a buffer this big
+
+static int benchLoad(const char *path)
+{
+	static const char *methods[] = { "stream", "map", "read" };
+	VkBufferCreateInfo vkbcInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = LOAD_WINDOW_SIZE,
+		.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+	VkBuffer dst;
+	struct GpuAlloc dstMemory;
+	if (VK_SUCCESS != vkCreateBuffer(vkDevice, &vkbcInfo, 0, &dst)
+		|| gpuAllocBuffer(dst, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, &dstMemory))
+	{
+		eprintf("Failed to create the load benchmark buffer!\n");
+		return 1;
+	}
+	printf("load %s: peak rss %.1f MiB before\n", path, peakRssMiB());
+	for (uint32_t m = 0; m < ARRAYSIZE(methods); m++)
+	{
+		double start = nowMs();
+		uint64_t total = 0;
+		int err = 1;
+		if (m == 0)
+		{
+			FILE *fp = fopen(path, "rb");
+			if (fp != NULL)
+			{
+				err = stagingUploadStream(dst, LOAD_WINDOW_SIZE, fp, &total);
+				fclose(fp);
+			}
+		}
+		else if (m == 1)
+		{
+			struct MappedFile file;
+			if (0 == mapFile(path, &file))
+			{
+				err = stagingUploadWrapped(dst, LOAD_WINDOW_SIZE, file.data, file.len);
+				total = file.len;
+				unmapFile(&file);
+			}
+		}
+		else
+		{
+			size_t len;
+			void *data = readfile(path, &len);
+			if (data != NULL)
+			{
+				err = stagingUploadWrapped(dst, LOAD_WINDOW_SIZE, data, len);
+				total = len;
+				free(data);
+			}
+		}
+		// It's not loaded until it's on the GPU
+		vkWaitForFences(vkDevice, STAGING_CHUNKS_COUNT, staging.fences, VK_TRUE, UINT64_MAX);
+		double ms = nowMs() - start;
+		if (err)
+			printf("load %-6s: failed\n", methods[m]);
+		else
+			printf("load %-6s: %.2f MiB in %.3f ms (%.1f MiB/s), peak rss %.1f MiB\n", methods[m], (double)total / 1048576.0, ms,
+				(double)total / 1048576.0 / (ms / 1000.0), peakRssMiB());
+	}
+	vkDestroyBuffer(vkDevice, dst, 0);
+	gpuFree(&dstMemory);
+	return 0;
+}
+
+// Matches the vertex inputs in vertex.glsl
+struct Vertex
+{
+	float pos[2];
+	float color[3];
+};
+
+struct Mesh
+{
+	VkBuffer vertexBuffer;
+	VkBuffer indexBuffer;
+	struct GpuAlloc vertexMemory;
+	struct GpuAlloc indexMemory;
+	uint32_t verticesCount;
+	uint32_t indicesCount;
+	float radius; // Of the bounding sphere around the origin
+	double uploadStart; // For time to first draw
+} mesh = { 0 };
+
+/*
+ * The tutorial triangle, cut into subdivisions^2 smaller triangles.
+ * It looks exactly the same, it's just a bigger upload.
+ */
+static int createMesh(uint32_t subdivisions, uint32_t graphicsFamily, VkCommandPool graphicsPool)
+{
+	static const struct Vertex corners[3] =
+	{
+		{ { 0.0f, 0.5773502691896257f }, { 1.0f, 0.0f, 0.0f } },
+		{ { -0.5f, -0.28867513459481287f }, { 0.0f, 1.0f, 0.0f } },
+		{ { 0.5f, -0.28867513459481287f }, { 0.0f, 0.0f, 1.0f } },
+	};
+	uint32_t n = subdivisions;
+	for (uint32_t k = 0; k < ARRAYSIZE(corners); k++)
+	{
+		float r2 = corners[k].pos[0] * corners[k].pos[0] + corners[k].pos[1] * corners[k].pos[1];
+		if (r2 > mesh.radius * mesh.radius)
+			mesh.radius = sqrtf(r2);
+	}
+	mesh.verticesCount = (n + 1) * (n + 2) / 2;
+	mesh.indicesCount = 3 * n * n;
+	struct Vertex *vertices = malloc(mesh.verticesCount * sizeof(*vertices));
+	uint32_t *indices = malloc(mesh.indicesCount * sizeof(*indices));
+	if (vertices == NULL || indices == NULL)
+	{
+		eprintf("Out of memory for a %u subdivision mesh!\n", n);
+		return 1;
+	}
+
+	// Row i has n + 1 - i vertices, weighted towards the second corner as i grows and the third as j does
+	struct Vertex *v = vertices;
+	for (uint32_t i = 0; i <= n; i++)
+	{
+		for (uint32_t j = 0; j <= n - i; j++, v++)
+		{
+			float w[3] = { 0, (float)i / n, (float)j / n };
+			w[0] = 1.0f - w[1] - w[2];
+			memset(v, 0, sizeof(*v));
+			for (uint32_t k = 0; k < ARRAYSIZE(corners); k++)
+			{
+				v->pos[0] += w[k] * corners[k].pos[0];
+				v->pos[1] += w[k] * corners[k].pos[1];
+				v->color[0] += w[k] * corners[k].color[0];
+				v->color[1] += w[k] * corners[k].color[1];
+				v->color[2] += w[k] * corners[k].color[2];
+			}
+		}
+	}
+	uint32_t *index = indices;
+	for (uint32_t i = 0; i < n; i++)
+	{
+		uint32_t row = i * (n + 1) - i * (i - 1) / 2;
+		uint32_t rowNext = row + n + 1 - i;
+		for (uint32_t j = 0; j < n - i; j++)
+		{
+			*index++ = row + j;
+			*index++ = rowNext + j;
+			*index++ = row + j + 1;
+			if (j + 1 < n - i)
+			{
+				*index++ = rowNext + j;
+				*index++ = rowNext + j + 1;
+				*index++ = row + j + 1;
+			}
+		}
+	}
+
+	VkBufferCreateInfo vkbcInfos[] =
+	{
+		{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			.size = mesh.verticesCount * sizeof(*vertices),
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		},
+		{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			.size = mesh.indicesCount * sizeof(*indices),
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		},
+	};
+	if (VK_SUCCESS != vkCreateBuffer(vkDevice, &vkbcInfos[0], 0, &mesh.vertexBuffer)
+		|| VK_SUCCESS != vkCreateBuffer(vkDevice, &vkbcInfos[1], 0, &mesh.indexBuffer)
+		|| gpuAllocBuffer(mesh.vertexBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, &mesh.vertexMemory)
+		|| gpuAllocBuffer(mesh.indexBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, &mesh.indexMemory))
+	{
+		eprintf("Failed to create the mesh buffers!\n");
+		return 1;
+	}
+
+	mesh.uploadStart = nowMs();
+	uint64_t bytesBefore = staging.bytesUploaded;
+	VkBuffer buffers[] = { mesh.vertexBuffer, mesh.indexBuffer };
+	if (0 != stagingUpload(mesh.vertexBuffer, 0, vertices, vkbcInfos[0].size)
+		|| 0 != stagingUpload(mesh.indexBuffer, 0, indices, vkbcInfos[1].size)
+		|| 0 != stagingFinish(buffers, ARRAYSIZE(buffers), VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+			VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT, graphicsFamily, graphicsPool, false))
+		return 1;
+	double uploadMs = nowMs() - mesh.uploadStart;
+	double bytes = (double)(staging.bytesUploaded - bytesBefore);
+	printf("mesh upload: %u vertices, %u indices, %.2f MiB in %.3f ms (%.1f MB/s) on %s queue family %u\n",
+		mesh.verticesCount, mesh.indicesCount, bytes / 1048576.0, uploadMs, bytes / 1e3 / uploadMs,
+		staging.queueFamily == graphicsFamily ? "the graphics" : "transfer", staging.queueFamily);
+	free(vertices);
+	free(indices);
+	return 0;
+}
+
+/*
+ * Async compute moves the culling pass onto a compute-only queue family, if
+ * the device has one, so it can run alongside the previous frame's graphics
+ * work. Each frame's graphics submit waits on that frame's culling with a
+ * semaphore, which also orders the CPU's read of the visible count behind
+ * the frame's fence.
+ *
+ * The buffers both queues touch are concurrent across the families rather
+ * than being released and acquired twice a frame. They're created that way
+ * whenever there's a queue to share with, so phases with and without async
+ * compute use the exact same buffers.
+ */
+struct AsyncCompute
+{
+	uint32_t family; // UINT32_MAX when there isn't one or nobody asked
+	VkQueue queue;
+	VkCommandPool pool;
+	VkCommandBuffer commandBuffers[MAX_FRAMES_IN_FLIGHT];
+	VkSemaphore semaphores[MAX_FRAMES_IN_FLIGHT]; // Culling's done
+	uint32_t families[3]; // Graphics, compute and maybe transfer
+	uint32_t familiesCount; // 1 means nothing is shared
+	bool enabled; // The current phase culls on it
+} asyncCompute = { .family = UINT32_MAX };
+
+static int createAsyncCompute(uint32_t family, uint32_t graphicsFamily, uint32_t transferFamily)
+{
+	asyncCompute.family = family;
+	asyncCompute.families[asyncCompute.familiesCount++] = graphicsFamily;
+	if (family == UINT32_MAX)
+		return 0;
+	asyncCompute.families[asyncCompute.familiesCount++] = family;
+	// Instances get uploaded through staging too
+	if (transferFamily != graphicsFamily)
+		asyncCompute.families[asyncCompute.familiesCount++] = transferFamily;
+	vkGetDeviceQueue(vkDevice, family, 0, &asyncCompute.queue);
+	VkCommandPoolCreateInfo vkpcInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+		.queueFamilyIndex = family,
+	};
+	if (VK_SUCCESS != vkCreateCommandPool(vkDevice, &vkpcInfo, 0, &asyncCompute.pool))
+	{
+		eprintf("Failed to create the async compute command pool!\n");
+		return 1;
+	}
+	VkCommandBufferAllocateInfo vkcbaInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = asyncCompute.pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = opts.framesInFlight,
+	};
+	if (VK_SUCCESS != vkAllocateCommandBuffers(vkDevice, &vkcbaInfo, asyncCompute.commandBuffers))
+	{
+		eprintf("Failed to create the async compute command buffers!\n");
+		return 1;
+	}
+	VkSemaphoreCreateInfo vksemcInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+	};
+	for (uint32_t i = 0; i < opts.framesInFlight; i++)
+	{
+		if (VK_SUCCESS != vkCreateSemaphore(vkDevice, &vksemcInfo, 0, &asyncCompute.semaphores[i]))
+		{
+			eprintf("Failed to create the async compute semaphores!\n");
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// For buffers that both queues touch
+static void asyncComputeShare(VkBufferCreateInfo *vkbcInfo)
+{
+	if (asyncCompute.familiesCount < 2)
+		return;
+	vkbcInfo->sharingMode = VK_SHARING_MODE_CONCURRENT;
+	vkbcInfo->queueFamilyIndexCount = asyncCompute.familiesCount;
+	vkbcInfo->pQueueFamilyIndices = asyncCompute.families;
+}
+
+// Per-instance data. This is std430 so it has to match Instance in instanced-vertex.glsl.
+struct Instance
+{
+	float offset[2];
+	float scale;
+	float phase;
+};
+
+/*
+ * What the instanced, indirect and culled draw modes draw from: the instances
+ * in a storage buffer and, for indirect, the draw parameters in another GPU
+ * buffer. Either way it's a single draw call however many instances there
+ * are. The instances only need the time and camera out of the uniforms, so
+ * they share the first slice of the uniform ring.
+ *
+ * Culled mode has a compute pass write the draw parameters and the list of
+ * visible instances every frame, so those are per frame in flight. The
+ * indirect buffer stays host visible so the CPU can read back how many made
+ * it through once the frame's fence is signaled.
+ */
+struct Instances
+{
+	enum DrawMode mode; // DRAW_PER_DRAW means none of this was created
+	uint32_t count;
+	VkBuffer buffer;
+	struct GpuAlloc memory;
+	VkBuffer indirectBuffer;
+	struct GpuAlloc indirectMemory;
+	VkBuffer visibleBuffers[MAX_FRAMES_IN_FLIGHT];
+	struct GpuAlloc visibleMemory[MAX_FRAMES_IN_FLIGHT];
+	VkBuffer cullBuffers[MAX_FRAMES_IN_FLIGHT];
+	struct GpuAlloc cullMemory[MAX_FRAMES_IN_FLIGHT];
+	struct DescriptorPools descriptors;
+	VkDescriptorSet sets[MAX_FRAMES_IN_FLIGHT];
+	VkDescriptorSet cullSets[MAX_FRAMES_IN_FLIGHT];
+} instances = { 0 };
+
+// Needs createUniforms() with the ring scheme first
+static int createInstances(enum DrawMode mode, uint32_t count, uint32_t graphicsFamily, VkCommandPool graphicsPool)
+{
+	memset(&instances, 0, sizeof(instances));
+	instances.mode = mode;
+	instances.count = count;
+
+	// Same grid the per-draw mode lays the draws out on, with every instance spinning a bit out of step
+	struct Instance *data = malloc(count * sizeof(*data));
+	if (data == NULL)
+	{
+		eprintf("Out of memory for %u instances!\n", count);
+		return 1;
+	}
+	uint32_t columns = 1;
+	while (columns * columns < count)
+		columns++;
+	float cell = 2.0f / columns;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		data[i].offset[0] = -1.0f + cell * (i % columns + 0.5f);
+		data[i].offset[1] = -1.0f + cell * (i / columns + 0.5f);
+		data[i].scale = 1.0f / columns;
+		data[i].phase = i ? ((i * 2654435761u) >> 16) / 65536.0f : 0;
+	}
+	VkDrawIndexedIndirectCommand indirect =
+	{
+		.indexCount = mesh.indicesCount,
+		.instanceCount = count,
+		.firstIndex = 0,
+		.vertexOffset = 0,
+		.firstInstance = 0,
+	};
+
+	VkBufferCreateInfo vkbcInfos[] =
+	{
+		{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			.size = count * sizeof(*data),
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		},
+		{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			.size = sizeof(indirect),
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		},
+	};
+	asyncComputeShare(&vkbcInfos[0]);
+	if (VK_SUCCESS != vkCreateBuffer(vkDevice, &vkbcInfos[0], 0, &instances.buffer)
+		|| VK_SUCCESS != vkCreateBuffer(vkDevice, &vkbcInfos[1], 0, &instances.indirectBuffer)
+		|| gpuAllocBuffer(instances.buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, &instances.memory)
+		|| gpuAllocBuffer(instances.indirectBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, &instances.indirectMemory))
+	{
+		eprintf("Failed to create the instance buffers!\n");
+		return 1;
+	}
+	VkBuffer buffers[] = { instances.buffer, instances.indirectBuffer };
+	if (0 != stagingUpload(instances.buffer, 0, data, vkbcInfos[0].size)
+		|| 0 != stagingUpload(instances.indirectBuffer, 0, &indirect, vkbcInfos[1].size)
+		|| 0 != stagingFinish(buffers, ARRAYSIZE(buffers), VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT, graphicsFamily, graphicsPool, asyncCompute.familiesCount > 1))
+		return 1;
+	free(data);
+
+	if (mode == DRAW_CULLED)
+	{
+		if ((count + 63) / 64 > vkPhysProps.limits.maxComputeWorkGroupCount[0])
+		{
+			eprintf("Can't cull %u instances in one dispatch!\n", count);
+			return 1;
+		}
+		VkBufferCreateInfo vkbcInfoVisible =
+		{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			.size = count * sizeof(uint32_t),
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		};
+		VkBufferCreateInfo vkbcInfoCull =
+		{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			.size = sizeof(indirect),
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		};
+		asyncComputeShare(&vkbcInfoVisible);
+		asyncComputeShare(&vkbcInfoCull);
+		for (uint32_t i = 0; i < opts.framesInFlight; i++)
+		{
+			if (VK_SUCCESS != vkCreateBuffer(vkDevice, &vkbcInfoVisible, 0, &instances.visibleBuffers[i])
+				|| VK_SUCCESS != vkCreateBuffer(vkDevice, &vkbcInfoCull, 0, &instances.cullBuffers[i])
+				|| gpuAllocBuffer(instances.visibleBuffers[i], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, &instances.visibleMemory[i])
+				|| gpuAllocBuffer(instances.cullBuffers[i], VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &instances.cullMemory[i]))
+			{
+				eprintf("Failed to create the culling buffers!\n");
+				return 1;
+			}
+			// The compute pass fills in instanceCount, the rest never changes
+			memcpy(instances.cullMemory[i].mapped, &indirect, sizeof(indirect));
+		}
+	}
+
+	if (0 != descriptorPoolsAllocate(&instances.descriptors, vkInstancedLayout, opts.framesInFlight, instances.sets)
+		|| (mode == DRAW_CULLED && 0 != descriptorPoolsAllocate(&instances.descriptors, vkCullLayout, opts.framesInFlight, instances.cullSets)))
+	{
+		eprintf("Failed to allocate the instance descriptor sets!\n");
+		return 1;
+	}
+	for (uint32_t i = 0; i < opts.framesInFlight; i++)
+	{
+		// Only the culled pipeline reads binding 2, but the others still need something valid there
+		VkBuffer visible = mode == DRAW_CULLED ? instances.visibleBuffers[i] : instances.buffer;
+		VkDescriptorBufferInfo bufInfos[] =
+		{
+			{
+				.buffer = uniforms.buffers[0],
+				.offset = 0,
+				.range = sizeof(struct Unis),
+			},
+			{
+				.buffer = instances.buffer,
+				.offset = 0,
+				.range = VK_WHOLE_SIZE,
+			},
+			{
+				.buffer = visible,
+				.offset = 0,
+				.range = VK_WHOLE_SIZE,
+			},
+			{
+				.buffer = instances.cullBuffers[i],
+				.offset = 0,
+				.range = VK_WHOLE_SIZE,
+			},
+		};
+		if (0 != descriptorWriteBuffers(instances.sets[i], 0, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, &bufInfos[0], 1)
+			|| 0 != descriptorWriteBuffers(instances.sets[i], 1, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufInfos[1], 1)
+			|| 0 != descriptorWriteBuffers(instances.sets[i], 2, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufInfos[2], 1)
+			// The compute side, where the three storage buffers roll over into bindings 0 to 2
+			|| (mode == DRAW_CULLED && 0 != descriptorWriteBuffers(instances.cullSets[i], 0, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufInfos[1], 3)))
+			return 1;
+	}
+	descriptorWritesFlush();
+	return 0;
+}
+
+// How many instances the culling pass let through in the frame that last used inFlight
+static uint32_t instancesVisible(uint32_t inFlight)
+{
+	const VkDrawIndexedIndirectCommand *draw = instances.cullMemory[inFlight].mapped;
+	return draw->instanceCount;
+}
+
+// Frames before frame might still be reading them
+static void destroyInstances(uint32_t frame)
+{
+	if (instances.mode == DRAW_PER_DRAW)
+		return;
+	destroyDescriptorPools(&instances.descriptors, frame);
+	deferBuffer(instances.buffer, &instances.memory, frame);
+	deferBuffer(instances.indirectBuffer, &instances.indirectMemory, frame);
+	if (instances.mode == DRAW_CULLED)
+	{
+		for (uint32_t i = 0; i < opts.framesInFlight; i++)
+		{
+			deferBuffer(instances.visibleBuffers[i], &instances.visibleMemory[i], frame);
+			deferBuffer(instances.cullBuffers[i], &instances.cullMemory[i], frame);
+		}
+	}
+	memset(&instances, 0, sizeof(instances));
+}
+
+/*
+ * Materials for the per-draw scene, each a tint in a storage buffer and a
+ * streamed texture. Draws are handed out to them in runs, the way they'd
+ * come out of a renderer that sorts by material.
+ *
+ * Bound per material, every material has a set of its own that gets bound
+ * whenever the material changes, on top of the uniform set every draw binds
+ * for its dynamic offset. Bindless, every material goes into the arrays of
+ * the one bindless set, which is bound once, and draws only push the
+ * indices of their uniforms and material.
+ *
+ * Either way there's a copy of the sets per frame in flight, so a texture
+ * that streams in or out can have its descriptors rewritten one frame at
+ * a time, once the frame that last used each copy is done with it.
+ */
+// Buffer 0 of the bindless set is the uniform ring
+#define BINDLESS_FIRST_MATERIAL 1
+
+// std430, so it has to match Material in material-fragment.glsl and bindless-fragment.glsl
+struct MaterialParams
+{
+	float tint[4];
+	uint32_t texture; // Into the bindless textures, sets bound per material have theirs at binding 1
+	uint32_t pad[3];
+};
+
+// Push constants for bindless-vertex.glsl and bindless-fragment.glsl
+struct BindlessParams
+{
+	uint32_t unis; // Which Unis of the ring, counting from the start of the buffer
+	uint32_t material; // Which buffer of the bindless set
+};
+
+struct Materials
+{
+	uint32_t count; // 0 means the per-draw scene has none
+	bool bindless;
+	VkBuffer buffer; // Every material's params, stride apart
+	struct GpuAlloc memory;
+	VkDeviceSize stride; // sizeof(struct MaterialParams) rounded up to minStorageBufferOffsetAlignment
+	struct DescriptorPools descriptors;
+	VkDescriptorSet *sets; // Bound per material only, count of them per frame in flight
+} materials = { 0 };
+
+// Which material a draw of the per-draw scene gets
+static uint32_t materialForDraw(uint32_t draw)
+{
+	return (uint32_t)((uint64_t)draw * materials.count / uniforms.draws);
+}
+
+/*
+ * The material textures, streamed a mip level at a time under a memory
+ * budget. Every texture is one image holding the full texture's mip chain
+ * from some level down, and never less than STREAM_MIN_SIZE across.
+ *
+ * Every frame, before the render pass, the draws say how much detail they
+ * want: about a texel per pixel they cover, halved for every half screen
+ * they are from a focus point that circles the screen like a camera would.
+ * Textures short of that get a new image one level bigger, with the new
+ * top level uploaded through the frame's staging buffer and the rest of
+ * the chain blitted down from it on the GPU. If that would go over budget,
+ * textures holding more than they're wanted for are evicted first, into a
+ * new image one level smaller copied out of the old one. If there's
+ * nothing left to evict, the load waits for a later frame.
+ *
+ * The work goes in the frame's own command buffer, so nothing waits on
+ * uploads, and the old image is deleted once that frame is done with it.
+ * The budget only counts the images the descriptors are getting, not the
+ * old ones waiting on that.
+ *
+ * Textures are generated, standing in for reading a mip level out of a
+ * file.
+ */
+// Staging per frame in flight, so the biggest top level has to fit in it
+#define STREAM_UPLOAD_BYTES ((VkDeviceSize)TEXTURE_MAX_SIZE * TEXTURE_MAX_SIZE * 4)
+#define STREAM_MAX_EVICTIONS 64 // Per frame
+
+struct StreamedTexture
+{
+	VkImage image;
+	VkImageView view;
+	struct GpuAlloc memory;
+	uint32_t top; // The image starts at this mip of the full texture
+	uint32_t wanted; // Mip the draws want this frame
+	uint32_t stale; // A bit per frame in flight whose descriptors have an older view
+};
+
+struct Textures
+{
+	struct StreamedTexture *items;
+	uint32_t count;
+	uint32_t size; // Of the full texture
+	uint32_t levels; // Of the full texture
+	uint32_t minTop; // The mip that's STREAM_MIN_SIZE, nothing gets evicted past it
+	VkDeviceSize budget;
+	VkDeviceSize resident;
+	VkBuffer staging[MAX_FRAMES_IN_FLIGHT];
+	struct GpuAlloc stagingMemory[MAX_FRAMES_IN_FLIGHT];
+	uint32_t *order; // Scratch for sorting what to load
+	// Stats for the phase
+	uint32_t loads;
+	uint32_t evictions;
+	uint32_t heldBack; // Loads that had to wait because of the budget
+	struct Samples uploadKiB; // A frame
+} textures = { 0 };
+
+// From VK_EXT_memory_budget, or the heap's size and no usage without it
+static void deviceLocalBudget(VkDeviceSize *budget, VkDeviceSize *usage)
+{
+	uint32_t heap = 0;
+	for (uint32_t i = 0; i < gpuAllocator.memProps.memoryHeapCount; i++)
+	{
+		const VkMemoryHeap *memoryHeap = &gpuAllocator.memProps.memoryHeaps[i];
+		if ((memoryHeap->flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) && memoryHeap->size > gpuAllocator.memProps.memoryHeaps[heap].size)
+			heap = i;
+	}
+	*budget = gpuAllocator.memProps.memoryHeaps[heap].size;
+	*usage = 0;
+	if (!vkMemoryBudget)
+		return;
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT vkBudgetProps =
+	{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+	};
+	VkPhysicalDeviceMemoryProperties2 vkMemProps2 =
+	{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+		.pNext = &vkBudgetProps,
+	};
+	vkGetPhysicalDeviceMemoryProperties2(vkPhysDevice, &vkMemProps2);
+	*budget = vkBudgetProps.heapBudget[heap];
+	*usage = vkBudgetProps.heapUsage[heap];
+}
+
+// A checkerboard with eight squares a side, at whatever size the mip is
+static void textureTexels(uint32_t index, uint32_t size, uint32_t *texels)
+{
+	uint32_t cell = size / 8;
+	uint32_t light = 192 + ((index * 2654435761u) >> 26);
+	uint32_t dark = light / 2;
+	for (uint32_t y = 0; y < size; y++)
+	{
+		for (uint32_t x = 0; x < size; x++)
+		{
+			uint32_t v = (x / cell + y / cell) & 1 ? dark : light;
+			*texels++ = v | v << 8 | v << 16 | 0xffu << 24;
+		}
+	}
+}
+
+// Roughly what an image starting at mip top takes, before the driver pads it
+static VkDeviceSize textureBytes(uint32_t top)
+{
+	VkDeviceSize bytes = 0;
+	for (uint32_t level = top; level < textures.levels; level++)
+		bytes += (VkDeviceSize)(textures.size >> level) * (textures.size >> level) * 4;
+	return bytes;
+}
+
+static int textureCreateImage(struct StreamedTexture *tex)
+{
+	uint32_t size = textures.size >> tex->top;
+	VkImageCreateInfo vkicInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.imageType = VK_IMAGE_TYPE_2D,
+		// The spec promises linear blits and filtering for this one
+		.format = VK_FORMAT_R8G8B8A8_UNORM,
+		.extent = { size, size, 1 },
+		.mipLevels = textures.levels - tex->top,
+		.arrayLayers = 1,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.tiling = VK_IMAGE_TILING_OPTIMAL,
+		.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+	};
+	if (VK_SUCCESS != vkCreateImage(vkDevice, &vkicInfo, 0, &tex->image)
+		|| gpuAllocImage(tex->image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, &tex->memory))
+	{
+		eprintf("Failed to create a %ux%u texture!\n", size, size);
+		return 1;
+	}
+	VkImageViewCreateInfo vkivcInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.image = tex->image,
+		.viewType = VK_IMAGE_VIEW_TYPE_2D,
+		.format = vkicInfo.format,
+		.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, vkicInfo.mipLevels, 0, 1 },
+	};
+	if (VK_SUCCESS != vkCreateImageView(vkDevice, &vkivcInfo, 0, &tex->view))
+	{
+		eprintf("Failed to create a %ux%u texture view!\n", size, size);
+		return 1;
+	}
+	return 0;
+}
+
+static VkImageMemoryBarrier textureBarrier(VkImage image, uint32_t level, uint32_t levels, VkImageLayout oldLayout, VkImageLayout newLayout,
+	VkAccessFlags srcAccess, VkAccessFlags dstAccess)
+{
+	return (VkImageMemoryBarrier)
+	{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = srcAccess,
+		.dstAccessMask = dstAccess,
+		.oldLayout = oldLayout,
+		.newLayout = newLayout,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = image,
+		.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, levels, 0, 1 },
+	};
+}
+
+// The top level out of staging, and every level under it blitted from the one above
+static void textureRecordLoad(VkCommandBuffer commandBuffer, const struct StreamedTexture *tex, VkBuffer staging, VkDeviceSize stagingOffset)
+{
+	uint32_t size = textures.size >> tex->top;
+	uint32_t levels = textures.levels - tex->top;
+	VkImageMemoryBarrier barriers[2];
+	barriers[0] = textureBarrier(tex->image, 0, levels, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		0, VK_ACCESS_TRANSFER_WRITE_BIT);
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, 0, 0, 0, 1, barriers);
+	VkBufferImageCopy copy =
+	{
+		.bufferOffset = stagingOffset,
+		.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+		.imageExtent = { size, size, 1 },
+	};
+	vkCmdCopyBufferToImage(commandBuffer, staging, tex->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+	for (uint32_t level = 1; level < levels; level++)
+	{
+		int32_t from = (int32_t)(size >> (level - 1));
+		barriers[0] = textureBarrier(tex->image, level - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, 0, 0, 0, 1, barriers);
+		VkImageBlit blit =
+		{
+			.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1 },
+			.srcOffsets = { { 0, 0, 0 }, { from, from, 1 } },
+			.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 },
+			.dstOffsets = { { 0, 0, 0 }, { from / 2, from / 2, 1 } },
+		};
+		vkCmdBlitImage(commandBuffer, tex->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, tex->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1, &blit, VK_FILTER_LINEAR);
+	}
+	// Every level but the last was blitted from, the last was only written
+	uint32_t barriersCount = 0;
+	if (levels > 1)
+		barriers[barriersCount++] = textureBarrier(tex->image, 0, levels - 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0, VK_ACCESS_SHADER_READ_BIT);
+	barriers[barriersCount++] = textureBarrier(tex->image, levels - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		0, 0, 0, 0, 0, barriersCount, barriers);
+}
+
+// Every level of next out of the one under it in old, which the frames still to come keep sampling
+static void textureRecordEvict(VkCommandBuffer commandBuffer, const struct StreamedTexture *old, const struct StreamedTexture *next)
+{
+	uint32_t levels = textures.levels - next->top;
+	VkImageMemoryBarrier barriers[] =
+	{
+		textureBarrier(old->image, 0, levels + 1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			0, VK_ACCESS_TRANSFER_READ_BIT),
+		textureBarrier(next->image, 0, levels, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			0, VK_ACCESS_TRANSFER_WRITE_BIT),
+	};
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, 0, 0, 0, ARRAYSIZE(barriers), barriers);
+	VkImageCopy copies[32];
+	for (uint32_t level = 0; level < levels; level++)
+	{
+		uint32_t size = textures.size >> (next->top + level);
+		copies[level] = (VkImageCopy)
+		{
+			.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level + 1, 0, 1 },
+			.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 },
+			.extent = { size, size, 1 },
+		};
+	}
+	vkCmdCopyImage(commandBuffer, old->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, next->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		levels, copies);
+	barriers[0] = textureBarrier(old->image, 0, levels + 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		0, VK_ACCESS_SHADER_READ_BIT);
+	barriers[1] = textureBarrier(next->image, 0, levels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		0, 0, 0, 0, 0, ARRAYSIZE(barriers), barriers);
+}
+
+/*
+ * Gives texture index a new image starting at mip top, loaded out of
+ * staging if it's bigger and copied from the old one if it's smaller.
+ * This frame is the last to touch the old one, the other frames in flight
+ * point their sets at the new one before they record.
+ */
+static int textureReplace(VkCommandBuffer commandBuffer, uint32_t index, uint32_t top, VkBuffer staging, VkDeviceSize stagingOffset,
+	uint32_t frame)
+{
+	struct StreamedTexture *tex = &textures.items[index];
+	struct StreamedTexture next = { .top = top, .wanted = tex->wanted };
+	if (0 != textureCreateImage(&next))
+		return 1;
+	if (tex->image == VK_NULL_HANDLE || top < tex->top)
+		textureRecordLoad(commandBuffer, &next, staging, stagingOffset);
+	else
+		textureRecordEvict(commandBuffer, tex, &next);
+	if (tex->image)
+	{
+		textures.resident -= tex->memory.size;
+		deferImageView(tex->view, frame + 1);
+		deferImage(tex->image, &tex->memory, frame + 1);
+	}
+	next.stale = (1u << opts.framesInFlight) - 1;
+	*tex = next;
+	textures.resident += tex->memory.size;
+	return 0;
+}
+
+// Furthest behind what's wanted first, then whatever's wanted sharpest
+static int textureLoadCompare(const void *a, const void *b)
+{
+	const struct StreamedTexture *x = &textures.items[*(const uint32_t *)a];
+	const struct StreamedTexture *y = &textures.items[*(const uint32_t *)b];
+	int32_t behindX = (int32_t)x->top - (int32_t)x->wanted;
+	int32_t behindY = (int32_t)y->top - (int32_t)y->wanted;
+	if (behindX != behindY)
+		return behindY - behindX;
+	return (int32_t)x->wanted - (int32_t)y->wanted;
+}
+
+// How sharp each texture's draws want it this frame
+static void texturesWant(float time)
+{
+	for (uint32_t i = 0; i < textures.count; i++)
+		textures.items[i].wanted = textures.minTop;
+	// A draw is about its scale of half the screen across, and gets a texel a pixel at the focus
+	float pixels = 0.5f * vkExtentDesired.width / uniforms.columns;
+	uint32_t base = 0;
+	while (base < textures.minTop && (float)(textures.size >> (base + 1)) >= pixels)
+		base++;
+	float focus[2] = { 0.6f * sinf(0.25f * time), 0.6f * cosf(0.25f * time) };
+	float cell = 2.0f / uniforms.columns;
+	for (uint32_t draw = 0; draw < uniforms.draws; draw++)
+	{
+		float dx = -1.0f + cell * (draw % uniforms.columns + 0.5f) - focus[0];
+		float dy = -1.0f + cell * (draw / uniforms.columns + 0.5f) - focus[1];
+		uint32_t level = minu32(base + (uint32_t)(2.0f * sqrtf(dx * dx + dy * dy)), textures.minTop);
+		struct StreamedTexture *tex = &textures.items[materialForDraw(draw)];
+		tex->wanted = minu32(tex->wanted, level);
+	}
+}
+
+// Drops a level off whichever texture has the most more than it's wanted for, if any does
+static int textureEvictOne(VkCommandBuffer commandBuffer, uint32_t frame, bool *evicted)
+{
+	uint32_t pick = UINT32_MAX;
+	uint32_t most = 0;
+	for (uint32_t i = 0; i < textures.count; i++)
+	{
+		const struct StreamedTexture *tex = &textures.items[i];
+		if (tex->wanted > tex->top && tex->wanted - tex->top > most)
+		{
+			pick = i;
+			most = tex->wanted - tex->top;
+		}
+	}
+	*evicted = pick != UINT32_MAX;
+	if (!*evicted)
+		return 0;
+	textures.evictions++;
+	return textureReplace(commandBuffer, pick, textures.items[pick].top + 1, VK_NULL_HANDLE, 0, frame);
+}
+
+// Main thread, outside the render pass, once the frame in flight's fence has signalled
+static int texturesStream(VkCommandBuffer commandBuffer, uint32_t inFlight, uint32_t frame, float time)
+{
+	texturesWant(time);
+	uint32_t loadsCount = 0;
+	for (uint32_t i = 0; i < textures.count; i++)
+	{
+		if (textures.items[i].top > textures.items[i].wanted)
+			textures.order[loadsCount++] = i;
+	}
+	qsort(textures.order, loadsCount, sizeof(*textures.order), textureLoadCompare);
+
+	char *staging = textures.stagingMemory[inFlight].mapped;
+	VkDeviceSize uploaded = 0;
+	uint32_t evictions = 0;
+	for (uint32_t i = 0; i < loadsCount; i++)
+	{
+		uint32_t index = textures.order[i];
+		uint32_t top = textures.items[index].top - 1;
+		uint32_t size = textures.size >> top;
+		VkDeviceSize bytes = (VkDeviceSize)size * size * 4;
+		// Something smaller further down might still fit
+		if (uploaded + bytes > STREAM_UPLOAD_BYTES)
+			continue;
+		VkDeviceSize grows = textureBytes(top) - textureBytes(top + 1);
+		bool evicted = true;
+		while (textures.resident + grows > textures.budget && evicted && evictions < STREAM_MAX_EVICTIONS)
+		{
+			if (0 != textureEvictOne(commandBuffer, frame, &evicted))
+				return 1;
+			evictions += evicted;
+		}
+		if (textures.resident + grows > textures.budget)
+		{
+			textures.heldBack++;
+			continue;
+		}
+		textureTexels(index, size, (uint32_t *)(staging + uploaded));
+		if (0 != textureReplace(commandBuffer, index, top, textures.staging[inFlight], uploaded, frame))
+			return 1;
+		uploaded += bytes;
+		textures.loads++;
+	}
+	samplesPush(&textures.uploadKiB, uploaded / 1024.0);
+	return 0;
+}
+
+// Uploads every texture's smallest top level in batches, createTextures cleans up after it either way
+static int textureSetupBatches(VkCommandBuffer commandBuffer, VkFence fence, VkQueue graphicsQueue)
+{
+	uint32_t count = textures.count;
+	uint32_t size = textures.size >> textures.minTop;
+	VkDeviceSize bytes = (VkDeviceSize)size * size * 4;
+	for (uint32_t first = 0; first < count;)
+	{
+		VkCommandBufferBeginInfo vkcbbInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		};
+		vkResetCommandBuffer(commandBuffer, 0);
+		if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffer, &vkcbbInfo))
+		{
+			eprintf("Failed to begin the texture setup!\n");
+			return 1;
+		}
+		uint32_t i = first;
+		for (VkDeviceSize offset = 0; i < count && offset + bytes <= STREAM_UPLOAD_BYTES; i++, offset += bytes)
+		{
+			textureTexels(i, size, (uint32_t *)((char *)textures.stagingMemory[0].mapped + offset));
+			if (0 != textureReplace(commandBuffer, i, textures.minTop, textures.staging[0], offset, 0))
+				return 1;
+		}
+		first = i;
+		VkSubmitInfo vkSubmitInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.commandBufferCount = 1,
+			.pCommandBuffers = &commandBuffer,
+		};
+		if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer)
+			|| VK_SUCCESS != vkQueueSubmit(graphicsQueue, 1, &vkSubmitInfo, fence))
+		{
+			eprintf("Failed to submit the texture setup!\n");
+			return 1;
+		}
+		vkWaitForFences(vkDevice, 1, &fence, VK_TRUE, UINT64_MAX);
+		vkResetFences(vkDevice, 1, &fence);
+	}
+	return 0;
+}
+
+// Every texture at STREAM_MIN_SIZE, streaming does the rest
+static int createTextures(uint32_t count, uint32_t graphicsFamily, VkCommandPool graphicsPool)
+{
+	memset(&textures, 0, sizeof(textures));
+	textures.count = count;
+	textures.size = opts.textureSize;
+	while ((textures.size >> textures.levels) != 0)
+		textures.levels++;
+	while ((textures.size >> textures.minTop) > STREAM_MIN_SIZE)
+		textures.minTop++;
+	VkDeviceSize heapBudget, heapUsage;
+	deviceLocalBudget(&heapBudget, &heapUsage);
+	// Half of what's left by default, or a quarter of the heap if there's no telling what's left
+	if (opts.textureBudgetMiB)
+		textures.budget = (VkDeviceSize)opts.textureBudgetMiB << 20;
+	else if (vkMemoryBudget)
+		textures.budget = heapBudget > heapUsage ? (heapBudget - heapUsage) / 2 : 0;
+	else
+		textures.budget = heapBudget / 4;
+	if (!(textures.items = calloc(count, sizeof(*textures.items)))
+		|| !(textures.order = calloc(count, sizeof(*textures.order))))
+	{
+		eprintf("Out of memory for %u textures!\n", count);
+		return 1;
+	}
+	for (uint32_t i = 0; i < opts.framesInFlight; i++)
+	{
+		VkBufferCreateInfo vkbcInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			.size = STREAM_UPLOAD_BYTES,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		};
+		if (VK_SUCCESS != vkCreateBuffer(vkDevice, &vkbcInfo, 0, &textures.staging[i])
+			|| gpuAllocBuffer(textures.staging[i], VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0,
+				&textures.stagingMemory[i]))
+		{
+			eprintf("Failed to create the texture staging buffers!\n");
+			return 1;
+		}
+	}
+
+	// As many at a time as fit in one staging buffer, waiting for each batch before filling it again
+	VkCommandBufferAllocateInfo vkcbaInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = graphicsPool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1,
+	};
+	VkFenceCreateInfo vkfcInfo = { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+	VkFence fence = VK_NULL_HANDLE;
+	VkQueue graphicsQueue;
+	vkGetDeviceQueue(vkDevice, graphicsFamily, 0, &graphicsQueue);
+	int err = 0;
+	if (VK_SUCCESS != vkAllocateCommandBuffers(vkDevice, &vkcbaInfo, &commandBuffer)
+		|| VK_SUCCESS != vkCreateFence(vkDevice, &vkfcInfo, 0, &fence))
+	{
+		eprintf("Failed to create the texture setup command buffer!\n");
+		err = 1;
+	}
+	else
+	{
+		err = textureSetupBatches(commandBuffer, fence, graphicsQueue);
+	}
+	if (fence)
+		vkDestroyFence(vkDevice, fence, 0);
+	if (commandBuffer)
+		vkFreeCommandBuffers(vkDevice, graphicsPool, 1, &commandBuffer);
+	return err;
+}
+
+// Frames before frame might still be reading them
+static void destroyTextures(uint32_t frame)
+{
+	for (uint32_t i = 0; i < textures.count; i++)
+	{
+		struct StreamedTexture *tex = &textures.items[i];
+		if (tex->view)
+			deferImageView(tex->view, frame);
+		if (tex->image)
+			deferImage(tex->image, &tex->memory, frame);
+	}
+	for (uint32_t i = 0; i < opts.framesInFlight; i++)
+	{
+		if (textures.staging[i])
+			deferBuffer(textures.staging[i], &textures.stagingMemory[i], frame);
+	}
+	free(textures.items);
+	free(textures.order);
+	free(textures.uploadKiB.values);
+	memset(&textures, 0, sizeof(textures));
+}
+
+// Sorts the samples, like samplesReport()
+static void texturesReport(void)
+{
+	if (textures.count == 0)
+		return;
+	uint32_t full = 0;
+	for (uint32_t i = 0; i < textures.count; i++)
+		full += textures.items[i].top == 0;
+	printf("textures: %u up to %ux%u, %u at full size, %.2f MiB resident of a %.2f MiB budget\n", textures.count,
+		textures.size, textures.size, full, textures.resident / 1048576.0, textures.budget / 1048576.0);
+	printf("texture streaming: %u loads, %u evictions, %u loads held back by the budget\n",
+		textures.loads, textures.evictions, textures.heldBack);
+	samplesReport("stream upload (KiB)", &textures.uploadKiB);
+	if (vkMemoryBudget)
+	{
+		VkDeviceSize heapBudget, heapUsage;
+		deviceLocalBudget(&heapBudget, &heapUsage);
+		printf("device-local heap: %.2f MiB used of a %.2f MiB budget\n", heapUsage / 1048576.0, heapBudget / 1048576.0);
+	}
+}
+
+// The rest of createMaterials, with scratch space for it that the caller frees however this goes
+static int materialsFill(char *data, VkDescriptorBufferInfo *bufInfos, VkDescriptorImageInfo *imageInfos,
+	uint32_t graphicsFamily, VkCommandPool graphicsPool)
+{
+	uint32_t count = materials.count;
+	bool bindlessOn = materials.bindless;
+	// Every material its own hue, the textures only go light and dark
+	for (uint32_t i = 0; i < count; i++)
+	{
+		struct MaterialParams *params = (struct MaterialParams *)(data + i * materials.stride);
+		float hue = (float)i / count;
+		for (uint32_t c = 0; c < 3; c++)
+			params->tint[c] = 0.5f + 0.5f * cosf(6.28318f * (hue + c / 3.0f));
+		params->tint[3] = 1.0f;
+		params->texture = i;
+	}
+
+	VkBufferCreateInfo vkbcInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		.size = count * materials.stride,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+	if (VK_SUCCESS != vkCreateBuffer(vkDevice, &vkbcInfo, 0, &materials.buffer)
+		|| gpuAllocBuffer(materials.buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, &materials.memory))
+	{
+		eprintf("Failed to create the material buffer!\n");
+		return 1;
+	}
+	if (0 != stagingUpload(materials.buffer, 0, data, vkbcInfo.size)
+		|| 0 != stagingFinish(&materials.buffer, 1, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+			graphicsFamily, graphicsPool, false)
+		|| 0 != createTextures(count, graphicsFamily, graphicsPool))
+		return 1;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		bufInfos[i] = (VkDescriptorBufferInfo){ .buffer = materials.buffer, .offset = i * materials.stride, .range = sizeof(struct MaterialParams) };
+		imageInfos[i] = (VkDescriptorImageInfo){ .imageView = textures.items[i].view, .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		textures.items[i].stale = 0;
+	}
+
+	if (!bindlessOn && 0 != descriptorPoolsAllocate(&materials.descriptors, vkMaterialLayout, count * opts.framesInFlight, materials.sets))
+		return 1;
+	for (uint32_t inFlight = 0; inFlight < opts.framesInFlight; inFlight++)
+	{
+		if (bindlessOn)
+		{
+			// The ring is new every phase, so it gets written again along with the materials
+			VkDescriptorBufferInfo ringInfo = { .buffer = uniforms.buffers[0], .offset = 0, .range = VK_WHOLE_SIZE };
+			VkDescriptorSet set = bindless.sets[inFlight];
+			if (0 != descriptorWriteBuffers(set, 0, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &ringInfo, 1)
+				|| 0 != descriptorWriteBuffers(set, 0, BINDLESS_FIRST_MATERIAL, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bufInfos, count)
+				|| 0 != descriptorWriteImages(set, 1, 0, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, imageInfos, count))
+				return 1;
+			continue;
+		}
+		for (uint32_t i = 0; i < count; i++)
+		{
+			VkDescriptorSet set = materials.sets[inFlight * count + i];
+			if (0 != descriptorWriteBuffers(set, 0, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufInfos[i], 1)
+				|| 0 != descriptorWriteImages(set, 1, 0, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, &imageInfos[i], 1))
+				return 1;
+		}
+	}
+	descriptorWritesFlush();
+	return 0;
+}
+
+// Needs createUniforms() with the ring scheme first, and nothing on the GPU using the bindless sets
+static int createMaterials(uint32_t count, bool bindlessOn, uint32_t graphicsFamily, VkCommandPool graphicsPool)
+{
+	memset(&materials, 0, sizeof(materials));
+	if (count == 0)
+		return 0;
+	materials.count = count;
+	materials.bindless = bindlessOn;
+	// The spec promises a power of two
+	VkDeviceSize alignment = vkPhysProps.limits.minStorageBufferOffsetAlignment;
+	materials.stride = (sizeof(struct MaterialParams) + alignment - 1) & ~(alignment - 1);
+
+	char *data = calloc(count, (size_t)materials.stride);
+	VkDescriptorBufferInfo *bufInfos = malloc(count * sizeof(*bufInfos));
+	VkDescriptorImageInfo *imageInfos = malloc(count * sizeof(*imageInfos));
+	int err = 1;
+	if (!data || !bufInfos || !imageInfos
+		|| !(materials.sets = calloc(count * opts.framesInFlight, sizeof(*materials.sets))))
+	{
+		eprintf("Out of memory for %u materials!\n", count);
+	}
+	else
+	{
+		err = materialsFill(data, bufInfos, imageInfos, graphicsFamily, graphicsPool);
+	}
+	free(data);
+	free(bufInfos);
+	free(imageInfos);
+	return err;
+}
+
+/*
+ * Streams the textures, then points this frame in flight's sets at
+ * whichever images changed since it was last here. Main thread, outside
+ * the render pass, once the frame in flight's fence has signalled.
+ */
+static int materialsBeginFrame(VkCommandBuffer commandBuffer, uint32_t inFlight, uint32_t frame, float time)
+{
+	if (materials.count == 0)
+		return 0;
+	if (0 != texturesStream(commandBuffer, inFlight, frame, time))
+		return 1;
+	uint32_t bit = 1u << inFlight;
+	for (uint32_t i = 0; i < textures.count; i++)
+	{
+		struct StreamedTexture *tex = &textures.items[i];
+		if (!(tex->stale & bit))
+			continue;
+		tex->stale &= ~bit;
+		VkDescriptorImageInfo imageInfo = { .imageView = tex->view, .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		if (0 != (materials.bindless
+			? descriptorWriteImages(bindless.sets[inFlight], 1, i, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, &imageInfo, 1)
+			: descriptorWriteImages(materials.sets[inFlight * materials.count + i], 1, 0, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, &imageInfo, 1)))
+			return 1;
+	}
+	descriptorWritesFlush();
+	return 0;
+}
+
+// Frames before frame might still be reading them. The bindless sets keep pointing at them, unused.
+static void destroyMaterials(uint32_t frame)
+{
+	if (materials.count == 0)
+		return;
+	destroyTextures(frame);
+	destroyDescriptorPools(&materials.descriptors, frame);
+	if (materials.buffer)
+		deferBuffer(materials.buffer, &materials.memory, frame);
+	free(materials.sets);
+	memset(&materials, 0, sizeof(materials));
+}
+
+/*
+ * Loads the pipeline cache blob we saved last time, if the driver that
+ * wrote it is the one we're running on. Anything stale or broken just
+ * gives us an empty cache, it's only a startup-time optimization anyways.
+ * Returns whether the cache started out warm.
+ */
+static bool createPipelineCache(const char *path)
+{
+	struct MappedFile file = { 0 };
+	if (path)
+		mapFile(path, &file);
+	void *data = file.data;
+	size_t len = file.len;
+
+	// The header is the only part of the blob the spec lets us look at
+	VkPipelineCacheHeaderVersionOne header;
+	if (len >= sizeof(header))
+	{
+		memcpy(&header, data, sizeof(header));
+		if (header.headerSize < sizeof(header)
+			|| header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+			|| header.vendorID != vkPhysProps.vendorID
+			|| header.deviceID != vkPhysProps.deviceID
+			|| memcmp(header.pipelineCacheUUID, vkPhysProps.pipelineCacheUUID, VK_UUID_SIZE))
+		{
+			eprintf("Pipeline cache %s is stale (vendor %04x device %04x), starting cold\n",
+				path, header.vendorID, header.deviceID);
+			len = 0;
+		}
+	}
+	else if (len != 0)
+	{
+		eprintf("Pipeline cache %s is truncated, starting cold\n", path);
+		len = 0;
+	}
+
+	VkPipelineCacheCreateInfo vkpccInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+		.initialDataSize = len,
+		.pInitialData = len ? data : NULL,
+	};
+	if (VK_SUCCESS != vkCreatePipelineCache(vkDevice, &vkpccInfo, 0, &vkPipelineCache))
+	{
+		// Drivers are allowed to reject the data anyways, so try again with nothing
+		len = 0;
+		vkpccInfo.initialDataSize = 0;
+		vkpccInfo.pInitialData = NULL;
+		if (VK_SUCCESS != vkCreatePipelineCache(vkDevice, &vkpccInfo, 0, &vkPipelineCache))
+		{
+			eprintf("Failed to create a pipeline cache, pipelines will compile from scratch\n");
+			vkPipelineCache = VK_NULL_HANDLE;
+		}
+	}
+	// The driver has its own copy now, and the file gets written over on the way out
+	unmapFile(&file);
+	if (len)
+		eprintf("Loaded %zu bytes of pipeline cache from %s\n", len, path);
+	return len != 0;
+}
+
+static void savePipelineCache(const char *path)
+{
+	if (path == NULL || vkPipelineCache == VK_NULL_HANDLE)
+		return;
+	size_t len = 0;
+	void *data = NULL;
+	if (VK_SUCCESS != vkGetPipelineCacheData(vkDevice, vkPipelineCache, &len, NULL)
+		|| len == 0
+		|| !(data = malloc(len))
+		|| VK_SUCCESS != vkGetPipelineCacheData(vkDevice, vkPipelineCache, &len, data))
+	{
+		eprintf("Failed to get pipeline cache data!\n");
+		free(data);
+		return;
+	}
+	FILE *fp = fopen(path, "wb");
+	if (fp == NULL || fwrite(data, 1, len, fp) != len)
+		eprintf("Failed to write pipeline cache to %s!\n", path);
+	else
+		eprintf("Saved %zu bytes of pipeline cache to %s\n", len, path);
+	if (fp != NULL)
+		fclose(fp);
+	free(data);
+}
+
+/*
+ * Dynamic rendering draws straight to the swapchain image views, so there's
+ * no render pass and no framebuffers to rebuild every time the swapchain is.
+ * The layout transitions the render pass did on its own become explicit
+ * synchronization2 barriers around the rendering.
+ */
+struct DynamicRendering
+{
+	bool enabled;
+	VkFormat format; // For the pipelines and secondaries, which would've gotten it from the render pass
+	PFN_vkCmdBeginRendering beginRendering;
+	PFN_vkCmdEndRendering endRendering;
+	PFN_vkCmdPipelineBarrier2 pipelineBarrier2;
+} dynamicRendering = { 0 };
+
+static int createDynamicRendering(bool supported, VkFormat format)
+{
+	memset(&dynamicRendering, 0, sizeof(dynamicRendering));
+	if (opts.rendering != RENDERING_DYNAMIC)
+		return 0;
+	if (!supported)
+	{
+		eprintf("No dynamic rendering on this device, render passes it is!\n");
+		return 0;
+	}
+	dynamicRendering.format = format;
+	dynamicRendering.beginRendering = (PFN_vkCmdBeginRendering)vkGetDeviceProcAddr(vkDevice, "vkCmdBeginRendering");
+	dynamicRendering.endRendering = (PFN_vkCmdEndRendering)vkGetDeviceProcAddr(vkDevice, "vkCmdEndRendering");
+	dynamicRendering.pipelineBarrier2 = (PFN_vkCmdPipelineBarrier2)vkGetDeviceProcAddr(vkDevice, "vkCmdPipelineBarrier2");
+	if (!dynamicRendering.beginRendering || !dynamicRendering.endRendering || !dynamicRendering.pipelineBarrier2)
+	{
+		eprintf("Dynamic rendering is supported but its functions aren't there? What?\n");
+		return 1;
+	}
+	dynamicRendering.enabled = true;
+	return 0;
+}
+
+// Moves the frame's image between layouts, and the transient targets into one, only for dynamic rendering
+static void renderTargetBarrier(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool begin)
+{
+	// The previous frame's depth tests have to be done before this one clears it
+	VkImageMemoryBarrier2 vkDepthBarrier =
+	{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+		.srcStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+		.srcAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		.dstStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+		.dstAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.newLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = vkDepthImage,
+		.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+		.subresourceRange.baseMipLevel = 0,
+		.subresourceRange.levelCount = 1,
+		.subresourceRange.baseArrayLayer = 0,
+		.subresourceRange.layerCount = 1,
+	};
+	// Same for the samples, the resolve into the frame's image is covered by its own barrier
+	VkImageMemoryBarrier2 vkMsaaBarrier =
+	{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+		.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+		.srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+		.dstStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+		.dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+		.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = vkMsaaImage,
+		.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.subresourceRange.baseMipLevel = 0,
+		.subresourceRange.levelCount = 1,
+		.subresourceRange.baseArrayLayer = 0,
+		.subresourceRange.layerCount = 1,
+	};
+	VkImageMemoryBarrier2 vkBarrier =
+	{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = vkSwapchainImages[imageIndex],
+		.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.subresourceRange.baseMipLevel = 0,
+		.subresourceRange.levelCount = 1,
+		.subresourceRange.baseArrayLayer = 0,
+		.subresourceRange.layerCount = 1,
+	};
+	if (begin)
+	{
+		// The render pass's external dependency, which chains onto the acquire semaphore's wait stage
+		vkBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+		vkBarrier.srcAccessMask = VK_ACCESS_2_NONE;
+		vkBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+		vkBarrier.dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+		vkBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		vkBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	}
+	else
+	{
+		// The render pass's final layout, presenting waits on the semaphore so nothing else does
+		vkBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+		vkBarrier.srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+		vkBarrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+		vkBarrier.dstAccessMask = VK_ACCESS_2_NONE;
+		vkBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		vkBarrier.newLayout = opts.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	}
+	VkImageMemoryBarrier2 vkBarriers[] = { vkBarrier, vkDepthBarrier, vkMsaaBarrier };
+	VkDependencyInfo vkDepInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+		// The transient targets are thrown away at the end, so they only need a barrier at the start
+		.imageMemoryBarrierCount = !begin ? 1 : vkMsaaImage ? 3 : 2,
+		.pImageMemoryBarriers = vkBarriers,
+	};
+	dynamicRendering.pipelineBarrier2(commandBuffer, &vkDepInfo);
+}
+
+// Clears the frame's image and starts drawing to it, either way
+static void beginRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool secondaries)
+{
+	// In attachment order, the render pass without MSAA just doesn't look at the last one
+	VkClearValue vkClearColors[] =
+	{
+		{ .color = { .float32 = { 0, 0, 0, 1 } } },
+		{ .depthStencil = { .depth = 1, .stencil = 0 } },
+		{ .color = { .float32 = { 0, 0, 0, 1 } } },
+	};
+	if (!dynamicRendering.enabled)
+	{
+		VkRenderPassBeginInfo vkrpbInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+			.renderPass = vkRenderPass,
+			.framebuffer = vkFramebuffers[imageIndex],
+			.renderArea.offset = {0, 0},
+			.renderArea.extent = vkExtentDesired,
+			.clearValueCount = ARRAYSIZE(vkClearColors),
+			.pClearValues = vkClearColors,
+		};
+		vkCmdBeginRenderPass(commandBuffer, &vkrpbInfo,
+			secondaries ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+		return;
+	}
+	renderTargetBarrier(commandBuffer, imageIndex, true);
+	VkRenderingAttachmentInfo vkColorAttachment =
+	{
+		.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+		.imageView = vkSwapchainImageViews[imageIndex],
+		.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		.resolveMode = VK_RESOLVE_MODE_NONE,
+		.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+		.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+		.clearValue = vkClearColors[0],
+	};
+	// The samples are drawn to and dropped, only the resolved pixels make it to the frame's image
+	if (vkMsaaView)
+	{
+		vkColorAttachment.imageView = vkMsaaView;
+		vkColorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+		vkColorAttachment.resolveImageView = vkSwapchainImageViews[imageIndex];
+		vkColorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		vkColorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	}
+	VkRenderingAttachmentInfo vkDepthAttachment =
+	{
+		.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+		.imageView = vkDepthView,
+		.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+		.resolveMode = VK_RESOLVE_MODE_NONE,
+		.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+		.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+		.clearValue = vkClearColors[1],
+	};
+	VkRenderingInfo vkrInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+		.flags = secondaries ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0,
+		.renderArea.offset = {0, 0},
+		.renderArea.extent = vkExtentDesired,
+		.layerCount = 1,
+		.colorAttachmentCount = 1,
+		.pColorAttachments = &vkColorAttachment,
+		.pDepthAttachment = &vkDepthAttachment,
+	};
+	dynamicRendering.beginRendering(commandBuffer, &vkrInfo);
+}
+
+static void endRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	if (!dynamicRendering.enabled)
+	{
+		vkCmdEndRenderPass(commandBuffer);
+		return;
+	}
+	dynamicRendering.endRendering(commandBuffer);
+	renderTargetBarrier(commandBuffer, imageIndex, false);
+}
+
+/*
+ * Graphics pipelines come out of a table keyed by everything that goes into
+ * one: shaders, specialization constants, vertex layout, raster, depth,
+ * blend, and what they're drawn into. Asking for one that isn't there yet
+ * either compiles it right there, for startup and anyone else who can't go
+ * on without it, or hands it to the compile threads and returns nothing, so
+ * a new material can draw with a stand-in until it's ready instead of
+ * hitching the frame. Pipelines live as long as the table does, except when
+ * a shader module they use goes away (hot reload), then they're evicted.
+ */
+#define MAX_SPEC_CONSTANTS 4
+#define MAX_VERTEX_ATTRIBUTES 4
+#define PIPELINE_TABLE_SIZE 256 // Power of two
+#define PIPELINE_COMPILERS 2
+
+// Always memset first, it gets hashed and compared byte for byte. Laid out so there's no padding either
+struct PipelineDesc
+{
+	VkPipelineLayout layout;
+	VkShaderModule vertex;
+	VkShaderModule fragment; // VK_NULL_HANDLE for depth only
+	VkRenderPass renderPass; // VK_NULL_HANDLE with dynamic rendering, which goes by the formats
+	uint32_t specCount; // Constant IDs 0 to specCount - 1, for both stages
+	uint32_t specValues[MAX_SPEC_CONSTANTS];
+	uint32_t stride; // 0 for no vertex buffer
+	uint32_t attributesCount;
+	VkVertexInputAttributeDescription attributes[MAX_VERTEX_ATTRIBUTES];
+	VkCullModeFlags cullMode;
+	VkSampleCountFlagBits samples;
+	VkBool32 depthTest;
+	VkBool32 depthWrite;
+	VkCompareOp depthCompare;
+	VkBool32 blend; // Alpha blending
+	VkColorComponentFlags colorWriteMask;
+	VkFormat colorFormat;
+	VkFormat depthFormat;
+};
+// What vkGraphicsPipelines were made from, so variants of them can be asked for
+struct PipelineDesc vkGraphicsPipelineDescs[UNIFORM_SCHEMES_COUNT] = { 0 };
+
+enum PipelineState
+{
+	PIPELINE_EMPTY,
+	PIPELINE_QUEUED, // Until whoever compiles it is done, failed or not
+	PIPELINE_READY,
+	PIPELINE_FAILED,
+	PIPELINE_EVICTED, // Still in the way of lookups so the ones past it can be found, free for inserts
+};
+
+struct PipelineEntry
+{
+	struct PipelineDesc desc;
+	uint64_t hash;
+	enum PipelineState state;
+	VkPipeline pipeline;
+};
+
+struct Pipelines
+{
+	struct PipelineEntry entries[PIPELINE_TABLE_SIZE];
+	uint32_t count;
+	// Entries for the compile threads, never more than there are entries
+	uint32_t queue[PIPELINE_TABLE_SIZE];
+	uint32_t queueHead;
+	uint32_t queueTail;
+	SDL_mutex *lock; // Over everything in here
+	SDL_cond *wake; // Something got queued, or it's time to quit
+	SDL_cond *done; // Something stopped being queued
+	SDL_Thread *threads[PIPELINE_COMPILERS];
+	uint32_t threadsCount;
+	bool quit;
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t failed;
+	uint32_t standIns; // Frames drawn with the plain pipeline while a variant compiled
+	struct Samples compileTimes;
+} pipelines = { 0 };
+
+// FNV-1a, the descriptions are small and this is nowhere near the slow part
+static uint64_t pipelineHash(const struct PipelineDesc *desc)
+{
+	const uint8_t *bytes = (const uint8_t *)desc;
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < sizeof(*desc); i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static VkPipeline pipelineCompile(const struct PipelineDesc *desc)
+{
+	VkDynamicState vkDynStates[] =
+	{
+		VK_DYNAMIC_STATE_VIEWPORT,
+		VK_DYNAMIC_STATE_SCISSOR,
+	};
+	VkPipelineDynamicStateCreateInfo vkpdscInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+		.dynamicStateCount = ARRAYSIZE(vkDynStates),
+		.pDynamicStates = vkDynStates,
+	};
+	VkVertexInputBindingDescription vkVertexBinding =
+	{
+		.binding = 0,
+		.stride = desc->stride,
+		.inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+	};
+	VkPipelineVertexInputStateCreateInfo vkpviscInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+		.vertexBindingDescriptionCount = desc->stride ? 1 : 0,
+		.pVertexBindingDescriptions = &vkVertexBinding,
+		.vertexAttributeDescriptionCount = desc->attributesCount,
+		.pVertexAttributeDescriptions = desc->attributes,
+	};
+	VkPipelineInputAssemblyStateCreateInfo vkpiascInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+		.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+		.primitiveRestartEnable = VK_FALSE,
+	};
+	// Both are dynamic, so only the counts matter
+	VkPipelineViewportStateCreateInfo vkpvscInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+		.viewportCount = 1,
+		.scissorCount = 1,
+	};
+	VkPipelineRasterizationStateCreateInfo vkprscInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+		.depthClampEnable = VK_FALSE,
+		.rasterizerDiscardEnable = VK_FALSE,
+		.polygonMode = VK_POLYGON_MODE_FILL,
+		.cullMode = desc->cullMode,
+		.lineWidth = 1,
+		.depthBiasEnable = VK_FALSE,
+	};
+	VkPipelineMultisampleStateCreateInfo vkpmscInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+		.sampleShadingEnable = VK_FALSE,
+		.rasterizationSamples = desc->samples,
+		.minSampleShading = 1.0f,
+		.pSampleMask = 0,
+		.alphaToCoverageEnable = VK_FALSE,
+		.alphaToOneEnable = VK_FALSE,
+	};
+	VkPipelineDepthStencilStateCreateInfo vkpdsscInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+		.depthTestEnable = desc->depthTest,
+		.depthWriteEnable = desc->depthWrite,
+		.depthCompareOp = desc->depthCompare,
+		.depthBoundsTestEnable = VK_FALSE,
+		.stencilTestEnable = VK_FALSE,
+		.minDepthBounds = 0,
+		.maxDepthBounds = 1,
+	};
+	VkPipelineColorBlendAttachmentState vkpcbaState =
+	{
+		.colorWriteMask = desc->colorWriteMask,
+		.blendEnable = desc->blend,
+		.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+		.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+		.colorBlendOp = VK_BLEND_OP_ADD,
+		.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+		.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+		.alphaBlendOp = VK_BLEND_OP_ADD,
+	};
+	VkPipelineColorBlendStateCreateInfo vkpcbscInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+		.attachmentCount = 1,
+		.pAttachments = &vkpcbaState,
+		.logicOpEnable = VK_FALSE,
+	};
+	VkSpecializationMapEntry vkSpecEntries[MAX_SPEC_CONSTANTS];
+	for (uint32_t i = 0; i < desc->specCount; i++)
+	{
+		vkSpecEntries[i].constantID = i;
+		vkSpecEntries[i].offset = i * (uint32_t)sizeof(desc->specValues[0]);
+		vkSpecEntries[i].size = sizeof(desc->specValues[0]);
+	}
+	VkSpecializationInfo vkSpecInfo =
+	{
+		.mapEntryCount = desc->specCount,
+		.pMapEntries = vkSpecEntries,
+		.dataSize = desc->specCount * sizeof(desc->specValues[0]),
+		.pData = desc->specValues,
+	};
+	VkPipelineShaderStageCreateInfo vkpsscInfos[] =
+	{
+		{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_VERTEX_BIT,
+			.module = desc->vertex,
+			.pName = "main",
+			.pSpecializationInfo = desc->specCount ? &vkSpecInfo : NULL,
+		},
+		{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+			.module = desc->fragment,
+			.pName = "main",
+			.pSpecializationInfo = desc->specCount ? &vkSpecInfo : NULL,
+		},
+	};
+	// Dynamic rendering has no render pass to take the attachment formats from
+	VkPipelineRenderingCreateInfo vkprcInfoDynamic =
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+		.colorAttachmentCount = 1,
+		.pColorAttachmentFormats = &desc->colorFormat,
+		.depthAttachmentFormat = desc->depthFormat,
+	};
+	VkGraphicsPipelineCreateInfo vkgpcInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+		.pNext = desc->renderPass ? 0 : &vkprcInfoDynamic,
+		.stageCount = desc->fragment ? 2 : 1,
+		.pStages = vkpsscInfos,
+		.pVertexInputState = &vkpviscInfo,
+		.pInputAssemblyState = &vkpiascInfo,
+		.pViewportState = &vkpvscInfo,
+		.pRasterizationState = &vkprscInfo,
+		.pMultisampleState = &vkpmscInfo,
+		.pDepthStencilState = &vkpdsscInfo,
+		.pColorBlendState = &vkpcbscInfo,
+		.pDynamicState = &vkpdscInfo,
+		.layout = desc->layout,
+		.renderPass = desc->renderPass,
+		.subpass = 0,
+		.basePipelineHandle = VK_NULL_HANDLE,
+		.basePipelineIndex = -1,
+	};
+	// The pipeline cache does its own locking, so every thread can share it
+	VkPipeline pipeline;
+	if (VK_SUCCESS != vkCreateGraphicsPipelines(vkDevice, vkPipelineCache, 1, &vkgpcInfo, 0, &pipeline))
+		return VK_NULL_HANDLE;
+	return pipeline;
+}
+
+// Whatever the scenes start from, the mesh's vertices drawn into this frame's targets with no depth or blending
+static void pipelineDescDefaults(struct PipelineDesc *desc)
+{
+	memset(desc, 0, sizeof(*desc));
+	desc->renderPass = vkRenderPass;
+	desc->stride = sizeof(struct Vertex);
+	desc->attributesCount = 2;
+	desc->attributes[0].location = 0;
+	desc->attributes[0].binding = 0;
+	desc->attributes[0].format = VK_FORMAT_R32G32_SFLOAT;
+	desc->attributes[0].offset = offsetof(struct Vertex, pos);
+	desc->attributes[1].location = 1;
+	desc->attributes[1].binding = 0;
+	desc->attributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+	desc->attributes[1].offset = offsetof(struct Vertex, color);
+	desc->cullMode = VK_CULL_MODE_NONE;
+	desc->samples = vkSamples;
+	desc->depthTest = VK_FALSE;
+	desc->depthWrite = VK_FALSE;
+	desc->depthCompare = VK_COMPARE_OP_LESS;
+	desc->blend = VK_FALSE;
+	desc->colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	// Render passes already pin these down
+	desc->colorFormat = vkRenderPass ? VK_FORMAT_UNDEFINED : dynamicRendering.format;
+	desc->depthFormat = vkRenderPass ? VK_FORMAT_UNDEFINED : vkDepthFormat;
+}
+
+// TIME_SCALE and BLUE_PULSE, then first is UNIS_SOURCE in vertex.glsl and CULLED in instanced-vertex.glsl. bindless-vertex.glsl skips it
+static void pipelineDescSpin(struct PipelineDesc *desc, uint32_t first)
+{
+	desc->specCount = 3;
+	desc->specValues[0] = first;
+	memcpy(&desc->specValues[1], &opts.timeScale, sizeof(opts.timeScale));
+	desc->specValues[2] = opts.bluePulse;
+}
+
+// Compiles an entry that's been claimed, on whichever thread claimed it
+static void pipelineBuild(struct PipelineEntry *entry)
+{
+	double start = nowMs();
+	VkPipeline pipeline = pipelineCompile(&entry->desc);
+	double ms = nowMs() - start;
+	SDL_LockMutex(pipelines.lock);
+	entry->pipeline = pipeline;
+	entry->state = pipeline ? PIPELINE_READY : PIPELINE_FAILED;
+	if (pipeline)
+		samplesPush(&pipelines.compileTimes, ms);
+	else
+		pipelines.failed++;
+	SDL_CondBroadcast(pipelines.done);
+	SDL_UnlockMutex(pipelines.lock);
+}
+
+static int pipelineCompilerMain(void *data)
+{
+	(void)data;
+	SDL_LockMutex(pipelines.lock);
+	for (;;)
+	{
+		while (!pipelines.quit && pipelines.queueHead == pipelines.queueTail)
+			SDL_CondWait(pipelines.wake, pipelines.lock);
+		if (pipelines.quit)
+			break;
+		struct PipelineEntry *entry = &pipelines.entries[pipelines.queue[pipelines.queueHead++ % PIPELINE_TABLE_SIZE]];
+		SDL_UnlockMutex(pipelines.lock);
+		pipelineBuild(entry);
+		SDL_LockMutex(pipelines.lock);
+	}
+	SDL_UnlockMutex(pipelines.lock);
+	return 0;
+}
+
+static int createPipelines(void)
+{
+	memset(&pipelines, 0, sizeof(pipelines));
+	if (!(pipelines.lock = SDL_CreateMutex())
+		|| !(pipelines.wake = SDL_CreateCond())
+		|| !(pipelines.done = SDL_CreateCond()))
+	{
+		eprintf("Failed to create the pipeline table's locks! %s\n", SDL_GetError());
+		return 1;
+	}
+	for (uint32_t i = 0; i < PIPELINE_COMPILERS; i++)
+	{
+		if (!(pipelines.threads[i] = SDL_CreateThread(pipelineCompilerMain, "pipeline compiler", NULL)))
+		{
+			eprintf("Failed to start a pipeline compiler thread! %s\n", SDL_GetError());
+			return 1;
+		}
+		pipelines.threadsCount++;
+	}
+	return 0;
+}
+
+/*
+ * Looks the pipeline up and counts a hit or a miss. On a miss, wait
+ * compiles it on this thread, otherwise it's queued for the compile threads
+ * and this returns VK_NULL_HANDLE until they're done. So does a pipeline
+ * that failed to compile, every time.
+ */
+static VkPipeline pipelineGet(const struct PipelineDesc *desc, bool wait)
+{
+	uint64_t hash = pipelineHash(desc);
+	SDL_LockMutex(pipelines.lock);
+	struct PipelineEntry *entry = NULL;
+	struct PipelineEntry *spare = NULL; // First evicted slot on the way, or the empty one that ended it
+	bool inserted = false;
+	for (uint32_t probe = 0; probe < PIPELINE_TABLE_SIZE && entry == NULL; probe++)
+	{
+		struct PipelineEntry *slot = &pipelines.entries[(hash + probe) & (PIPELINE_TABLE_SIZE - 1)];
+		if (slot->state == PIPELINE_EMPTY)
+		{
+			if (spare == NULL)
+				spare = slot;
+			break;
+		}
+		if (slot->state == PIPELINE_EVICTED)
+		{
+			if (spare == NULL)
+				spare = slot;
+		}
+		else if (slot->hash == hash && !memcmp(&slot->desc, desc, sizeof(*desc)))
+		{
+			entry = slot;
+		}
+	}
+	if (entry == NULL && spare != NULL)
+	{
+		spare->desc = *desc;
+		spare->hash = hash;
+		spare->state = PIPELINE_QUEUED;
+		spare->pipeline = VK_NULL_HANDLE;
+		pipelines.count++;
+		entry = spare;
+		inserted = true;
+	}
+	if (entry == NULL)
+	{
+		SDL_UnlockMutex(pipelines.lock);
+		eprintf("The pipeline table is full!\n");
+		return VK_NULL_HANDLE;
+	}
+	if (inserted)
+		pipelines.misses++;
+	else
+		pipelines.hits++;
+	if (inserted && wait)
+	{
+		// Nobody else knows about it yet, so whoever would be waiting on it might as well do it
+		SDL_UnlockMutex(pipelines.lock);
+		pipelineBuild(entry);
+		SDL_LockMutex(pipelines.lock);
+	}
+	else if (inserted)
+	{
+		pipelines.queue[pipelines.queueTail++ % PIPELINE_TABLE_SIZE] = (uint32_t)(entry - pipelines.entries);
+		SDL_CondSignal(pipelines.wake);
+	}
+	while (wait && entry->state == PIPELINE_QUEUED)
+		SDL_CondWait(pipelines.done, pipelines.lock);
+	VkPipeline pipeline = entry->state == PIPELINE_READY ? entry->pipeline : VK_NULL_HANDLE;
+	SDL_UnlockMutex(pipelines.lock);
+	return pipeline;
+}
+
+// Main thread only, before module is destroyed, so nothing made from it comes out of the table again
+static void pipelineEvict(VkShaderModule module, uint32_t frame)
+{
+	SDL_LockMutex(pipelines.lock);
+	for (uint32_t i = 0; i < PIPELINE_TABLE_SIZE; i++)
+	{
+		struct PipelineEntry *entry = &pipelines.entries[i];
+		if (entry->state == PIPELINE_EMPTY || entry->state == PIPELINE_EVICTED
+			|| (entry->desc.vertex != module && entry->desc.fragment != module))
+		{
+			continue;
+		}
+		// A compile thread could be using the module right now
+		while (entry->state == PIPELINE_QUEUED)
+			SDL_CondWait(pipelines.done, pipelines.lock);
+		if (entry->state == PIPELINE_READY)
+			deferPipeline(entry->pipeline, frame);
+		entry->state = PIPELINE_EVICTED;
+		entry->pipeline = VK_NULL_HANDLE;
+		pipelines.count--;
+	}
+	SDL_UnlockMutex(pipelines.lock);
+}
+
+static void pipelinesReport(void)
+{
+	SDL_LockMutex(pipelines.lock);
+	printf("pipelines: %u cached, %u hits, %u misses, %u failed, %u frames with a stand-in\n",
+		pipelines.count, pipelines.hits, pipelines.misses, pipelines.failed, pipelines.standIns);
+	samplesReport("pipeline compile (ms)", &pipelines.compileTimes);
+	SDL_UnlockMutex(pipelines.lock);
+}
+
+// Once nothing will ask for a pipeline again, whatever the compile threads didn't get to is dropped
+static void destroyPipelines(uint32_t frame)
+{
+	if (pipelines.lock == NULL)
+		return;
+	SDL_LockMutex(pipelines.lock);
+	pipelines.quit = true;
+	SDL_CondBroadcast(pipelines.wake);
+	SDL_UnlockMutex(pipelines.lock);
+	for (uint32_t i = 0; i < pipelines.threadsCount; i++)
+		SDL_WaitThread(pipelines.threads[i], NULL);
+	for (uint32_t i = 0; i < PIPELINE_TABLE_SIZE; i++)
+	{
+		if (pipelines.entries[i].state == PIPELINE_READY)
+			deferPipeline(pipelines.entries[i].pipeline, frame);
+	}
+	SDL_DestroyCond(pipelines.done);
+	SDL_DestroyCond(pipelines.wake);
+	SDL_DestroyMutex(pipelines.lock);
+	free(pipelines.compileTimes.values);
+	memset(&pipelines, 0, sizeof(pipelines));
+}
+
+/*
+ * Depth never has to outlive the render pass, so it's a transient
+ * attachment that gets cleared on load and dropped on store. Tilers can
+ * keep it all in tile memory and back it with lazily allocated memory that
+ * never gets committed. Everyone else just gets normal device memory.
+ * With MSAA the samples are the same deal, since the subpass resolves them
+ * into the frame's image before they'd ever have to be stored.
+ */
+static VkFormat pickDepthFormat(void)
+{
+	// D16 is the only one that's guaranteed, and neither has stencil to worry about
+	VkFormat candidates[] = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM };
+	for (uint32_t i = 0; i < ARRAYSIZE(candidates); i++)
+	{
+		VkFormatProperties vkFormatProps;
+		vkGetPhysicalDeviceFormatProperties(vkPhysDevice, candidates[i], &vkFormatProps);
+		if (vkFormatProps.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+			return candidates[i];
+	}
+	return VK_FORMAT_D16_UNORM;
+}
+
+// The most samples up to requested that both color and depth can do
+static VkSampleCountFlagBits pickSamples(uint32_t requested)
+{
+	VkSampleCountFlags supported = vkPhysProps.limits.framebufferColorSampleCounts & vkPhysProps.limits.framebufferDepthSampleCounts;
+	uint32_t samples = requested;
+	while (samples > 1 && !(supported & samples))
+		samples >>= 1;
+	if (samples != requested)
+		eprintf("No %ux MSAA here, %ux will have to do!\n", requested, samples);
+	return (VkSampleCountFlagBits)samples;
+}
+
+static int createTransientTarget(VkFormat vkFormat, VkImageUsageFlags usage, VkImageAspectFlags aspect, VkExtent2D vkExtent,
+	VkImage *image, VkImageView *view, struct GpuAlloc *memory)
+{
+	VkImageCreateInfo vkicInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.imageType = VK_IMAGE_TYPE_2D,
+		.format = vkFormat,
+		.extent = { vkExtent.width, vkExtent.height, 1 },
+		.mipLevels = 1,
+		.arrayLayers = 1,
+		.samples = vkSamples,
+		.tiling = VK_IMAGE_TILING_OPTIMAL,
+		.usage = usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+	};
+	if (VK_SUCCESS != vkCreateImage(vkDevice, &vkicInfo, 0, image)
+		|| gpuAllocImage(*image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, memory))
+		return 1;
+	VkImageViewCreateInfo vkivcInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.image = *image,
+		.viewType = VK_IMAGE_VIEW_TYPE_2D,
+		.format = vkFormat,
+		.subresourceRange.aspectMask = aspect,
+		.subresourceRange.baseMipLevel = 0,
+		.subresourceRange.levelCount = 1,
+		.subresourceRange.baseArrayLayer = 0,
+		.subresourceRange.layerCount = 1,
+	};
+	return VK_SUCCESS != vkCreateImageView(vkDevice, &vkivcInfo, 0, view);
+}
+
+// The depth buffer, and the multisampled color with MSAA on
+static int createTransientTargets(VkFormat vkFormat, VkExtent2D vkExtent)
+{
+	if (0 != createTransientTarget(vkDepthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT,
+		vkExtent, &vkDepthImage, &vkDepthView, &vkDepthMemory))
+	{
+		eprintf("Failed to create the depth buffer!\n");
+		return 1;
+	}
+	if (vkSamples != VK_SAMPLE_COUNT_1_BIT
+		&& 0 != createTransientTarget(vkFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT,
+			vkExtent, &vkMsaaImage, &vkMsaaView, &vkMsaaMemory))
+	{
+		eprintf("Failed to create the multisampled color target!\n");
+		return 1;
+	}
+	bool lazy = gpuAllocator.memProps.memoryTypes[vkDepthMemory.memoryType].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+	eprintf("Created %ux%u depth buffer (format %d) at %ux MSAA in %s memory\n", vkExtent.width, vkExtent.height, vkDepthFormat,
+		vkSamples, lazy ? "lazily allocated" : "plain device");
+	return 0;
+}
+
+/*
+ * What MSAA costs in memory. Lazily allocated memory can say how much of
+ * it really got committed, but only for a whole VkDeviceMemory, so anything
+ * sharing a block is counted in full.
+ */
+static void transientTargetsReport(void)
+{
+	const struct GpuAlloc *allocs[] = { &vkDepthMemory, &vkMsaaMemory };
+	VkDeviceSize committed = 0;
+	bool lazy = false;
+	for (uint32_t i = 0; i < ARRAYSIZE(allocs); i++)
+	{
+		VkDeviceSize bytes = allocs[i]->size;
+		if (allocs[i]->memory && (gpuAllocator.memProps.memoryTypes[allocs[i]->memoryType].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT))
+		{
+			lazy = true;
+			if (allocs[i]->block == UINT32_MAX)
+				vkGetDeviceMemoryCommitment(vkDevice, allocs[i]->memory, &bytes);
+		}
+		committed += bytes;
+	}
+	printf("render targets: %ux msaa, depth %.2f MiB + samples %.2f MiB in %s memory, %.2f MiB committed\n", vkSamples,
+		vkDepthMemory.size / 1048576.0, vkMsaaMemory.size / 1048576.0, lazy ? "lazily allocated" : "plain device", committed / 1048576.0);
+}
+
+static int createFramebuffers(VkExtent2D vkExtent, VkRenderPass vkRenderPassCompat)
+{
+	// Nothing to do, the views are all dynamic rendering needs
+	if (dynamicRendering.enabled)
+		return 0;
+	vkFramebuffers = calloc(vkSwapchainImagesCount, sizeof(*vkFramebuffers));
+	if (vkFramebuffers == NULL)
+	{
+		eprintf("Failed to allocate array of Framebuffers!\n");
+		return 1;
+	}
+	for (size_t i = 0; i < vkSwapchainImagesCount; i++)
+	{
+		// Same order as the render pass, which only has the samples with MSAA on
+		VkImageView vkImageViewAttachments[] = { vkSwapchainImageViews[i], vkDepthView, vkMsaaView };
+		VkFramebufferCreateInfo vkfcInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+			.renderPass = vkRenderPassCompat,
+			.attachmentCount = vkMsaaView ? 3 : 2,
+			.pAttachments = vkImageViewAttachments,
+			.width = vkExtent.width,
+			.height = vkExtent.height,
+			.layers = 1,
+		};
+		if (VK_SUCCESS != vkCreateFramebuffer(vkDevice, &vkfcInfo, 0, &vkFramebuffers[i]))
+		{
+			eprintf("Failed to allocate framebuffer!\n");
+			return 1;
+		}
+		eprintf("Created framebuffer %zu from view %p: %p\n", i,  vkImageViewAttachments[0], vkFramebuffers[i]);
+	}
+	eprintf("Created Framebuffers!\n");
+	return 0;
+}
+
+/*
+ * Headless mode has no surface to get images from, so we make our own
+ * images and pretend they're the swapchain. Everything downstream
+ * (views, framebuffers, the render loop) can't tell the difference.
+ */
+static int createOffscreenTargets(VkFormat vkFormat, VkExtent2D vkExtent, VkRenderPass vkRenderPassCompat)
+{
+	vkSwapchainImagesCount = OFFSCREEN_IMAGES_COUNT;
+	if (!(vkSwapchainImages = calloc(vkSwapchainImagesCount, sizeof(*vkSwapchainImages)))
+		|| !(vkSwapchainImageViews = calloc(vkSwapchainImagesCount, sizeof(*vkSwapchainImageViews)))
+		|| !(vkOffscreenMemories = calloc(vkSwapchainImagesCount, sizeof(*vkOffscreenMemories))))
+	{
+		eprintf("Failed to allocate offscreen image arrays!\n");
+		return 1;
+	}
+	for (uint32_t i = 0; i < vkSwapchainImagesCount; i++)
+	{
+		VkImageCreateInfo vkicInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = vkFormat,
+			.extent = { vkExtent.width, vkExtent.height, 1 },
+			.mipLevels = 1,
+			.arrayLayers = 1,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		};
+		if (VK_SUCCESS != vkCreateImage(vkDevice, &vkicInfo, 0, &vkSwapchainImages[i]))
+		{
+			eprintf("Failed to create offscreen image!\n");
+			return 1;
+		}
+		if (gpuAllocImage(vkSwapchainImages[i], 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vkOffscreenMemories[i]))
+		{
+			eprintf("Failed to back offscreen image with memory!\n");
+			return 1;
+		}
+
+		VkImageViewCreateInfo vkivcInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.image = vkSwapchainImages[i],
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = vkFormat,
+			.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.subresourceRange.baseMipLevel = 0,
+			.subresourceRange.levelCount = 1,
+			.subresourceRange.baseArrayLayer = 0,
+			.subresourceRange.layerCount = 1,
+		};
+		if (VK_SUCCESS != vkCreateImageView(vkDevice, &vkivcInfo, 0, &vkSwapchainImageViews[i]))
+		{
+			eprintf("Failed to create offscreen image view!\n");
+			return 1;
+		}
+	}
+	eprintf("Created %u offscreen targets (%ux%u)\n", vkSwapchainImagesCount, vkExtent.width, vkExtent.height);
+	return createTransientTargets(vkFormat, vkExtent) || createFramebuffers(vkExtent, vkRenderPassCompat);
+}
+
+/*
+ * Queues up the swapchain or offscreen images along with their views and
+ * framebuffers for deletion, and forgets about them. Frames before frame
+ * might still be rendering to them.
+ */
+static void retireRenderTargets(uint32_t frame)
+{
+	for (uint32_t i = 0; vkFramebuffers && i < vkSwapchainImagesCount; i++)
+	{
+		if (vkFramebuffers[i])
+			deferFramebuffer(vkFramebuffers[i], frame);
+	}
+	for (uint32_t i = 0; vkSwapchainImageViews && i < vkSwapchainImagesCount; i++)
+	{
+		if (vkSwapchainImageViews[i])
+			deferImageView(vkSwapchainImageViews[i], frame);
+	}
+	// Offscreen images are ours, swapchain images go with the swapchain
+	for (uint32_t i = 0; vkOffscreenMemories && i < vkSwapchainImagesCount; i++)
+		deferImage(vkSwapchainImages[i], &vkOffscreenMemories[i], frame);
+	if (vkDepthView)
+		deferImageView(vkDepthView, frame);
+	if (vkDepthImage)
+		deferImage(vkDepthImage, &vkDepthMemory, frame);
+	if (vkMsaaView)
+		deferImageView(vkMsaaView, frame);
+	if (vkMsaaImage)
+		deferImage(vkMsaaImage, &vkMsaaMemory, frame);
+	vkDepthView = 0;
+	vkDepthImage = 0;
+	vkMsaaView = 0;
+	vkMsaaImage = 0;
+	if (vkSwapchain)
+		deferSwapchain(vkSwapchain, frame);
+	free(vkFramebuffers);
+	free(vkSwapchainImageViews);
+	free(vkSwapchainImages);
+	free(vkOffscreenMemories);
+	vkFramebuffers = 0;
+	vkSwapchainImageViews = 0;
+	vkSwapchainImages = 0;
+	vkOffscreenMemories = 0;
+	vkSwapchain = 0;
+	vkSwapchainImagesCount = 0;
+}
+
+// What size the swapchain should be right now, which can be 0x0 while minimized
+static VkExtent2D surfaceExtent(SDL_Window *window, const VkSurfaceCapabilitiesKHR *vkSurfaceCaps)
+{
+	VkExtent2D extent = vkSurfaceCaps->currentExtent;
+	if (extent.width == UINT32_MAX || extent.height == UINT32_MAX)
+	{
+		int w, h;
+		SDL_Vulkan_GetDrawableSize(window, &w, &h);
+		extent.width = clampu32((uint32_t)w, vkSurfaceCaps->minImageExtent.width, vkSurfaceCaps->maxImageExtent.width);
+		extent.height = clampu32((uint32_t)h, vkSurfaceCaps->minImageExtent.height, vkSurfaceCaps->maxImageExtent.height);
+	}
+	return extent;
+}
+
+// The old swapchain is only handed over, whoever retired it still has to destroy it
+static int createSwapchain(VkSurfaceKHR vkSurface, VkSurfaceCapabilitiesKHR *vkSurfaceCaps, VkSurfaceFormatKHR *vkFormatDesired, VkSwapchainKHR vkSwapchainOld)
+{
+	// I fucking hate Vulkan so much
+	// An image for every frame in flight and one more for the display, where a max of 0 means no max
+	uint32_t imageCount = maxu32(vkSurfaceCaps->minImageCount + 1, opts.framesInFlight + 1);
+	if (vkSurfaceCaps->maxImageCount != 0)
+		imageCount = minu32(imageCount, vkSurfaceCaps->maxImageCount);
+	eprintf("Min,Count,Max Image Count=%u,%u,%u\n", vkSurfaceCaps->minImageCount, imageCount, vkSurfaceCaps->maxImageCount);
+	VkSwapchainCreateInfoKHR vkscInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+		.surface = vkSurface,
+		.minImageCount = imageCount,
+		.imageFormat = vkFormatDesired->format,
+		.imageColorSpace = vkFormatDesired->colorSpace,
+		.imageExtent = vkExtentDesired,
+		.imageArrayLayers = 1,
+		.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+		/*
+		 * NOTE:
+		 * We differ from the Khronos tutorial right now by having
+		 * the graphics queue family equal to the presentation queue family.
+		 * If we couldn't find such a queue, we would set the fields
+		 * like this instead...
+		 * 
+		 * .imageSharingMode = VK_SHARING_MODE_CONCURRENT,
+		 * .queueFamilyIndexCount = 2,
+		 * .pQueueFamilyIndices = (uint32_t[2]){grFamily,prFamily},
+		 */
+		.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.queueFamilyIndexCount = 0,
+		.pQueueFamilyIndices = 0,
+		.preTransform = vkSurfaceCaps->currentTransform,
+		.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
+		.presentMode = vkPresentModeDesired,
+		.clipped = VK_TRUE,
+		.oldSwapchain = vkSwapchainOld,
+	};
+	if (VK_SUCCESS != vkCreateSwapchainKHR(vkDevice, &vkscInfo, 0, &vkSwapchain))
+	{
+		eprintf("Failed to create the swapchain!\n");
+		return 1;
+	}
+
+	if (VK_SUCCESS != vkGetSwapchainImagesKHR(vkDevice, vkSwapchain, &vkSwapchainImagesCount, vkSwapchainImages)
+		|| !(vkSwapchainImages = malloc(vkSwapchainImagesCount * sizeof(*vkSwapchainImages)))
+		|| !(vkSwapchainImageViews = calloc(sizeof(*vkSwapchainImageViews), vkSwapchainImagesCount))
+		|| VK_SUCCESS != vkGetSwapchainImagesKHR(vkDevice, vkSwapchain, &vkSwapchainImagesCount, vkSwapchainImages))
+	{
+		eprintf("Failed to get swapchain images!\n");
+		return 1;
+	}
+	eprintf("Vk Swapchain images count: %d\n", vkSwapchainImagesCount);
+	if (vkSwapchainImagesCount == 0)
+	{
+		eprintf("No swapchain images? Excuse me?");
+		return 1;
+	}
+	
+	for (uint32_t i = 0; i < vkSwapchainImagesCount; i++)
+	{
+		VkImageViewCreateInfo vkivcInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.image = vkSwapchainImages[i],
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = vkFormatDesired->format,
+			.components.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+			.components.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+			.components.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+			.components.a = VK_COMPONENT_SWIZZLE_IDENTITY,
+			.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.subresourceRange.baseMipLevel = 0,
+			.subresourceRange.levelCount = 1,
+			.subresourceRange.baseArrayLayer = 0,
+			.subresourceRange.layerCount = 1,
+		};
+
+		if (VK_SUCCESS != vkCreateImageView(vkDevice, &vkivcInfo, 0, &vkSwapchainImageViews[i]))
+		{
+			eprintf("Failed to create image views!\n");
+			return 1;
+		}
+	}
+
+	return createTransientTargets(vkFormatDesired->format, vkExtentDesired) || createFramebuffers(vkExtentDesired, vkRenderPass);
+}
+
+/*
+ * Builds a swapchain at the window's current size from the old one, which
+ * keeps presenting whatever is already in flight. Returns -1 without doing
+ * anything when there's nothing to draw to, like when minimized.
+ */
+static int recreateSwapchain(SDL_Window *window, VkSurfaceKHR vkSurface, VkSurfaceCapabilitiesKHR *vkSurfaceCaps,
+	VkSurfaceFormatKHR *vkFormatDesired, uint32_t frame)
+{
+	if (VK_SUCCESS != vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vkPhysDevice, vkSurface, vkSurfaceCaps))
+	{
+		eprintf("Failed to get physical surface capabilities!\n");
+		return 1;
+	}
+	VkExtent2D extent = surfaceExtent(window, vkSurfaceCaps);
+	if (extent.width == 0 || extent.height == 0)
+		return -1;
+	// Still handed over below, the deletion only happens once its frames are done
+	VkSwapchainKHR vkSwapchainOld = vkSwapchain;
+	retireRenderTargets(frame);
+
+	vkExtentDesired = extent;
+	vkSurfaceCaps->currentExtent = extent;
+	return createSwapchain(vkSurface, vkSurfaceCaps, vkFormatDesired, vkSwapchainOld);
+}
+
+static VKAPI_ATTR VkBool32 VKAPI_CALL vkDbgCb(
+	VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+	VkDebugUtilsMessageTypeFlagsEXT flags,
+	const VkDebugUtilsMessengerCallbackDataEXT *data,
+	void *userdata)
+{
+	(void)userdata;
+	eprintf("Super-Epic Validation Layer: %08x,%08x,%s\n", severity, flags, data->pMessage);
+	return VK_FALSE;
+}
+static VkDebugUtilsMessengerCreateInfoEXT vkdumcInfo =
+{
+	.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
+	.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT
+	| VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT
+	| VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT
+	| VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
+	.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT
+	| VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT
+	| VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
+	.pfnUserCallback = vkDbgCb,
+	.pUserData = 0,
+};
+
+
+/*
+ * GPU timing with timestamp queries. Each frame in flight owns a slice of
+ * the query pool with a begin/end pair per scope. Scopes get named while
+ * recording, and their results are read back once that frame's fence has
+ * signaled, which is opts.framesInFlight frames later, so reading never
+ * waits on the GPU.
+ *
+ * Scopes are reserved on the main thread only. Worker threads can still
+ * write the timestamps of scopes reserved for them into their secondaries.
+ */
+struct GpuScope
+{
+	char name[24];
+	double ms;
+};
+
+struct GpuScopeStats
+{
+	char name[24];
+	struct Samples samples;
+};
+
+struct GpuTimers
+{
+	VkQueryPool pool; // 0 if the graphics queue can't do timestamps
+	double nsPerTick;
+	uint64_t mask; // Timestamps only have timestampValidBits worth of bits
+	struct
+	{
+		char names[MAX_GPU_SCOPES][24];
+		uint32_t count;
+		uint32_t frame;
+		bool pending;
+	} frames[MAX_FRAMES_IN_FLIGHT];
+	uint32_t framesRecorded;
+	// The latest frame that was read back
+	struct GpuScope results[MAX_GPU_SCOPES];
+	uint32_t resultsCount;
+	// Every frame since the last gpuTimersReset(), by scope name
+	struct GpuScopeStats stats[MAX_GPU_SCOPES];
+	uint32_t statsCount;
+	FILE *csv;
+} gpuTimers = { 0 };
+
+static int createGpuTimers(uint32_t validBits, const char *csvPath)
+{
+	memset(&gpuTimers, 0, sizeof(gpuTimers));
+	if (csvPath)
+	{
+		if (!(gpuTimers.csv = fopen(csvPath, "w")))
+		{
+			eprintf("Can't open %s for the GPU times!\n", csvPath);
+			return 1;
+		}
+		fprintf(gpuTimers.csv, "frame,scope,ms\n");
+	}
+	if (validBits == 0)
+	{
+		eprintf("The graphics queue has no timestamps, so no GPU times for you\n");
+		return 0;
+	}
+	gpuTimers.nsPerTick = vkPhysProps.limits.timestampPeriod;
+	gpuTimers.mask = validBits >= 64 ? UINT64_MAX : ((uint64_t)1 << validBits) - 1;
+	VkQueryPoolCreateInfo vkqpcInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.queryType = VK_QUERY_TYPE_TIMESTAMP,
+		.queryCount = MAX_FRAMES_IN_FLIGHT * MAX_GPU_SCOPES * 2,
+	};
+	if (VK_SUCCESS != vkCreateQueryPool(vkDevice, &vkqpcInfo, 0, &gpuTimers.pool))
+	{
+		eprintf("Failed to create the timestamp query pool!\n");
+		return 1;
+	}
+	return 0;
+}
+
+static void destroyGpuTimers(void)
+{
+	if (gpuTimers.pool)
+		vkDestroyQueryPool(vkDevice, gpuTimers.pool, 0);
+	if (gpuTimers.csv)
+		fclose(gpuTimers.csv);
+	for (uint32_t i = 0; i < gpuTimers.statsCount; i++)
+		free(gpuTimers.stats[i].samples.values);
+	memset(&gpuTimers, 0, sizeof(gpuTimers));
+}
+
+// Must be recorded outside a render pass before any scope of the frame
+static void gpuTimersBeginFrame(VkCommandBuffer commandBuffer, uint32_t inFlight)
+{
+	gpuTimers.frames[inFlight].count = 0;
+	gpuTimers.frames[inFlight].frame = gpuTimers.framesRecorded++;
+	gpuTimers.frames[inFlight].pending = gpuTimers.pool != 0;
+	if (gpuTimers.pool)
+		vkCmdResetQueryPool(commandBuffer, gpuTimers.pool, inFlight * MAX_GPU_SCOPES * 2, MAX_GPU_SCOPES * 2);
+}
+
+// Returns UINT32_MAX when there's no room or no timestamps, which gpuScopeWrite() ignores
+static uint32_t gpuScopeReserve(uint32_t inFlight, const char *name)
+{
+	if (gpuTimers.pool == 0 || gpuTimers.frames[inFlight].count == MAX_GPU_SCOPES)
+		return UINT32_MAX;
+	uint32_t scope = gpuTimers.frames[inFlight].count++;
+	snprintf(gpuTimers.frames[inFlight].names[scope], sizeof(gpuTimers.frames[inFlight].names[scope]), "%s", name);
+	return scope;
+}
+
+static void gpuScopeWrite(VkCommandBuffer commandBuffer, uint32_t inFlight, uint32_t scope, bool end)
+{
+	if (scope == UINT32_MAX)
+		return;
+	vkCmdWriteTimestamp(commandBuffer, end ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		gpuTimers.pool, (inFlight * MAX_GPU_SCOPES + scope) * 2 + end);
+}
+
+static uint32_t gpuScopeBegin(VkCommandBuffer commandBuffer, uint32_t inFlight, const char *name)
+{
+	uint32_t scope = gpuScopeReserve(inFlight, name);
+	gpuScopeWrite(commandBuffer, inFlight, scope, false);
+	return scope;
+}
+
+static void gpuScopeEnd(VkCommandBuffer commandBuffer, uint32_t inFlight, uint32_t scope)
+{
+	gpuScopeWrite(commandBuffer, inFlight, scope, true);
+}
+
+// Only call this once the frame's fence has signaled
+static void gpuTimersCollect(uint32_t inFlight)
+{
+	if (!gpuTimers.frames[inFlight].pending)
+		return;
+	gpuTimers.frames[inFlight].pending = false;
+	uint32_t count = gpuTimers.frames[inFlight].count;
+	uint64_t ticks[MAX_GPU_SCOPES * 2];
+	if (count == 0 || VK_SUCCESS != vkGetQueryPoolResults(vkDevice, gpuTimers.pool, inFlight * MAX_GPU_SCOPES * 2, count * 2,
+		sizeof(ticks), ticks, sizeof(*ticks), VK_QUERY_RESULT_64_BIT))
+		return;
+	gpuTimers.resultsCount = count;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		struct GpuScope *result = &gpuTimers.results[i];
+		memcpy(result->name, gpuTimers.frames[inFlight].names[i], sizeof(result->name));
+		result->ms = (double)((ticks[2 * i + 1] - ticks[2 * i]) & gpuTimers.mask) * gpuTimers.nsPerTick / 1e6;
+		if (gpuTimers.csv)
+			fprintf(gpuTimers.csv, "%u,%s,%.6f\n", gpuTimers.frames[inFlight].frame, result->name, result->ms);
+
+		uint32_t s = 0;
+		while (s < gpuTimers.statsCount && strcmp(gpuTimers.stats[s].name, result->name))
+			s++;
+		if (s == gpuTimers.statsCount)
+		{
+			if (s == MAX_GPU_SCOPES)
+				continue;
+			memcpy(gpuTimers.stats[s].name, result->name, sizeof(result->name));
+			gpuTimers.statsCount++;
+		}
+		samplesPush(&gpuTimers.stats[s].samples, result->ms);
+	}
+}
+
+// The scopes of the latest frame that was read back, in the order they were begun
+static uint32_t gpuTimerResults(const struct GpuScope **scopes)
+{
+	*scopes = gpuTimers.results;
+	return gpuTimers.resultsCount;
+}
+
+// Median GPU time of a scope since the last reset, or 0 if it never ran
+static double gpuTimerP50(const char *name)
+{
+	for (uint32_t s = 0; s < gpuTimers.statsCount; s++)
+	{
+		struct Samples *samples = &gpuTimers.stats[s].samples;
+		if (strcmp(gpuTimers.stats[s].name, name))
+			continue;
+		qsort(samples->values, samples->count, sizeof(*samples->values), cmpDouble);
+		return samplesPercentile(samples->values, samples->count, 0.50);
+	}
+	return 0;
+}
+
+static void gpuTimersReport(void)
+{
+	for (uint32_t s = 0; s < gpuTimers.statsCount; s++)
+	{
+		char label[40];
+		snprintf(label, sizeof(label), "gpu %s (ms)", gpuTimers.stats[s].name);
+		samplesReport(label, &gpuTimers.stats[s].samples);
+	}
+}
+
+static void gpuTimersReset(void)
+{
+	for (uint32_t s = 0; s < gpuTimers.statsCount; s++)
+		free(gpuTimers.stats[s].samples.values);
+	memset(gpuTimers.stats, 0, sizeof(gpuTimers.stats));
+	gpuTimers.statsCount = 0;
+}
+
+// Records draws [first, first + count) along with all the state they need, returns how many descriptor binds that took
+static uint32_t recordDraws(VkCommandBuffer commandBuffer, uint32_t inFlight, uint32_t first, uint32_t count, float time)
+{
+	VkViewport vkViewports[] =
+	{
+		{
+			.x = 0,
+			.y = 0,
+			.width = (float)vkExtentDesired.width,
+			.height = (float)vkExtentDesired.height,
+			.minDepth = 0,
+			.maxDepth = 1,
+		}
+	};
+	VkRect2D vkScissors[] =
+	{
+		{
+			.offset = {0, 0},
+			.extent = vkExtentDesired,
+		}
+	};
+	VkPipeline pipeline = vkVariantPipeline ? vkVariantPipeline : vkGraphicsPipelines[uniforms.scheme];
+	VkPipelineLayout layout = vkPipelineLayouts[uniforms.scheme];
+	if (materials.count)
+	{
+		pipeline = materials.bindless ? vkBindlessPipeline : vkMaterialPipeline;
+		layout = materials.bindless ? vkBindlessPipelineLayout : vkMaterialPipelineLayout;
+	}
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	uint32_t binds = 0;
+	uint32_t boundMaterial = UINT32_MAX;
+	if (materials.bindless)
+	{
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &bindless.sets[inFlight], 0, 0);
+		binds++;
+	}
+	VkDeviceSize vertexOffset = 0;
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &mesh.vertexBuffer, &vertexOffset);
+	vkCmdBindIndexBuffer(commandBuffer, mesh.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+	vkCmdSetViewport(commandBuffer, 0, ARRAYSIZE(vkViewports), vkViewports);
+	vkCmdSetScissor(commandBuffer, 0, ARRAYSIZE(vkScissors), vkScissors);
+	// Neither reads the set, but the blocks the shader didn't specialize to still need something bound
+	bool pushed = uniforms.scheme == UNIFORMS_PUSH;
+	bool indexed = uniforms.scheme == UNIFORMS_STORAGE;
+	if (pushed || indexed)
+	{
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &uniforms.sets[0], 0, 0);
+		binds++;
+	}
+	float cell = 2.0f / uniforms.columns;
+	for (uint32_t draw = first; draw < first + count; draw++)
+	{
+		VkDescriptorSet descSet;
+		uint32_t dynamicOffset;
+		struct Unis pushUnis;
+		struct Unis *unis = pushed ? &pushUnis : uniformsForDraw(inFlight, draw, &descSet, &dynamicOffset);
+		// A grid that fills the screen, so a single draw looks like it always did
+		unis->time = time;
+		unis->scale = 1.0f / uniforms.columns;
+		unis->offset[0] = -1.0f + cell * (draw % uniforms.columns + 0.5f);
+		unis->offset[1] = -1.0f + cell * (draw / uniforms.columns + 0.5f);
+		uint32_t material = materials.count ? materialForDraw(draw) : 0;
+		if (materials.bindless)
+		{
+			// The ring's slices are all a multiple of sizeof(struct Unis) in
+			struct BindlessParams params =
+			{
+				.unis = (uint32_t)(((char *)unis - (char *)uniforms.memories[0].mapped) / sizeof(struct Unis)),
+				.material = BINDLESS_FIRST_MATERIAL + material,
+			};
+			vkCmdPushConstants(commandBuffer, layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+				0, sizeof(params), &params);
+		}
+		else if (pushed)
+		{
+			vkCmdPushConstants(commandBuffer, layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushUnis), &pushUnis);
+		}
+		else if (!indexed)
+		{
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &descSet,
+				uniforms.scheme == UNIFORMS_RING ? 1 : 0, &dynamicOffset);
+			binds++;
+			// Draws come in runs of the same material, so this is once a run
+			if (materials.count && material != boundMaterial)
+			{
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 1, 1,
+					&materials.sets[inFlight * materials.count + material], 0, 0);
+				boundMaterial = material;
+				binds++;
+			}
+		}
+		// Storage slices are packed tight, so the slice is the index
+		uint32_t firstInstance = indexed ? (uint32_t)(((char *)unis - (char *)uniforms.memories[0].mapped) / sizeof(struct Unis)) : 0;
+		vkCmdDrawIndexed(commandBuffer, mesh.indicesCount, 1, 0, 0, firstInstance);
+	}
+	return binds;
+}
+
+/*
+ * Threads that record the draw list into secondary command buffers.
+ *
+ * Every worker has a command pool per frame in flight, since pools can only
+ * be used by one thread at a time, and resets the whole pool at the start
+ * of its job instead of individual buffers. The main thread hands out a
+ * contiguous slice of the draws to each worker, wakes them all up and
+ * waits for them before executing their secondaries in order.
+ */
+struct Worker
+{
+	SDL_Thread *thread;
+	SDL_sem *start;
+	VkCommandPool pools[MAX_FRAMES_IN_FLIGHT];
+	VkCommandBuffer commandBuffers[MAX_FRAMES_IN_FLIGHT];
+	// The current job, written by the main thread before posting start
+	uint32_t first;
+	uint32_t count;
+	uint32_t scope; // GPU timer scope, reserved by the main thread
+	uint32_t binds;
+	int err;
+};
+
+struct Workers
+{
+	struct Worker *workers;
+	uint32_t count;
+	SDL_sem *done;
+	bool quit;
+	// Shared by every worker's job
+	uint32_t inFlight;
+	uint32_t imageIndex;
+	float time;
+} workerPool = { 0 };
+
+static int recordSecondary(struct Worker *worker)
+{
+	uint32_t inFlight = workerPool.inFlight;
+	VkCommandBuffer commandBuffer = worker->commandBuffers[inFlight];
+	vkResetCommandPool(vkDevice, worker->pools[inFlight], 0);
+	VkCommandBufferInheritanceRenderingInfo vkcbirInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+		.colorAttachmentCount = 1,
+		.pColorAttachmentFormats = &dynamicRendering.format,
+		.depthAttachmentFormat = vkDepthFormat,
+		.rasterizationSamples = vkSamples,
+	};
+	VkCommandBufferInheritanceInfo vkcbiInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+		.pNext = dynamicRendering.enabled ? &vkcbirInfo : 0,
+		.renderPass = vkRenderPass,
+		.subpass = 0,
+		.framebuffer = dynamicRendering.enabled ? VK_NULL_HANDLE : vkFramebuffers[workerPool.imageIndex],
+	};
+	VkCommandBufferBeginInfo vkcbbInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+		.pInheritanceInfo = &vkcbiInfo,
+	};
+	if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffer, &vkcbbInfo))
+	{
+		eprintf("Beginning secondary command buffer failed!\n");
+		return 1;
+	}
+	gpuScopeWrite(commandBuffer, inFlight, worker->scope, false);
+	worker->binds = recordDraws(commandBuffer, inFlight, worker->first, worker->count, workerPool.time);
+	gpuScopeWrite(commandBuffer, inFlight, worker->scope, true);
+	if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer))
+	{
+		eprintf("Failed to record a secondary command buffer!\n");
+		return 1;
+	}
+	return 0;
+}
+
+static int workerMain(void *data)
+{
+	struct Worker *worker = data;
+	for (;;)
+	{
+		SDL_SemWait(worker->start);
+		if (workerPool.quit)
+			break;
+		worker->err = recordSecondary(worker);
+		SDL_SemPost(workerPool.done);
+	}
+	return 0;
+}
+
+static int createWorkers(uint32_t count, uint32_t queueFamily)
+{
+	memset(&workerPool, 0, sizeof(workerPool));
+	if (count == 0)
+		return 0;
+	if (!(workerPool.workers = calloc(count, sizeof(*workerPool.workers)))
+		|| !(workerPool.done = SDL_CreateSemaphore(0)))
+	{
+		eprintf("Failed to create the worker pool!\n");
+		return 1;
+	}
+	for (uint32_t i = 0; i < count; i++)
+	{
+		struct Worker *worker = &workerPool.workers[i];
+		for (uint32_t j = 0; j < opts.framesInFlight; j++)
+		{
+			VkCommandPoolCreateInfo vkpcInfo =
+			{
+				.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+				.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+				.queueFamilyIndex = queueFamily,
+			};
+			if (VK_SUCCESS != vkCreateCommandPool(vkDevice, &vkpcInfo, 0, &worker->pools[j]))
+			{
+				eprintf("Failed to create worker command pool!\n");
+				return 1;
+			}
+			VkCommandBufferAllocateInfo vkcbaInfo =
+			{
+				.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+				.commandPool = worker->pools[j],
+				.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+				.commandBufferCount = 1,
+			};
+			if (VK_SUCCESS != vkAllocateCommandBuffers(vkDevice, &vkcbaInfo, &worker->commandBuffers[j]))
+			{
+				eprintf("Failed to allocate worker command buffers!\n");
+				return 1;
+			}
+		}
+		if (!(worker->start = SDL_CreateSemaphore(0))
+			|| !(worker->thread = SDL_CreateThread(workerMain, "recorder", worker)))
+		{
+			eprintf("Failed to start a worker thread! %s\n", SDL_GetError());
+			return 1;
+		}
+		workerPool.count++;
+	}
+	return 0;
+}
+
+// Only call this once the GPU is done with every frame in flight
+static void destroyWorkers(void)
+{
+	workerPool.quit = true;
+	for (uint32_t i = 0; i < workerPool.count; i++)
+		SDL_SemPost(workerPool.workers[i].start);
+	for (uint32_t i = 0; i < workerPool.count; i++)
+	{
+		struct Worker *worker = &workerPool.workers[i];
+		SDL_WaitThread(worker->thread, NULL);
+		SDL_DestroySemaphore(worker->start);
+		for (uint32_t j = 0; j < opts.framesInFlight; j++)
+			vkDestroyCommandPool(vkDevice, worker->pools[j], 0);
+	}
+	if (workerPool.done)
+		SDL_DestroySemaphore(workerPool.done);
+	free(workerPool.workers);
+	memset(&workerPool, 0, sizeof(workerPool));
+}
+
+/*
+ * Full-screen layers with an expensive fragment shader, stacked back to front
+ * so the depth test can't reject any of them on the way in. With the pre-pass,
+ * a depth-only pass finds the front layer first, and the shading pass only
+ * runs the fragment shader where the depth is EQUAL, once per pixel.
+ * The other scenes are flat at z=0 and drawn in order, so they leave it off.
+ *
+ * The fragment shader's loop count and whether it wobbles are
+ * specialization constants, so every combination is a pipeline of its
+ * own with them folded in. With uniform branching, one pipeline reads
+ * them from push constants and branches at runtime instead, like an
+ * uber-shader would. Everything a run needs is built along with the rest
+ * of the pipelines at startup, and phases only look them up.
+ */
+struct Shading
+{
+	uint32_t iterations;
+	bool wobble;
+	bool branching;
+};
+
+struct Overdraw
+{
+	uint32_t layers; // 0 when some other scene is up
+	bool prepass;
+	struct Shading shading;
+	VkPipeline shaded; // The color pass, after the pre-pass or not, for shading
+} overdraw = { 0 };
+
+// vkOverdrawPipelines were made from these, before specializing
+struct PipelineDesc vkOverdrawPipelineDescs[OVERDRAW_PIPELINES_COUNT] = { 0 };
+
+// Push constants for overdraw-vertex.glsl and overdraw-fragment.glsl, the last two are only read when branching
+struct OverdrawParams
+{
+	uint32_t layers;
+	float time;
+	uint32_t iterations;
+	uint32_t wobble;
+};
+
+// ITERATIONS, WOBBLE and BRANCHING in overdraw-fragment.glsl
+static struct PipelineDesc overdrawShadingDesc(const struct Shading *shading, bool prepass)
+{
+	struct PipelineDesc desc = vkOverdrawPipelineDescs[prepass ? OVERDRAW_AFTER_PREPASS : OVERDRAW_COLOR];
+	desc.specCount = 3;
+	// Branching ignores them, so pinning them makes it the one pipeline whatever they are
+	desc.specValues[0] = shading->branching ? 0 : shading->iterations;
+	desc.specValues[1] = shading->branching ? VK_FALSE : shading->wobble;
+	desc.specValues[2] = shading->branching;
+	return desc;
+}
+
+// What --bench-specialization sweeps, each branching first and then specialized, or just what the options say
+#define MAX_SHADINGS 12
+static uint32_t shadingsForRun(struct Shading *shadings)
+{
+	static const uint32_t benchIterations[] = { 8, 64, 512 };
+	if (!opts.benchSpecialization)
+	{
+		shadings[0] = (struct Shading){ opts.shadeIterations, opts.wobble, opts.uniformBranching };
+		return 1;
+	}
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < ARRAYSIZE(benchIterations); i++)
+	{
+		for (uint32_t w = 0; w < 2; w++)
+		{
+			shadings[count++] = (struct Shading){ benchIterations[i], w == 1, true };
+			shadings[count++] = (struct Shading){ benchIterations[i], w == 1, false };
+		}
+	}
+	return count;
+}
+
+/*
+ * A run is split into phases of --frames frames each, one for every
+ * combination of the settings being swept by the --bench-* options.
+ * Without any of those there's just the one phase.
+ */
+struct Phase
+{
+	enum DrawMode mode;
+	enum UniformScheme scheme;
+	uint32_t draws; // Objects really, which are instances unless mode is DRAW_PER_DRAW
+	uint32_t threads; // 0 records on the main thread without secondaries
+	enum SyncScheme sync;
+	bool async; // Culling on the async compute queue
+	bool prepass; // Depth pre-pass for the overdraw layers
+	uint32_t materials; // Per-draw only
+	bool bindless; // All the materials bound at once
+	struct Shading shading; // Overdraw only
+	// Results
+	double setupMs;
+	double frameP50;
+	double recordP50;
+	double submitP50;
+	double visibleP50; // Percent of instances that survived culling
+	double gpuP50; // The whole command buffer, 0 without timestamps
+	double waitP50; // CPU time blocked on a frame in flight
+	double descriptorsP50; // Allocating and writing the frame's descriptor sets, 0 unless the uniforms are transient
+	uint32_t binds; // Descriptor binds in the last frame, per-draw only
+	double shadeP50; // The overdraw layers' shading pass on the GPU, 0 without timestamps
+};
+
+// Past this many objects, a draw call each takes too long to be worth sweeping
+#define BENCH_MAX_PER_DRAW 10000
+
+static struct Phase *createPhases(uint32_t *phasesCount)
+{
+	static const uint32_t benchDraws[] = { 1, 16, 256, 1024, 4096 };
+	static const uint32_t benchInstances[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+	// Culling fewer than these is over before the other queue would notice
+	static const uint32_t benchAsyncInstances[] = { 10000, 100000, 1000000 };
+	static const uint32_t benchLayers[] = { 1, 2, 4, 8, 16 };
+	static const uint32_t benchMaterials[] = { 1, 16, 256, 1024, BINDLESS_MAX_MATERIALS };
+	enum DrawMode modes[DRAW_MODES_COUNT] = { opts.drawMode };
+	uint32_t modesCount = 1;
+	enum UniformScheme schemes[UNIFORM_SCHEMES_COUNT] = { opts.uniformScheme };
+	uint32_t schemesCount = 1;
+	const uint32_t *draws = &opts.draws;
+	uint32_t drawsCount = 1;
+	uint32_t threads[16] = { opts.threads };
+	uint32_t threadsCount = 1;
+	enum SyncScheme syncs[SYNC_SCHEMES_COUNT] = { opts.sync };
+	uint32_t syncsCount = 1;
+	bool asyncs[2] = { opts.asyncCompute };
+	uint32_t asyncsCount = 1;
+	bool prepasses[2] = { opts.depthPrepass };
+	uint32_t prepassesCount = 1;
+	const uint32_t *materialCounts = &opts.materials;
+	uint32_t materialCountsCount = 1;
+	bool bindlesses[2] = { opts.bindless };
+	uint32_t bindlessesCount = 1;
+	struct Shading shadings[MAX_SHADINGS];
+	uint32_t shadingsCount = shadingsForRun(shadings);
+	if (opts.benchUniforms)
+	{
+		for (schemesCount = 0; schemesCount < UNIFORM_SCHEMES_COUNT; schemesCount++)
+			schemes[schemesCount] = (enum UniformScheme)schemesCount;
+		draws = benchDraws;
+		drawsCount = ARRAYSIZE(benchDraws);
+	}
+	if (opts.benchThreads)
+	{
+		// Powers of two up to however many cores there are, starting with no workers at all
+		uint32_t cores = clampu32((uint32_t)SDL_GetCPUCount(), 1, MAX_WORKERS);
+		threadsCount = 1;
+		for (uint32_t t = 1; t < cores; t *= 2)
+			threads[threadsCount++] = t;
+		threads[threadsCount++] = cores;
+	}
+	if (opts.benchInstances)
+	{
+		// Overdraw layers aren't objects, so they get their own sweep
+		for (modesCount = 0; modesCount <= DRAW_CULLED; modesCount++)
+			modes[modesCount] = (enum DrawMode)modesCount;
+		draws = benchInstances;
+		drawsCount = ARRAYSIZE(benchInstances);
+	}
+	if (opts.benchSync)
+	{
+		for (syncsCount = 0; syncsCount < SYNC_SCHEMES_COUNT; syncsCount++)
+			syncs[syncsCount] = (enum SyncScheme)syncsCount;
+	}
+	if (opts.benchAsync)
+	{
+		if (!opts.benchInstances)
+		{
+			modes[0] = DRAW_CULLED;
+			modesCount = 1;
+			draws = benchAsyncInstances;
+			drawsCount = ARRAYSIZE(benchAsyncInstances);
+		}
+		asyncs[0] = false;
+		asyncs[1] = true;
+		asyncsCount = 2;
+	}
+	if (opts.benchOverdraw)
+	{
+		modes[0] = DRAW_OVERDRAW;
+		modesCount = 1;
+		draws = benchLayers;
+		drawsCount = ARRAYSIZE(benchLayers);
+		prepasses[0] = false;
+		prepasses[1] = true;
+		prepassesCount = 2;
+	}
+	if (opts.benchSpecialization && !opts.benchOverdraw)
+	{
+		modes[0] = DRAW_OVERDRAW;
+		modesCount = 1;
+	}
+	if (opts.benchBindless)
+	{
+		modes[0] = DRAW_PER_DRAW;
+		modesCount = 1;
+		materialCounts = benchMaterials;
+		materialCountsCount = ARRAYSIZE(benchMaterials);
+		bindlesses[0] = false;
+		bindlesses[1] = true;
+		bindlessesCount = 2;
+	}
+	if (!bindless.supported && (opts.benchBindless || opts.bindless))
+	{
+		eprintf("No descriptor indexing on this device, materials get bound one set at a time!\n");
+		bindlesses[0] = false;
+		bindlessesCount = 1;
+	}
+	if (asyncCompute.family == UINT32_MAX && (opts.benchAsync || opts.asyncCompute))
+	{
+		eprintf("No compute-only queue family, culling stays on the graphics queue!\n");
+		asyncs[0] = false;
+		asyncsCount = 1;
+	}
+	// Timelines were asked for but there aren't any, so say so once and carry on with fences
+	if (frameSync.timeline == VK_NULL_HANDLE && (opts.benchSync || opts.sync == SYNC_TIMELINE))
+	{
+		eprintf("No timeline semaphores on this device, fences it is!\n");
+		syncs[0] = SYNC_FENCES;
+		syncsCount = 1;
+	}
+
+	struct Phase *phases = calloc(drawsCount * modesCount * schemesCount * threadsCount * syncsCount * asyncsCount * prepassesCount
+		* shadingsCount * materialCountsCount * bindlessesCount, sizeof(*phases));
+	if (phases == NULL)
+	{
+		eprintf("Out of memory for phases!\n");
+		return NULL;
+	}
+	struct Phase *phase = phases;
+	for (uint32_t d = 0; d < drawsCount; d++)
+	{
+		for (uint32_t m = 0; m < modesCount; m++)
+		{
+			if (opts.benchInstances && modes[m] == DRAW_PER_DRAW && draws[d] > BENCH_MAX_PER_DRAW)
+				continue;
+			for (uint32_t s = 0; s < schemesCount; s++)
+			{
+				for (uint32_t t = 0; t < threadsCount; t++)
+				{
+					// Instancing is one draw, so it always uses the ring and the main thread
+					if (modes[m] != DRAW_PER_DRAW && (s > 0 || t > 0))
+						continue;
+					for (uint32_t y = 0; y < syncsCount; y++)
+					{
+						for (uint32_t a = 0; a < asyncsCount; a++)
+						{
+							// Only culling has any compute to move
+							if (modes[m] != DRAW_CULLED && a > 0)
+								continue;
+							// Every shading without the pre-pass, then with it
+							for (uint32_t z = 0; z < prepassesCount * shadingsCount; z++)
+							{
+								// Only the overdraw layers have any depth to lay down first, or shading to speak of
+								if (modes[m] != DRAW_OVERDRAW && z > 0)
+									continue;
+								// Every material count bound per material, then bindless
+								for (uint32_t k = 0; k < materialCountsCount * bindlessesCount; k++)
+								{
+									uint32_t materialsCount = modes[m] == DRAW_PER_DRAW ? materialCounts[k / bindlessesCount] : 0;
+									// Materials always go with the ring's uniforms, and there's nothing to bind without any
+									if ((materialsCount && s > 0) || (materialsCount == 0 && k > 0))
+										continue;
+									phase->mode = modes[m];
+									phase->scheme = modes[m] == DRAW_PER_DRAW && materialsCount == 0 ? schemes[s] : UNIFORMS_RING;
+									phase->draws = draws[d];
+									phase->threads = modes[m] == DRAW_PER_DRAW ? threads[t] : 0;
+									phase->sync = syncs[y];
+									phase->async = modes[m] == DRAW_CULLED && asyncs[a];
+									phase->prepass = modes[m] == DRAW_OVERDRAW && prepasses[z / shadingsCount];
+									phase->shading = shadings[z % shadingsCount];
+									phase->materials = materialsCount;
+									phase->bindless = materialsCount && bindlesses[k % bindlessesCount];
+									phase++;
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+	*phasesCount = (uint32_t)(phase - phases);
+	return phases;
+}
+
+static int startPhase(struct Phase *phase, uint32_t queueFamily, VkCommandPool graphicsPool)
+{
+	// Everything was drained, so switching is safe: fences are left signaled and the timeline caught up
+	frameSync.scheme = phase->sync;
+	asyncCompute.enabled = phase->async;
+	double start = nowMs();
+	int err;
+	if (phase->mode == DRAW_OVERDRAW)
+	{
+		// Nothing to upload, the layers come out of gl_VertexIndex and gl_InstanceIndex
+		overdraw.layers = phase->draws;
+		overdraw.prepass = phase->prepass;
+		overdraw.shading = phase->shading;
+		// Built at startup, so this never waits
+		struct PipelineDesc desc = overdrawShadingDesc(&phase->shading, phase->prepass);
+		if (!(overdraw.shaded = pipelineGet(&desc, true)))
+			eprintf("Failed to create the overdraw shading pipeline!\n");
+		err = !overdraw.shaded || createUniforms(UNIFORMS_RING, 1);
+	}
+	else
+	{
+		err = phase->mode == DRAW_PER_DRAW
+			? createUniforms(phase->scheme, phase->draws) || createWorkers(phase->threads, queueFamily)
+				|| createMaterials(phase->materials, phase->bindless, queueFamily, graphicsPool)
+			: createUniforms(UNIFORMS_RING, 1) || createInstances(phase->mode, phase->draws, queueFamily, graphicsPool);
+	}
+	phase->setupMs = nowMs() - start;
+	return err;
+}
+
+// Has to be drained first since the workers' command pools go right away.
+// Frames before frame might still be using the phase's resources.
+static void endPhase(uint32_t frame)
+{
+	destroyInstances(frame);
+	destroyMaterials(frame);
+	destroyWorkers();
+	destroyUniforms(frame);
+	memset(&overdraw, 0, sizeof(overdraw));
+}
+
+// The instanced and indirect draw modes
+/*
+ * There's no real camera, so this pans and zooms over the instance grid to
+ * give culling something to throw away. Clip space is world * scale + offset.
+ */
+static void cameraAt(float time, float *scale, float offset[2])
+{
+	*scale = 1.5f + sinf(0.3f * time);
+	offset[0] = 0.5f * sinf(0.2f * time);
+	offset[1] = 0.5f * cosf(0.2f * time);
+}
+
+// Push constants for cull-compute.glsl
+struct CullParams
+{
+	float planes[4][4];
+	float radius;
+	uint32_t count;
+};
+
+/*
+ * Zeroes the frame's draw count and has the compute pass refill it with the
+ * instances that touch the camera, before the render pass reads any of it.
+ * On the async compute queue, the graphics stages aren't there to barrier
+ * against, the semaphore the frame waits on covers those instead.
+ */
+static void recordCull(VkCommandBuffer commandBuffer, uint32_t inFlight, float time, bool async)
+{
+	float s, o[2];
+	cameraAt(time, &s, o);
+	// The edges of clip space pulled back into the world, with normals pointing inside
+	struct CullParams params =
+	{
+		.planes =
+		{
+			{ 1, 0, 0, (1 + o[0]) / s },
+			{ -1, 0, 0, (1 - o[0]) / s },
+			{ 0, 1, 0, (1 + o[1]) / s },
+			{ 0, -1, 0, (1 - o[1]) / s },
+		},
+		.radius = mesh.radius,
+		.count = instances.count,
+	};
+	VkBuffer cullBuffer = instances.cullBuffers[inFlight];
+	vkCmdFillBuffer(commandBuffer, cullBuffer, offsetof(VkDrawIndexedIndirectCommand, instanceCount), sizeof(uint32_t), 0);
+	VkBufferMemoryBarrier vkBarrier =
+	{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.buffer = cullBuffer,
+		.offset = 0,
+		.size = VK_WHOLE_SIZE,
+	};
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, 0, 1, &vkBarrier, 0, 0);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vkCullPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vkCullPipelineLayout, 0, 1, &instances.cullSets[inFlight], 0, 0);
+	vkCmdPushConstants(commandBuffer, vkCullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+	vkCmdDispatch(commandBuffer, (instances.count + 63) / 64, 1, 1);
+
+	// The draw reads both buffers, and the CPU reads the count back after the fence
+	VkPipelineStageFlags dstStage = VK_PIPELINE_STAGE_HOST_BIT;
+	VkBufferMemoryBarrier vkBarriers[] =
+	{
+		{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = cullBuffer,
+			.offset = 0,
+			.size = VK_WHOLE_SIZE,
+		},
+		{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = instances.visibleBuffers[inFlight],
+			.offset = 0,
+			.size = VK_WHOLE_SIZE,
+		},
+	};
+	if (async)
+		vkBarriers[0].dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	else
+		dstStage |= VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStage,
+		0, 0, 0, async ? 1 : ARRAYSIZE(vkBarriers), vkBarriers, 0, 0);
+}
+
+/*
+ * Culls on the async compute queue, the frame's graphics submit has to wait
+ * on asyncCompute.semaphores[inFlight] before it draws. GPU timestamps only
+ * cover the graphics queue, so this doesn't get a scope.
+ */
+static int submitAsyncCull(uint32_t inFlight, float time)
+{
+	VkCommandBuffer commandBuffer = asyncCompute.commandBuffers[inFlight];
+	vkResetCommandBuffer(commandBuffer, 0);
+	VkCommandBufferBeginInfo vkcbbInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+	if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffer, &vkcbbInfo))
+	{
+		eprintf("Beginning the culling command buffer failed!\n");
+		return 1;
 	}
-	if (err != 0 || i == lenmax) {
-		free(mem);
-		mem = NULL;
+	recordCull(commandBuffer, inFlight, time, true);
+	VkSubmitInfo vkSubmitInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &commandBuffer,
+		.signalSemaphoreCount = 1,
+		.pSignalSemaphores = &asyncCompute.semaphores[inFlight],
+	};
+	if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer)
+		|| VK_SUCCESS != vkQueueSubmit(asyncCompute.queue, 1, &vkSubmitInfo, VK_NULL_HANDLE))
+	{
+		eprintf("Failed to submit the culling!\n");
+		return 1;
 	}
-	*len_p = i;
-	return mem;
+	return 0;
 }
 
-// We love globals here
-VkPresentModeKHR vkPresentModeDesired = VK_PRESENT_MODE_FIFO_KHR;
-VkDevice vkDevice = 0;
-VkSwapchainKHR vkSwapchain = 0;
-VkImage *vkSwapchainImages = 0;
-uint32_t vkSwapchainImagesCount = 0;
-VkImageView *vkSwapchainImageViews = 0;
-VkFramebuffer *vkFramebuffers = 0;
-
-static int createSwapchain(VkSurfaceKHR vkSurface, VkSurfaceCapabilitiesKHR *vkSurfaceCaps, VkSurfaceFormatKHR *vkFormatDesired, VkExtent2D vkExtentDesired, VkRenderPass vkRenderPass)
+static void recordInstanced(VkCommandBuffer commandBuffer, uint32_t inFlight, float time)
 {
-	// Normally I'm not worried about freeing everything in a program
-	// but swapchain resources leaking is problematic because it needs
-	// to be reallocated everytime the window is resized
-	if (vkSwapchainImages)
+	VkViewport vkViewports[] =
 	{
-		free(vkSwapchainImages);
-		vkSwapchainImages = 0;
-	}
-	if (vkSwapchainImageViews)
+		{
+			.x = 0,
+			.y = 0,
+			.width = (float)vkExtentDesired.width,
+			.height = (float)vkExtentDesired.height,
+			.minDepth = 0,
+			.maxDepth = 1,
+		}
+	};
+	VkRect2D vkScissors[] =
 	{
-		for (uint32_t i = 0; i < vkSwapchainImagesCount; i++)
 		{
-			if (vkSwapchainImageViews[i])
-			{
-				vkDestroyImageView(vkDevice, vkSwapchainImageViews[i], 0);
-				vkSwapchainImageViews[i] = 0;
-			}
+			.offset = {0, 0},
+			.extent = vkExtentDesired,
 		}
-		free(vkSwapchainImageViews);
-		vkSwapchainImageViews = 0;
-	}
-	if (vkFramebuffers)
+	};
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkInstancedPipelines[instances.mode == DRAW_CULLED]);
+	VkDeviceSize vertexOffset = 0;
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &mesh.vertexBuffer, &vertexOffset);
+	vkCmdBindIndexBuffer(commandBuffer, mesh.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+	vkCmdSetViewport(commandBuffer, 0, ARRAYSIZE(vkViewports), vkViewports);
+	vkCmdSetScissor(commandBuffer, 0, ARRAYSIZE(vkScissors), vkScissors);
+	VkDescriptorSet descSet;
+	uint32_t dynamicOffset;
+	struct Unis *unis = uniformsForDraw(inFlight, 0, &descSet, &dynamicOffset);
+	unis->time = time;
+	cameraAt(time, &unis->scale, unis->offset);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkInstancedPipelineLayout, 0, 1, &instances.sets[inFlight], 1, &dynamicOffset);
+	if (instances.mode == DRAW_CULLED)
+		vkCmdDrawIndexedIndirect(commandBuffer, instances.cullBuffers[inFlight], 0, 1, sizeof(VkDrawIndexedIndirectCommand));
+	else if (instances.mode == DRAW_INDIRECT)
+		vkCmdDrawIndexedIndirect(commandBuffer, instances.indirectBuffer, 0, 1, sizeof(VkDrawIndexedIndirectCommand));
+	else
+		vkCmdDrawIndexed(commandBuffer, mesh.indicesCount, instances.count, 0, 0, 0);
+}
+
+// Three vertices a layer, one layer an instance, inside the render pass
+static void recordOverdraw(VkCommandBuffer commandBuffer, uint32_t inFlight, float time)
+{
+	VkViewport vkViewports[] =
 	{
-		for (uint32_t i = 0; i < vkSwapchainImagesCount; i++)
 		{
-			if (vkFramebuffers[i])
-			{
-				vkDestroyFramebuffer(vkDevice, vkFramebuffers[i], 0);
-				vkFramebuffers[i] = 0;
-			}
+			.x = 0,
+			.y = 0,
+			.width = (float)vkExtentDesired.width,
+			.height = (float)vkExtentDesired.height,
+			.minDepth = 0,
+			.maxDepth = 1,
 		}
-		free(vkFramebuffers);
-		vkFramebuffers = 0;
-	}
-	if (vkSwapchain)
+	};
+	VkRect2D vkScissors[] =
 	{
-		vkDestroySwapchainKHR(vkDevice, vkSwapchain, 0);
-		vkSwapchain = 0;
-	}
-	vkSwapchainImagesCount = 0;
-	// After this point, it's fine to not clean up after a failure in this function
-    
-	// I fucking hate Vulkan so much
-	if (vkSurfaceCaps->maxImageCount == 0)
-		vkSurfaceCaps->maxImageCount = vkSurfaceCaps->minImageCount;
-	uint32_t imageCount = minu32(vkSurfaceCaps->minImageCount + 1, vkSurfaceCaps->maxImageCount);
-	eprintf("Min,Count,Max Image Count=%u,%u,%u\n", vkSurfaceCaps->minImageCount, imageCount, vkSurfaceCaps->maxImageCount);
-	VkSwapchainCreateInfoKHR vkscInfo =
+		{
+			.offset = {0, 0},
+			.extent = vkExtentDesired,
+		}
+	};
+	struct OverdrawParams params =
 	{
-		.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
-		.surface = vkSurface,
-		.minImageCount = imageCount,
-		.imageFormat = vkFormatDesired->format,
-		.imageColorSpace = vkFormatDesired->colorSpace,
-		.imageExtent = vkExtentDesired,
-		.imageArrayLayers = 1,
-		.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-		/*
-		 * NOTE:
-		 * We differ from the Khronos tutorial right now by having
-		 * the graphics queue family equal to the presentation queue family.
-		 * If we couldn't find such a queue, we would set the fields
-		 * like this instead...
-		 * 
-		 * .imageSharingMode = VK_SHARING_MODE_CONCURRENT,
-		 * .queueFamilyIndexCount = 2,
-		 * .pQueueFamilyIndices = (uint32_t[2]){grFamily,prFamily},
-		 */
-		.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
-		.queueFamilyIndexCount = 0,
-		.pQueueFamilyIndices = 0,
-		.preTransform = vkSurfaceCaps->currentTransform,
-		.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-		.presentMode = vkPresentModeDesired,
-		.clipped = VK_TRUE,
-		.oldSwapchain = 0,
+		.layers = overdraw.layers,
+		.time = time,
+		.iterations = overdraw.shading.iterations,
+		.wobble = overdraw.shading.wobble,
 	};
-	if (VK_SUCCESS != vkCreateSwapchainKHR(vkDevice, &vkscInfo, 0, &vkSwapchain))
+	vkCmdSetViewport(commandBuffer, 0, ARRAYSIZE(vkViewports), vkViewports);
+	vkCmdSetScissor(commandBuffer, 0, ARRAYSIZE(vkScissors), vkScissors);
+	vkCmdPushConstants(commandBuffer, vkOverdrawPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+		0, sizeof(params), &params);
+	if (overdraw.prepass)
 	{
-		eprintf("Failed to create the swapchain!\n");
-		return 1;
+		uint32_t prepassScope = gpuScopeBegin(commandBuffer, inFlight, "prepass");
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkOverdrawPipelines[OVERDRAW_PREPASS]);
+		vkCmdDraw(commandBuffer, 3, overdraw.layers, 0, 0);
+		gpuScopeEnd(commandBuffer, inFlight, prepassScope);
 	}
+	uint32_t drawScope = gpuScopeBegin(commandBuffer, inFlight, "draws");
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, overdraw.shaded);
+	vkCmdDraw(commandBuffer, 3, overdraw.layers, 0, 0);
+	gpuScopeEnd(commandBuffer, inFlight, drawScope);
+}
 
-	if (VK_SUCCESS != vkGetSwapchainImagesKHR(vkDevice, vkSwapchain, &vkSwapchainImagesCount, vkSwapchainImages)
-		|| !(vkSwapchainImages = malloc(vkSwapchainImagesCount * sizeof(*vkSwapchainImages)))
-		|| !(vkSwapchainImageViews = calloc(sizeof(*vkSwapchainImageViews), vkSwapchainImagesCount))
-		|| VK_SUCCESS != vkGetSwapchainImagesKHR(vkDevice, vkSwapchain, &vkSwapchainImagesCount, vkSwapchainImages))
+/*
+ * --pipeline-variants: the per-draw scene asks for a different variant of
+ * its pipeline every VARIANT_FRAMES frames, like new materials showing up
+ * would, and draws with the plain one until the variant has compiled. Once
+ * it's been through all of them they're all hits.
+ */
+// Every write mask that lets some color through, with and without blending, then all again with BLUE_PULSE flipped
+#define VARIANTS_COUNT 28
+
+// Main thread, before recording, the recorders just read what it picked
+static void pickPipelineVariant(uint32_t frame)
+{
+	vkVariantPipeline = VK_NULL_HANDLE;
+	if (!opts.pipelineVariants || overdraw.layers || instances.mode != DRAW_PER_DRAW || materials.count)
+		return;
+	uint32_t variant = (frame / VARIANT_FRAMES) % VARIANTS_COUNT;
+	struct PipelineDesc desc = vkGraphicsPipelineDescs[uniforms.scheme];
+	desc.colorWriteMask = (variant % 7 + 1) | VK_COLOR_COMPONENT_A_BIT; // R, G and B are the low bits
+	desc.blend = variant / 7 % 2 ? VK_TRUE : VK_FALSE;
+	desc.specValues[2] = variant / 14 ? !opts.bluePulse : opts.bluePulse;
+	if (!(vkVariantPipeline = pipelineGet(&desc, false)))
+		pipelines.standIns++;
+}
+
+static int recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t inFlight, uint32_t frame, float time)
+{
+	vkResetCommandBuffer(commandBuffer, 0);
+
+	VkCommandBufferBeginInfo vkcbbInfo =
 	{
-		eprintf("Failed to get swapchain images!\n");
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = 0,
+		.pInheritanceInfo = 0,
+	};
+	if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffer, &vkcbbInfo))
+	{
+		eprintf("Beginning command buffer failed!\n");
 		return 1;
 	}
-	eprintf("Vk Swapchain images count: %d\n", vkSwapchainImagesCount);
-	if (vkSwapchainImagesCount == 0)
+	gpuTimersBeginFrame(commandBuffer, inFlight);
+	uint32_t frameScope = gpuScopeBegin(commandBuffer, inFlight, "frame");
+	descriptorBinds = 0;
+	// Texture uploads and mip blits can't go inside a render pass
+	if (materials.count)
 	{
-		eprintf("No swapchain images? Excuse me?");
-		return 1;
+		uint32_t streamScope = gpuScopeBegin(commandBuffer, inFlight, "stream");
+		int err = materialsBeginFrame(commandBuffer, inFlight, frame, time);
+		gpuScopeEnd(commandBuffer, inFlight, streamScope);
+		if (err)
+			return 1;
 	}
-	
-	for (uint32_t i = 0; i < vkSwapchainImagesCount; i++)
+	uint32_t passScope, drawScope;
+	if (overdraw.layers)
 	{
-		VkImageViewCreateInfo vkivcInfo =
+		passScope = gpuScopeBegin(commandBuffer, inFlight, "render pass");
+		beginRendering(commandBuffer, imageIndex, false);
+		recordOverdraw(commandBuffer, inFlight, time);
+	}
+	else if (instances.mode != DRAW_PER_DRAW)
+	{
+		// Compute can't go inside a render pass, so the culling comes first, unless it's on the other queue
+		if (instances.mode == DRAW_CULLED && !asyncCompute.enabled)
 		{
-			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-			.image = vkSwapchainImages[i],
-			.viewType = VK_IMAGE_VIEW_TYPE_2D,
-			.format = vkFormatDesired->format,
-			.components.r = VK_COMPONENT_SWIZZLE_IDENTITY,
-			.components.g = VK_COMPONENT_SWIZZLE_IDENTITY,
-			.components.b = VK_COMPONENT_SWIZZLE_IDENTITY,
-			.components.a = VK_COMPONENT_SWIZZLE_IDENTITY,
-			.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-			.subresourceRange.baseMipLevel = 0,
-			.subresourceRange.levelCount = 1,
-			.subresourceRange.baseArrayLayer = 0,
-			.subresourceRange.layerCount = 1,
-		};
+			uint32_t cullScope = gpuScopeBegin(commandBuffer, inFlight, "cull");
+			recordCull(commandBuffer, inFlight, time, false);
+			gpuScopeEnd(commandBuffer, inFlight, cullScope);
+		}
+		passScope = gpuScopeBegin(commandBuffer, inFlight, "render pass");
+		beginRendering(commandBuffer, imageIndex, false);
+		drawScope = gpuScopeBegin(commandBuffer, inFlight, "draws");
+		recordInstanced(commandBuffer, inFlight, time);
+		gpuScopeEnd(commandBuffer, inFlight, drawScope);
+	}
+	else if (workerPool.count == 0)
+	{
+		passScope = gpuScopeBegin(commandBuffer, inFlight, "render pass");
+		beginRendering(commandBuffer, imageIndex, false);
+		drawScope = gpuScopeBegin(commandBuffer, inFlight, "draws");
+		descriptorBinds = recordDraws(commandBuffer, inFlight, 0, uniforms.draws, time);
+		gpuScopeEnd(commandBuffer, inFlight, drawScope);
+	}
+	else
+	{
+		workerPool.inFlight = inFlight;
+		workerPool.imageIndex = imageIndex;
+		workerPool.time = time;
+		for (uint32_t i = 0; i < workerPool.count; i++)
+		{
+			struct Worker *worker = &workerPool.workers[i];
+			worker->first = (uint32_t)((uint64_t)uniforms.draws * i / workerPool.count);
+			worker->count = (uint32_t)((uint64_t)uniforms.draws * (i + 1) / workerPool.count) - worker->first;
+			char name[24];
+			snprintf(name, sizeof(name), "batch %u", i);
+			worker->scope = worker->count ? gpuScopeReserve(inFlight, name) : UINT32_MAX;
+			SDL_SemPost(worker->start);
+		}
+		// Recording the primary can't go any further without the secondaries anyways
+		for (uint32_t i = 0; i < workerPool.count; i++)
+			SDL_SemWait(workerPool.done);
 
-		if (VK_SUCCESS != vkCreateImageView(vkDevice, &vkivcInfo, 0, &vkSwapchainImageViews[i]))
+		VkCommandBuffer secondaries[MAX_WORKERS];
+		uint32_t secondariesCount = 0;
+		for (uint32_t i = 0; i < workerPool.count; i++)
 		{
-			eprintf("Failed to create image views!\n");
-			return 1;
+			if (workerPool.workers[i].err)
+				return 1;
+			descriptorBinds += workerPool.workers[i].binds;
+			// Workers with nothing to draw still recorded a valid empty buffer, but why bother
+			if (workerPool.workers[i].count)
+				secondaries[secondariesCount++] = workerPool.workers[i].commandBuffers[inFlight];
 		}
+		// Only secondaries can go in this render pass, so they time their own batches
+		passScope = gpuScopeBegin(commandBuffer, inFlight, "render pass");
+		beginRendering(commandBuffer, imageIndex, true);
+		if (secondariesCount)
+			vkCmdExecuteCommands(commandBuffer, secondariesCount, secondaries);
 	}
-
-	vkFramebuffers = calloc(vkSwapchainImagesCount, sizeof(*vkFramebuffers));
-	if (vkFramebuffers == NULL)
+	endRendering(commandBuffer, imageIndex);
+	gpuScopeEnd(commandBuffer, inFlight, passScope);
+	gpuScopeEnd(commandBuffer, inFlight, frameScope);
+	if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer))
 	{
-		eprintf("Failed to allocate array of Framebuffers!\n");
+		eprintf("Failed to record the command buffer!\n");
 		return 1;
 	}
-	for (size_t i = 0; i < vkSwapchainImagesCount; i++)
+	return 0;
+}
+
+/*
+ * With --hot-reload, a thread polls vertex.glsl and fragment.glsl, compiles
+ * whichever one changed with shaderc, and asks the pipeline table for a
+ * whole new set of the pipelines that use them, which get built off to the
+ * side. The main loop swaps those in between frames and evicts everything
+ * made from the old module, so it never waits on a compile. A shader that
+ * doesn't compile keeps the old pipelines going until the next save.
+ */
+#define SHADER_POLL_MS 250
+// The per-draw pipelines, then the instanced ones and the material one, same as main's vkPipelineDescs
+#define RELOAD_PIPELINES_COUNT (UNIFORM_SCHEMES_COUNT + 3)
+
+struct ShaderSource
+{
+	const char *path;
+	shaderc_shader_kind kind;
+	char *text; // What it was last compiled from, NULL if it wasn't there
+	size_t len;
+	VkShaderModule startup; // What main made, left for main like the rest of its modules
+	VkShaderModule module; // What the pipelines being drawn with were built from
+};
+
+struct ShaderReload
+{
+	SDL_Thread *thread;
+	SDL_atomic_t quit;
+	SDL_atomic_t ready; // Set once pipelines are waiting, cleared when they're swapped in
+	struct ShaderSource sources[2];
+	struct PipelineDesc descs[RELOAD_PIPELINES_COUNT]; // What's being drawn with, only swapping changes them
+	// For whatever is waiting to be swapped in
+	struct PipelineDesc next[RELOAD_PIPELINES_COUNT];
+	VkPipeline pipelines[RELOAD_PIPELINES_COUNT];
+	bool built; // Otherwise there's only retired to deal with
+	VkShaderModule retired; // Whichever of the old and new modules isn't being drawn with
+	const char *changed;
+	double seenAt;
+	double compileMs;
+	double buildMs;
+	uint32_t reloads;
+	uint32_t failures; // Only the thread touches this until it's joined
+} shaderReload = { 0 };
+
+static int shaderReloadCompile(shaderc_compiler_t compiler, const struct ShaderSource *source, VkShaderModule *module)
+{
+	shaderc_compilation_result_t result = shaderc_compile_into_spv(compiler, source->text, source->len, source->kind,
+		source->path, "main", NULL);
+	int err = 0;
+	if (shaderc_result_get_compilation_status(result) != shaderc_compilation_status_success)
 	{
-		VkImageView vkImageViewAttachments[] = { vkSwapchainImageViews[i] };
-		VkFramebufferCreateInfo vkfcInfo =
+		eprintf("%s didn't compile, sticking with the old one:\n%s", source->path, shaderc_result_get_error_message(result));
+		err = 1;
+	}
+	else
+	{
+		VkShaderModuleCreateInfo vksmcInfo =
 		{
-			.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-			.renderPass = vkRenderPass,
-			.attachmentCount = ARRAYSIZE(vkImageViewAttachments),
-			.pAttachments = vkImageViewAttachments,
-			.width = vkExtentDesired.width,
-			.height = vkExtentDesired.height,
-			.layers = 1,
+			.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+			.codeSize = shaderc_result_get_length(result),
+			.pCode = (const uint32_t *)shaderc_result_get_bytes(result),
 		};
-		if (VK_SUCCESS != vkCreateFramebuffer(vkDevice, &vkfcInfo, 0, &vkFramebuffers[i]))
+		err = VK_SUCCESS != vkCreateShaderModule(vkDevice, &vksmcInfo, 0, module);
+	}
+	shaderc_result_release(result);
+	return err;
+}
+
+// The current descriptions with old swapped for module, all queued up front so the compile threads split them
+static bool shaderReloadBuild(VkShaderModule old, VkShaderModule module)
+{
+	for (uint32_t i = 0; i < RELOAD_PIPELINES_COUNT; i++)
+	{
+		struct PipelineDesc *desc = &shaderReload.next[i];
+		*desc = shaderReload.descs[i];
+		if (desc->vertex == old)
+			desc->vertex = module;
+		if (desc->fragment == old)
+			desc->fragment = module;
+		pipelineGet(desc, false);
+	}
+	bool built = true;
+	for (uint32_t i = 0; i < RELOAD_PIPELINES_COUNT; i++)
+		built = VK_NULL_HANDLE != (shaderReload.pipelines[i] = pipelineGet(&shaderReload.next[i], true)) && built;
+	return built;
+}
+
+static int shaderReloadMain(void *data)
+{
+	(void)data;
+	shaderc_compiler_t compiler = shaderc_compiler_initialize();
+	while (!SDL_AtomicGet(&shaderReload.quit))
+	{
+		SDL_Delay(SHADER_POLL_MS);
+		// The last batch hasn't been picked up yet
+		if (SDL_AtomicGet(&shaderReload.ready))
+			continue;
+		for (uint32_t i = 0; i < ARRAYSIZE(shaderReload.sources); i++)
 		{
-			eprintf("Failed to allocate framebuffer!\n");
-			return 1;
+			struct ShaderSource *source = &shaderReload.sources[i];
+			size_t len;
+			char *text = copyFile(source->path, &len);
+			if (text == NULL || (source->text && len == source->len && !memcmp(text, source->text, len)))
+			{
+				free(text);
+				continue;
+			}
+			free(source->text);
+			source->text = text;
+			source->len = len;
+
+			double start = nowMs();
+			VkShaderModule module;
+			if (0 != shaderReloadCompile(compiler, source, &module))
+			{
+				shaderReload.failures++;
+				continue;
+			}
+			double compiled = nowMs();
+			VkShaderModule old = source->module;
+			source->module = module;
+			if (!(shaderReload.built = shaderReloadBuild(old, module)))
+			{
+				eprintf("Failed to rebuild the pipelines for %s!\n", source->path);
+				source->module = old;
+				shaderReload.failures++;
+			}
+			// Whatever got built from it is still in the table, and the main loop is the one that can evict it
+			shaderReload.retired = shaderReload.built ? old : module;
+			shaderReload.changed = source->path;
+			shaderReload.seenAt = start;
+			shaderReload.compileMs = compiled - start;
+			shaderReload.buildMs = nowMs() - compiled;
+			SDL_AtomicSet(&shaderReload.ready, 1);
+			// The other one can wait for the next poll, this has to be picked up first
+			break;
 		}
-		eprintf("Created framebuffer %zu from view %p: %p\n", i,  vkImageViewAttachments[0], vkFramebuffers[i]);
 	}
-	eprintf("Created Framebuffers!\n");
-
+	shaderc_compiler_release(compiler);
 	return 0;
 }
 
-static int recreateSwapchain(VkSurfaceKHR vkSurface, VkSurfaceCapabilitiesKHR *vkSurfaceCaps, VkSurfaceFormatKHR *vkFormatDesired, VkExtent2D vkExtentDesired, VkRenderPass vkRenderPass)
+static int startShaderReload(const struct PipelineDesc *descs, VkShaderModule vertex, VkShaderModule fragment)
 {
-	vkDeviceWaitIdle(vkDevice);
-	return createSwapchain(vkSurface, vkSurfaceCaps, vkFormatDesired, vkExtentDesired, vkRenderPass);
+	struct ShaderSource sources[] =
+	{
+		{ .path = "vertex.glsl", .kind = shaderc_vertex_shader, .startup = vertex, .module = vertex },
+		{ .path = "fragment.glsl", .kind = shaderc_fragment_shader, .startup = fragment, .module = fragment },
+	};
+	memcpy(shaderReload.sources, sources, sizeof(sources));
+	// Whatever is there now is what the .spv files were built from, hopefully
+	for (uint32_t i = 0; i < ARRAYSIZE(shaderReload.sources); i++)
+		shaderReload.sources[i].text = copyFile(shaderReload.sources[i].path, &shaderReload.sources[i].len);
+	memcpy(shaderReload.descs, descs, sizeof(shaderReload.descs));
+	if (!(shaderReload.thread = SDL_CreateThread(shaderReloadMain, "shader reload", NULL)))
+	{
+		eprintf("Couldn't start the shader reload thread: %s\n", SDL_GetError());
+		return 1;
+	}
+	eprintf("Watching vertex.glsl and fragment.glsl for changes\n");
+	return 0;
 }
 
-static VKAPI_ATTR VkBool32 VKAPI_CALL vkDbgCb(
-	VkDebugUtilsMessageSeverityFlagBitsEXT severity,
-	VkDebugUtilsMessageTypeFlagsEXT flags,
-	const VkDebugUtilsMessengerCallbackDataEXT *data,
-	void *userdata)
+// Between frames, so nothing is recording with what gets evicted
+static void shaderReloadSwap(uint32_t frame)
 {
-	(void)userdata;
-	eprintf("Super-Epic Validation Layer: %08x,%08x,%s\n", severity, flags, data->pMessage);
-	return VK_FALSE;
+	if (shaderReload.built)
+	{
+		memcpy(shaderReload.descs, shaderReload.next, sizeof(shaderReload.descs));
+		memcpy(vkGraphicsPipelineDescs, shaderReload.descs, sizeof(vkGraphicsPipelineDescs));
+		memcpy(vkGraphicsPipelines, shaderReload.pipelines, sizeof(vkGraphicsPipelines));
+		memcpy(vkInstancedPipelines, &shaderReload.pipelines[UNIFORM_SCHEMES_COUNT], sizeof(vkInstancedPipelines));
+		vkMaterialPipeline = shaderReload.pipelines[UNIFORM_SCHEMES_COUNT + 2];
+		shaderReload.reloads++;
+		printf("hot reload %u: %s compiled in %.3f ms, %u pipelines built in %.3f ms, drawing %.3f ms after the change was seen\n",
+			shaderReload.reloads, shaderReload.changed, shaderReload.compileMs, RELOAD_PIPELINES_COUNT, shaderReload.buildMs,
+			nowMs() - shaderReload.seenAt);
+	}
+	// Takes every pipeline made from it along, variants too, and those don't need it once they're built
+	pipelineEvict(shaderReload.retired, frame);
+	vkDestroyShaderModule(vkDevice, shaderReload.retired, 0);
+	SDL_AtomicSet(&shaderReload.ready, 0);
 }
-static VkDebugUtilsMessengerCreateInfoEXT vkdumcInfo =
-{
-	.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
-	.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT
-	| VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT
-	| VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT
-	| VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
-	.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT
-	| VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT
-	| VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
-	.pfnUserCallback = vkDbgCb,
-	.pUserData = 0,
-};
 
+static void stopShaderReload(uint32_t frame)
+{
+	if (shaderReload.thread == NULL)
+		return;
+	SDL_AtomicSet(&shaderReload.quit, 1);
+	SDL_WaitThread(shaderReload.thread, NULL);
+	// Built, but the loop was done before it could swap them in
+	if (SDL_AtomicGet(&shaderReload.ready))
+		shaderReloadSwap(frame);
+	for (uint32_t i = 0; i < ARRAYSIZE(shaderReload.sources); i++)
+	{
+		free(shaderReload.sources[i].text);
+		if (shaderReload.sources[i].module != shaderReload.sources[i].startup)
+		{
+			pipelineEvict(shaderReload.sources[i].module, frame);
+			vkDestroyShaderModule(vkDevice, shaderReload.sources[i].module, 0);
+		}
+	}
+	printf("hot reload: %u reloads, %u failed\n", shaderReload.reloads, shaderReload.failures);
+	memset(&shaderReload, 0, sizeof(shaderReload));
+}
 
 int main(int argc, char **argv)
 {
-	(void)argc;
-	(void)argv;
+	if (parseArgs(argc, argv))
+		return 1;
 
 	// Debug variables
 	const char *vkicLayers[] = {
@@ -276,33 +5895,46 @@ int main(int argc, char **argv)
 	VkDebugUtilsMessengerCreateInfoEXT *pVkDumcInfo = &vkdumcInfo;
 
 	SDL_SetMainReady();
-	if (SDL_Init(SDL_INIT_VIDEO) < 0)
+	// Headless boxes have no display, so only the timer gets initialized there
+	if (SDL_Init(opts.headless ? SDL_INIT_TIMER : SDL_INIT_VIDEO) < 0)
 	{
 		eprintf("SDL not initialized! %s\n", SDL_GetError());
 		return 1;
 	}
 
-	SDL_Window *window = SDL_CreateWindow(
-		"Khronos Tutorial",
-		SDL_WINDOWPOS_UNDEFINED,
-		SDL_WINDOWPOS_UNDEFINED,
-		WIDTH,
-		HEIGHT,
-		SDL_WINDOW_SHOWN | SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
-	if (window == NULL)
-	{
-		eprintf("Window could not be created! %s", SDL_GetError());
-		return 1;
-	}
-
+	SDL_Window *window = NULL;
 	const char **vkExtensions = 0;
 	uint32_t vkExtensionsCount = 0;
-	if (!SDL_Vulkan_GetInstanceExtensions(window, &vkExtensionsCount, vkExtensions)
-		|| !(vkExtensions = malloc((vkExtensionsCount + ARRAYSIZE(vkExtensionsExtra)) * sizeof(*vkExtensions)))
-		|| !SDL_Vulkan_GetInstanceExtensions(window, &vkExtensionsCount, vkExtensions))
+	if (opts.headless)
 	{
-		eprintf("Failed to get Vulkan extensions!\n");
-		return 1;
+		if (!(vkExtensions = malloc(ARRAYSIZE(vkExtensionsExtra) * sizeof(*vkExtensions))))
+		{
+			eprintf("Failed to allocate Vulkan extensions!\n");
+			return 1;
+		}
+	}
+	else
+	{
+		window = SDL_CreateWindow(
+			"Khronos Tutorial",
+			SDL_WINDOWPOS_UNDEFINED,
+			SDL_WINDOWPOS_UNDEFINED,
+			(int)opts.width,
+			(int)opts.height,
+			SDL_WINDOW_SHOWN | SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
+		if (window == NULL)
+		{
+			eprintf("Window could not be created! %s", SDL_GetError());
+			return 1;
+		}
+
+		if (!SDL_Vulkan_GetInstanceExtensions(window, &vkExtensionsCount, vkExtensions)
+			|| !(vkExtensions = malloc((vkExtensionsCount + ARRAYSIZE(vkExtensionsExtra)) * sizeof(*vkExtensions)))
+			|| !SDL_Vulkan_GetInstanceExtensions(window, &vkExtensionsCount, vkExtensions))
+		{
+			eprintf("Failed to get Vulkan extensions!\n");
+			return 1;
+		}
 	}
 	for (uint32_t i = 0; i < ARRAYSIZE(vkExtensionsExtra); i++)
 	{
@@ -313,6 +5945,13 @@ int main(int argc, char **argv)
 	{
 		eprintf("\t%s\n", vkExtensions[i]);
 	}
+	// Timeline semaphores are core in 1.2 and dynamic rendering in 1.3, so ask for those when the loader has them.
+	// 1.0 loaders don't even have the entry point.
+	PFN_vkEnumerateInstanceVersion vkeivProcAddr = (PFN_vkEnumerateInstanceVersion)
+		vkGetInstanceProcAddr(NULL, "vkEnumerateInstanceVersion");
+	uint32_t vkLoaderVersion = VK_API_VERSION_1_0;
+	if (vkeivProcAddr && VK_SUCCESS == vkeivProcAddr(&vkLoaderVersion) && vkLoaderVersion >= VK_API_VERSION_1_2)
+		vkApiVersion = vkLoaderVersion >= VK_API_VERSION_1_3 ? VK_API_VERSION_1_3 : VK_API_VERSION_1_2;
 	VkApplicationInfo vkaInfo =
 	{
 		.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
@@ -321,14 +5960,30 @@ int main(int argc, char **argv)
 		.applicationVersion = 1337,
 		.pEngineName = APP_SHORT_NAME,
 		.engineVersion = 1337,
-		.apiVersion = VK_API_VERSION_1_0,
+		.apiVersion = vkApiVersion,
 	};
+	// CI boxes don't always have the SDK installed, so the layer is optional
+	uint32_t vkicLayersCount = 0;
+	VkLayerProperties *vkLayerProps = 0;
+	uint32_t vkLayerPropsCount = 0;
+	if (VK_SUCCESS == vkEnumerateInstanceLayerProperties(&vkLayerPropsCount, vkLayerProps)
+		&& (vkLayerProps = malloc(vkLayerPropsCount * sizeof(*vkLayerProps)))
+		&& VK_SUCCESS == vkEnumerateInstanceLayerProperties(&vkLayerPropsCount, vkLayerProps))
+	{
+		for (uint32_t i = 0; i < vkLayerPropsCount; i++)
+		{
+			if (!strcmp(vkLayerProps[i].layerName, vkicLayers[0]))
+				vkicLayersCount = ARRAYSIZE(vkicLayers);
+		}
+	}
+	if (vkicLayersCount == 0)
+		eprintf("%s isn't available. Flying blind!\n", vkicLayers[0]);
 	VkInstanceCreateInfo vkicInfo =
 	{
 		.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
 		.pNext = pVkDumcInfo,
 		.pApplicationInfo = &vkaInfo,
-		.enabledLayerCount = ARRAYSIZE(vkicLayers),
+		.enabledLayerCount = vkicLayersCount,
 		.ppEnabledLayerNames = vkicLayers,
 		.enabledExtensionCount = vkExtensionsCount,
 		.ppEnabledExtensionNames = vkExtensions,
@@ -363,7 +6018,9 @@ int main(int argc, char **argv)
 		eprintf("No physical devices. Cringe...\n");
 		return 1;
 	}
-	VkPhysicalDevice vkPhysDevice = vkPhysicalDevices[0];
+	vkPhysDevice = vkPhysicalDevices[0];
+	vkGetPhysicalDeviceProperties(vkPhysDevice, &vkPhysProps);
+	eprintf("Using physical device %s (vendor %04x device %04x)\n", vkPhysProps.deviceName, vkPhysProps.vendorID, vkPhysProps.deviceID);
 
 	VkExtensionProperties *vkDeviceExtensions = 0;
 	uint32_t vkDeviceExtensionsCount = 0;
@@ -379,6 +6036,9 @@ int main(int argc, char **argv)
 	for (uint32_t i = 0; i < vkDeviceExtensionsCount; i++)
 	{
 		eprintf("\t%s\n", vkDeviceExtensions[i].extensionName);
+		// Reading it back goes through vkGetPhysicalDeviceMemoryProperties2, which is core in the 1.2 instance
+		if (!strcmp(vkDeviceExtensions[i].extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) && vkApiVersion >= VK_API_VERSION_1_2)
+			vkMemoryBudget = true;
 	}
 
 	VkQueueFamilyProperties *vkQueueProps = 0;
@@ -394,8 +6054,9 @@ int main(int argc, char **argv)
 	VkPhysicalDeviceFeatures vkPhysFeatures;
 	vkGetPhysicalDeviceFeatures(vkPhysDevice, &vkPhysFeatures);
 	uint32_t vkQueueNodeIndex = UINT32_MAX;
+	// Culling runs compute on the graphics queue, and the spec promises a family that can do both
 	for (uint32_t i = 0; i < vkQueueCount; i++) {
-		if (vkQueueProps[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+		if ((vkQueueProps[i].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))
 			vkQueueNodeIndex = i;
 	}
 	if (vkQueueNodeIndex == UINT32_MAX) {
@@ -403,12 +6064,31 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
-	const float vkQueuePriorities[1] = { 0.0f };
-	const char *vkdcEnabledExtensions[] =
+	// Transfer-only families are usually DMA engines, so uploads don't hold up rendering
+	uint32_t vkTransferQueueNodeIndex = vkQueueNodeIndex;
+	for (uint32_t i = 0; opts.transferQueue && i < vkQueueCount; i++)
 	{
-		"VK_KHR_swapchain",
-	};
-	const VkDeviceQueueCreateInfo vkdqcInfo[1] =
+		if ((vkQueueProps[i].queueFlags & VK_QUEUE_TRANSFER_BIT)
+			&& !(vkQueueProps[i].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+			vkTransferQueueNodeIndex = i;
+	}
+
+	// Compute-only families are where async compute goes
+	uint32_t vkComputeQueueNodeIndex = UINT32_MAX;
+	for (uint32_t i = 0; (opts.asyncCompute || opts.benchAsync) && i < vkQueueCount; i++)
+	{
+		if ((vkQueueProps[i].queueFlags & VK_QUEUE_COMPUTE_BIT) && !(vkQueueProps[i].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+			vkComputeQueueNodeIndex = i;
+	}
+
+	const float vkQueuePriorities[1] = { 0.0f };
+	const char *vkdcEnabledExtensions[2];
+	uint32_t vkdcEnabledExtensionsCount = 0;
+	if (!opts.headless)
+		vkdcEnabledExtensions[vkdcEnabledExtensionsCount++] = "VK_KHR_swapchain";
+	if (vkMemoryBudget)
+		vkdcEnabledExtensions[vkdcEnabledExtensionsCount++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+	VkDeviceQueueCreateInfo vkdqcInfo[] =
 	{
 		{
 			.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
@@ -416,202 +6096,634 @@ int main(int argc, char **argv)
 			.queueFamilyIndex = vkQueueNodeIndex,
 			.queueCount = ARRAYSIZE(vkQueuePriorities),
 			.pQueuePriorities = vkQueuePriorities,
+		},
+		{
+			.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+			.pNext = 0,
+			.queueFamilyIndex = vkTransferQueueNodeIndex,
+			.queueCount = ARRAYSIZE(vkQueuePriorities),
+			.pQueuePriorities = vkQueuePriorities,
+		},
+		{
+			.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+			.pNext = 0,
+			.queueFamilyIndex = vkComputeQueueNodeIndex,
+			.queueCount = ARRAYSIZE(vkQueuePriorities),
+			.pQueuePriorities = vkQueuePriorities,
+		},
+	};
+	// Drop the families we don't have, graphics always stays first
+	uint32_t vkdqcInfoCount = 1;
+	if (vkTransferQueueNodeIndex != vkQueueNodeIndex)
+		vkdqcInfoCount++;
+	if (vkComputeQueueNodeIndex != UINT32_MAX)
+		vkdqcInfo[vkdqcInfoCount++] = vkdqcInfo[2];
+	VkPhysicalDeviceTimelineSemaphoreFeatures vkTimelineFeatures =
+	{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+	};
+	VkPhysicalDeviceDynamicRenderingFeatures vkDynamicRenderingFeatures =
+	{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES,
+	};
+	VkPhysicalDeviceSynchronization2Features vkSync2Features =
+	{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES,
+	};
+	VkPhysicalDeviceDescriptorIndexingFeatures vkIndexingFeatures =
+	{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES,
+		.pNext = &vkTimelineFeatures,
+	};
+	VkPhysicalDeviceDescriptorIndexingProperties vkIndexingProps =
+	{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES,
+	};
+	if (vkApiVersion >= VK_API_VERSION_1_2 && vkPhysProps.apiVersion >= VK_API_VERSION_1_2)
+	{
+		// The 1.3 structs aren't allowed in the chain before 1.3
+		if (vkApiVersion >= VK_API_VERSION_1_3 && vkPhysProps.apiVersion >= VK_API_VERSION_1_3)
+		{
+			vkTimelineFeatures.pNext = &vkDynamicRenderingFeatures;
+			vkDynamicRenderingFeatures.pNext = &vkSync2Features;
 		}
+		VkPhysicalDeviceFeatures2 vkFeatures2 =
+		{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+			.pNext = &vkIndexingFeatures,
+		};
+		vkGetPhysicalDeviceFeatures2(vkPhysDevice, &vkFeatures2);
+		VkPhysicalDeviceProperties2 vkPhysProps2 =
+		{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+			.pNext = &vkIndexingProps,
+		};
+		vkGetPhysicalDeviceProperties2(vkPhysDevice, &vkPhysProps2);
+	}
+	// Only enable what's there and wanted, dynamic rendering needs both of its halves
+	bool dynamicRenderingSupported = vkDynamicRenderingFeatures.dynamicRendering && vkSync2Features.synchronization2;
+	void *vkdcNext = 0;
+	vkSync2Features.pNext = 0;
+	if (dynamicRenderingSupported && opts.rendering == RENDERING_DYNAMIC)
+	{
+		vkDynamicRenderingFeatures.pNext = &vkSync2Features;
+		vkdcNext = &vkDynamicRenderingFeatures;
+	}
+	if (vkTimelineFeatures.timelineSemaphore)
+	{
+		vkTimelineFeatures.pNext = vkdcNext;
+		vkdcNext = &vkTimelineFeatures;
+	}
+	// Only the bits bindless uses, and only if the arrays fit in what the device can do
+	VkPhysicalDeviceDescriptorIndexingFeatures vkIndexingEnabled =
+	{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES,
+		.pNext = vkdcNext,
+		.runtimeDescriptorArray = VK_TRUE,
+		.descriptorBindingPartiallyBound = VK_TRUE,
+		.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE,
+		.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE,
 	};
+	// The indices are all dynamically uniform, so the plain dynamic indexing from 1.0 is enough for those
+	bindless.supported = vkPhysFeatures.shaderStorageBufferArrayDynamicIndexing
+		&& vkPhysFeatures.shaderSampledImageArrayDynamicIndexing
+		&& vkIndexingFeatures.runtimeDescriptorArray
+		&& vkIndexingFeatures.descriptorBindingPartiallyBound
+		&& vkIndexingFeatures.descriptorBindingStorageBufferUpdateAfterBind
+		&& vkIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind
+		&& vkIndexingProps.maxPerStageDescriptorUpdateAfterBindStorageBuffers >= BINDLESS_MAX_BUFFERS
+		&& vkIndexingProps.maxDescriptorSetUpdateAfterBindStorageBuffers >= BINDLESS_MAX_BUFFERS
+		&& vkIndexingProps.maxPerStageDescriptorUpdateAfterBindSampledImages >= BINDLESS_MAX_TEXTURES
+		&& vkIndexingProps.maxDescriptorSetUpdateAfterBindSampledImages >= BINDLESS_MAX_TEXTURES
+		&& vkIndexingProps.maxPerStageUpdateAfterBindResources >= BINDLESS_MAX_BUFFERS + BINDLESS_MAX_TEXTURES;
+	VkPhysicalDeviceFeatures vkEnabledFeatures = { 0 };
+	if (bindless.supported)
+	{
+		vkdcNext = &vkIndexingEnabled;
+		vkEnabledFeatures.shaderStorageBufferArrayDynamicIndexing = VK_TRUE;
+		vkEnabledFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+	}
 	VkDeviceCreateInfo vkdcInfo =
 	{
 		.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-		.pNext = 0,
-		.queueCreateInfoCount = ARRAYSIZE(vkdqcInfo),
+		.pNext = vkdcNext,
+		.queueCreateInfoCount = vkdqcInfoCount,
 		.pQueueCreateInfos = vkdqcInfo,
 		.enabledLayerCount = 0,
 		.ppEnabledLayerNames = 0,
-		.enabledExtensionCount = ARRAYSIZE(vkdcEnabledExtensions),
+		.enabledExtensionCount = vkdcEnabledExtensionsCount,
 		.ppEnabledExtensionNames = vkdcEnabledExtensions,
-		.pEnabledFeatures = 0,
+		.pEnabledFeatures = &vkEnabledFeatures,
 	};
 	if (VK_SUCCESS != vkCreateDevice(vkPhysDevice, &vkdcInfo, 0, &vkDevice))
 	{
 		eprintf("Failed to create logical device!\n");
 		return 1;
 	}
+	gpuAllocatorInit();
+	if (0 != createFrameSync(vkTimelineFeatures.timelineSemaphore == VK_TRUE)
+		|| 0 != createAsyncCompute(vkComputeQueueNodeIndex, vkQueueNodeIndex, vkTransferQueueNodeIndex))
+		return 1;
 
-	VkSurfaceKHR vkSurface;
-	if (!SDL_Vulkan_CreateSurface(window, vkInstance, &vkSurface))
+	VkSurfaceKHR vkSurface = 0;
+	VkSurfaceCapabilitiesKHR vkSurfaceCaps = { 0 };
+	VkSurfaceFormatKHR vkFormatOffscreen = { VK_FORMAT_B8G8R8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR };
+	VkSurfaceFormatKHR *vkFormatDesired = &vkFormatOffscreen;
+	if (opts.headless)
 	{
-		eprintf("Failed to create Vulkan surface!\n");
-		return 1;
+		vkSurfaceCaps.currentExtent.width = opts.width;
+		vkSurfaceCaps.currentExtent.height = opts.height;
 	}
-	uint32_t vkSurfaceSupported;
-	if (VK_SUCCESS != vkGetPhysicalDeviceSurfaceSupportKHR(vkPhysDevice, vkQueueNodeIndex, vkSurface, &vkSurfaceSupported)
-		|| !vkSurfaceSupported)
+	else
 	{
-		eprintf("Failed to confirm that physical device supports surface!\n");
-		return 1;
+		if (!SDL_Vulkan_CreateSurface(window, vkInstance, &vkSurface))
+		{
+			eprintf("Failed to create Vulkan surface!\n");
+			return 1;
+		}
+		uint32_t vkSurfaceSupported;
+		if (VK_SUCCESS != vkGetPhysicalDeviceSurfaceSupportKHR(vkPhysDevice, vkQueueNodeIndex, vkSurface, &vkSurfaceSupported)
+			|| !vkSurfaceSupported)
+		{
+			eprintf("Failed to confirm that physical device supports surface!\n");
+			return 1;
+		}
+
+		if (VK_SUCCESS != vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vkPhysDevice, vkSurface, &vkSurfaceCaps))
+		{
+			eprintf("Failed to get physical surface capabilities!\n");
+			return 1;
+		}
+
+		VkSurfaceFormatKHR *vkFormats = 0;
+		uint32_t vkFormatsCount = 0;
+		if (VK_SUCCESS != vkGetPhysicalDeviceSurfaceFormatsKHR(vkPhysDevice, vkSurface, &vkFormatsCount, vkFormats)
+			|| !(vkFormats = malloc(vkFormatsCount * sizeof(*vkFormats)))
+			|| VK_SUCCESS != vkGetPhysicalDeviceSurfaceFormatsKHR(vkPhysDevice, vkSurface, &vkFormatsCount, vkFormats))
+		{
+			eprintf("Failed to get surface formats!\n");
+			return 1;
+		}
+
+		VkPresentModeKHR *vkPresentModes = 0;
+		uint32_t vkPresentModesCount = 0;
+		if (VK_SUCCESS != vkGetPhysicalDeviceSurfacePresentModesKHR(vkPhysDevice, vkSurface, &vkPresentModesCount, vkPresentModes)
+			|| !(vkPresentModes = malloc(vkPresentModesCount * sizeof(*vkPresentModes)))
+			|| VK_SUCCESS != vkGetPhysicalDeviceSurfacePresentModesKHR(vkPhysDevice, vkSurface, &vkPresentModesCount, vkPresentModes))
+		{
+			eprintf("Failed to get presentation modes!\n");
+			return 1;
+		}
+
+		eprintf("VK Surface Formats:\n");
+		vkFormatDesired = &vkFormats[0];
+		for (uint32_t i = 0; i < vkFormatsCount; i++)
+		{
+			VkSurfaceFormatKHR *vkFormatCurrent = &vkFormats[i];
+			eprintf("Format,Colorspace = %u,%u\n", vkFormatCurrent->format, vkFormatCurrent->colorSpace);
+			if ((VK_FORMAT_B8G8R8_SNORM == vkFormatCurrent->format
+				|| VK_FORMAT_B8G8R8A8_UNORM == vkFormatCurrent->format)
+				&& VK_COLOR_SPACE_SRGB_NONLINEAR_KHR == vkFormatCurrent->colorSpace)
+			{
+				eprintf("I have found my desired colorspace!\n");
+				vkFormatDesired = vkFormatCurrent;
+			}
+		}
+		eprintf("VK desired format: %u,%u\n", vkFormatDesired->format, vkFormatDesired->colorSpace);
+
+		eprintf("VK presentation modes\n");
+		for (uint32_t i = 0; i < vkPresentModesCount; i++)
+		{
+			VkPresentModeKHR vkPresentModeCurrent = vkPresentModes[i];
+			eprintf("\t%d\n", vkPresentModeCurrent);
+			if (opts.presentMode == vkPresentModeCurrent)
+				vkPresentModeDesired = vkPresentModeCurrent;
+		}
+		// FIFO is the only one that's guaranteed
+		if (vkPresentModeDesired != opts.presentMode)
+			eprintf("No %s present mode here, so fifo it is!\n", presentModeNames[opts.presentMode]);
+		eprintf("VK desired presentation mode: %d\n", vkPresentModeDesired);
+
+		vkSurfaceCaps.currentExtent = surfaceExtent(window, &vkSurfaceCaps);
 	}
 
-	VkSurfaceCapabilitiesKHR vkSurfaceCaps = { 0 };
-	if (VK_SUCCESS != vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vkPhysDevice, vkSurface, &vkSurfaceCaps))
+	vkExtentDesired = vkSurfaceCaps.currentExtent;
+
+	// Same shader either way, the uniform schemes only differ in descriptor type and which of these it's specialized to read
+	VkPushConstantRange vkUnisPushRange =
 	{
-		eprintf("Failed to get physical surface capabilities!\n");
-		return 1;
-	}
+		.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+		.offset = 0,
+		.size = sizeof(struct Unis),
+	};
+	for (uint32_t i = 0; i < UNIFORM_SCHEMES_COUNT; i++)
+	{
+		VkDescriptorSetLayoutBinding vkLayoutBindings[] =
+		{
+			{
+				.binding = 0,
+				.descriptorType = i == UNIFORMS_RING ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+			},
+			{
+				.binding = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+			},
+		};
+		VkDescriptorSetLayoutCreateInfo vkdslcInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.bindingCount = ARRAYSIZE(vkLayoutBindings),
+			.pBindings = vkLayoutBindings,
+		};
+		if (VK_SUCCESS != vkCreateDescriptorSetLayout(vkDevice, &vkdslcInfo, 0, &vkUniformLayouts[i]))
+		{
+			eprintf("Failed to create descriptor set layout!\n");
+			return 1;
+		}
+		VkPipelineLayoutCreateInfo vkplcInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.setLayoutCount = 1,
+			.pSetLayouts = &vkUniformLayouts[i],
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &vkUnisPushRange,
+		};
 
-	VkSurfaceFormatKHR *vkFormats = 0;
-	uint32_t vkFormatsCount = 0;
-	if (VK_SUCCESS != vkGetPhysicalDeviceSurfaceFormatsKHR(vkPhysDevice, vkSurface, &vkFormatsCount, vkFormats)
-		|| !(vkFormats = malloc(vkFormatsCount * sizeof(*vkFormats)))
-		|| VK_SUCCESS != vkGetPhysicalDeviceSurfaceFormatsKHR(vkPhysDevice, vkSurface, &vkFormatsCount, vkFormats))
+		if (VK_SUCCESS != vkCreatePipelineLayout(vkDevice, &vkplcInfo, 0, &vkPipelineLayouts[i]))
+		{
+			eprintf("Pipeline layout creation failed!\n");
+			return 1;
+		}
+	}
+	// Instancing still gets its time from the ring, but everything else from the instance buffer
+	VkDescriptorSetLayoutBinding vkInstancedBindings[] =
+	{
+		{
+			.binding = 0,
+			.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+		},
+		{
+			.binding = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+		},
+		{
+			.binding = 2,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+		},
+	};
+	VkDescriptorSetLayoutCreateInfo vkdslcInfoInstanced =
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = ARRAYSIZE(vkInstancedBindings),
+		.pBindings = vkInstancedBindings,
+	};
+	if (VK_SUCCESS != vkCreateDescriptorSetLayout(vkDevice, &vkdslcInfoInstanced, 0, &vkInstancedLayout))
 	{
-		eprintf("Failed to get surface formats!\n");
+		eprintf("Failed to create instanced descriptor set layout!\n");
 		return 1;
 	}
-
-	VkPresentModeKHR *vkPresentModes = 0;
-	uint32_t vkPresentModesCount = 0;
-	if (VK_SUCCESS != vkGetPhysicalDeviceSurfacePresentModesKHR(vkPhysDevice, vkSurface, &vkPresentModesCount, vkPresentModes)
-		|| !(vkPresentModes = malloc(vkPresentModesCount * sizeof(*vkPresentModes)))
-		|| VK_SUCCESS != vkGetPhysicalDeviceSurfacePresentModesKHR(vkPhysDevice, vkSurface, &vkPresentModesCount, vkPresentModes))
+	VkPipelineLayoutCreateInfo vkplcInfoInstanced =
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &vkInstancedLayout,
+	};
+	if (VK_SUCCESS != vkCreatePipelineLayout(vkDevice, &vkplcInfoInstanced, 0, &vkInstancedPipelineLayout))
 	{
-		eprintf("Failed to get presentation modes!\n");
+		eprintf("Instanced pipeline layout creation failed!\n");
 		return 1;
 	}
-
-	eprintf("VK Surface Formats:\n");
-	VkSurfaceFormatKHR *vkFormatDesired = &vkFormats[0];
-	for (uint32_t i = 0; i < vkFormatsCount; i++)
+	// Instances, visible list and draw parameters, in the order cull-compute.glsl has them
+	VkDescriptorSetLayoutBinding vkCullBindings[3];
+	for (uint32_t i = 0; i < ARRAYSIZE(vkCullBindings); i++)
 	{
-		VkSurfaceFormatKHR *vkFormatCurrent = &vkFormats[i];
-		eprintf("Format,Colorspace = %u,%u\n", vkFormatCurrent->format, vkFormatCurrent->colorSpace);
-		if ((VK_FORMAT_B8G8R8_SNORM == vkFormatCurrent->format
-			|| VK_FORMAT_B8G8R8A8_UNORM == vkFormatCurrent->format)
-			&& VK_COLOR_SPACE_SRGB_NONLINEAR_KHR == vkFormatCurrent->colorSpace)
+		vkCullBindings[i] = (VkDescriptorSetLayoutBinding)
 		{
-			eprintf("I have found my desired colorspace!\n");
-			vkFormatDesired = vkFormatCurrent;
-		}
+			.binding = i,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		};
 	}
-	eprintf("VK desired format: %u,%u\n", vkFormatDesired->format, vkFormatDesired->colorSpace);
-
-	eprintf("VK presentation modes\n");
-	for (uint32_t i = 0; i < vkPresentModesCount; i++)
+	VkDescriptorSetLayoutCreateInfo vkdslcInfoCull =
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = ARRAYSIZE(vkCullBindings),
+		.pBindings = vkCullBindings,
+	};
+	VkPushConstantRange vkCullPushRange =
+	{
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = sizeof(struct CullParams),
+	};
+	VkPipelineLayoutCreateInfo vkplcInfoCull =
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &vkCullLayout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &vkCullPushRange,
+	};
+	if (VK_SUCCESS != vkCreateDescriptorSetLayout(vkDevice, &vkdslcInfoCull, 0, &vkCullLayout)
+		|| VK_SUCCESS != vkCreatePipelineLayout(vkDevice, &vkplcInfoCull, 0, &vkCullPipelineLayout))
 	{
-		VkPresentModeKHR vkPresentModeCurrent = vkPresentModes[i];
-		eprintf("\t%d\n", vkPresentModeCurrent);
-		if (VK_PRESENT_MODE_MAILBOX_KHR == vkPresentModeCurrent)
-			eprintf("Found Mailbox! Don't care!\n");
+		eprintf("Culling pipeline layout creation failed!\n");
+		return 1;
 	}
-	eprintf("VK desired presentation mode: %d\n", vkPresentModeDesired);
-
-	uint32_t extentWidth = vkSurfaceCaps.currentExtent.width;
-	uint32_t extentHeight = vkSurfaceCaps.currentExtent.height;
-	if (extentWidth == UINT32_MAX || extentHeight == UINT32_MAX)
+	// The layers don't read anything but these
+	VkPushConstantRange vkOverdrawPushRange =
 	{
-		int w, h;
-		SDL_GetWindowSize(window, &w, &h);
-		extentWidth = clampu32(w, vkSurfaceCaps.minImageExtent.width, vkSurfaceCaps.maxImageExtent.width);
-		extentHeight = clampu32(w, vkSurfaceCaps.minImageExtent.height, vkSurfaceCaps.maxImageExtent.height);
+		.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+		.offset = 0,
+		.size = sizeof(struct OverdrawParams),
+	};
+	VkPipelineLayoutCreateInfo vkplcInfoOverdraw =
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &vkOverdrawPushRange,
+	};
+	if (VK_SUCCESS != vkCreatePipelineLayout(vkDevice, &vkplcInfoOverdraw, 0, &vkOverdrawPipelineLayout))
+	{
+		eprintf("Overdraw pipeline layout creation failed!\n");
+		return 1;
 	}
-	vkSurfaceCaps.currentExtent.width = extentWidth;
-	vkSurfaceCaps.currentExtent.height = extentHeight;
-
-	VkExtent2D vkExtentDesired = vkSurfaceCaps.currentExtent;
-
-	VkDescriptorSetLayoutBinding vkLayoutBindings[] =
+	// Trilinear, so streamed mips blend in instead of popping
+	VkSamplerCreateInfo vkscInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+		.magFilter = VK_FILTER_LINEAR,
+		.minFilter = VK_FILTER_LINEAR,
+		.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+		.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+		.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+		.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+		.maxLod = VK_LOD_CLAMP_NONE,
+	};
+	if (VK_SUCCESS != vkCreateSampler(vkDevice, &vkscInfo, 0, &vkMaterialSampler))
+	{
+		eprintf("Failed to create the material sampler!\n");
+		return 1;
+	}
+	// A material a set, after the ring's uniforms, in the order material-fragment.glsl has them
+	VkDescriptorSetLayoutBinding vkMaterialBindings[] =
 	{
 		{
 			.binding = 0,
-			.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 			.descriptorCount = 1,
-			.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
-		}
+			.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+		},
+		{
+			.binding = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+		},
+		{
+			.binding = 2,
+			.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+			.pImmutableSamplers = &vkMaterialSampler,
+		},
 	};
-	VkDescriptorSetLayoutCreateInfo vkdslcInfo =
+	VkDescriptorSetLayoutCreateInfo vkdslcInfoMaterial =
 	{
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-		.bindingCount = ARRAYSIZE(vkLayoutBindings),
-		.pBindings = vkLayoutBindings,
+		.bindingCount = ARRAYSIZE(vkMaterialBindings),
+		.pBindings = vkMaterialBindings,
 	};
-	VkDescriptorSetLayout vkLayout = 0;
-	if (VK_SUCCESS != vkCreateDescriptorSetLayout(vkDevice, &vkdslcInfo, 0, &vkLayout))
+	if (VK_SUCCESS != vkCreateDescriptorSetLayout(vkDevice, &vkdslcInfoMaterial, 0, &vkMaterialLayout))
 	{
-		eprintf("Failed to create descriptor set layout!\n");
+		eprintf("Failed to create material descriptor set layout!\n");
 		return 1;
 	}
-	VkPipelineLayoutCreateInfo vkplcInfo =
+	VkDescriptorSetLayout vkMaterialSetLayouts[] = { vkUniformLayouts[UNIFORMS_RING], vkMaterialLayout };
+	VkPipelineLayoutCreateInfo vkplcInfoMaterial =
 	{
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-		.setLayoutCount = 1,
-		.pSetLayouts = &vkLayout,
-		.pushConstantRangeCount = 0,
-		.pPushConstantRanges = 0,
+		.setLayoutCount = ARRAYSIZE(vkMaterialSetLayouts),
+		.pSetLayouts = vkMaterialSetLayouts,
+		// vertex.glsl declares the push block whether it reads it or not
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &vkUnisPushRange,
 	};
-
-	VkPipelineLayout vkPipelineLayout;
-	if (VK_SUCCESS != vkCreatePipelineLayout(vkDevice, &vkplcInfo, 0, &vkPipelineLayout))
+	if (VK_SUCCESS != vkCreatePipelineLayout(vkDevice, &vkplcInfoMaterial, 0, &vkMaterialPipelineLayout))
 	{
-		eprintf("Pipeline layout creation failed!\n");
+		eprintf("Material pipeline layout creation failed!\n");
 		return 1;
 	}
+	// The same again as arrays, with the ring in front of the material buffers, and draws pushing their indices
+	if (bindless.supported)
+	{
+		VkDescriptorSetLayoutBinding vkBindlessBindings[] =
+		{
+			{
+				.binding = 0,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = BINDLESS_MAX_BUFFERS,
+				.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+			},
+			{
+				.binding = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+				.descriptorCount = BINDLESS_MAX_TEXTURES,
+				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+			},
+			vkMaterialBindings[2],
+		};
+		VkDescriptorBindingFlags vkBindlessFlags[] =
+		{
+			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT,
+			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT,
+			0,
+		};
+		VkDescriptorSetLayoutBindingFlagsCreateInfo vkdslbfcInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+			.bindingCount = ARRAYSIZE(vkBindlessFlags),
+			.pBindingFlags = vkBindlessFlags,
+		};
+		VkDescriptorSetLayoutCreateInfo vkdslcInfoBindless =
+		{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.pNext = &vkdslbfcInfo,
+			.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+			.bindingCount = ARRAYSIZE(vkBindlessBindings),
+			.pBindings = vkBindlessBindings,
+		};
+		VkPushConstantRange vkBindlessPushRange =
+		{
+			.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+			.offset = 0,
+			.size = sizeof(struct BindlessParams),
+		};
+		VkPipelineLayoutCreateInfo vkplcInfoBindless =
+		{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.setLayoutCount = 1,
+			.pSetLayouts = &vkBindlessLayout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &vkBindlessPushRange,
+		};
+		VkDescriptorPoolSize vkBindlessPoolSizes[] =
+		{
+			{ .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = BINDLESS_MAX_BUFFERS * MAX_FRAMES_IN_FLIGHT },
+			{ .type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, .descriptorCount = BINDLESS_MAX_TEXTURES * MAX_FRAMES_IN_FLIGHT },
+			{ .type = VK_DESCRIPTOR_TYPE_SAMPLER, .descriptorCount = MAX_FRAMES_IN_FLIGHT },
+		};
+		VkDescriptorPoolCreateInfo vkdpcInfoBindless =
+		{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+			.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+			.poolSizeCount = ARRAYSIZE(vkBindlessPoolSizes),
+			.pPoolSizes = vkBindlessPoolSizes,
+			.maxSets = MAX_FRAMES_IN_FLIGHT,
+		};
+		if (VK_SUCCESS != vkCreateDescriptorSetLayout(vkDevice, &vkdslcInfoBindless, 0, &vkBindlessLayout)
+			|| VK_SUCCESS != vkCreatePipelineLayout(vkDevice, &vkplcInfoBindless, 0, &vkBindlessPipelineLayout)
+			|| VK_SUCCESS != vkCreateDescriptorPool(vkDevice, &vkdpcInfoBindless, 0, &bindless.pool))
+		{
+			eprintf("Bindless pipeline layout creation failed!\n");
+			return 1;
+		}
+		VkDescriptorSetLayout vkBindlessLayouts[MAX_FRAMES_IN_FLIGHT];
+		for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+			vkBindlessLayouts[i] = vkBindlessLayout;
+		VkDescriptorSetAllocateInfo vkdsaInfoBindless =
+		{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.descriptorPool = bindless.pool,
+			.descriptorSetCount = MAX_FRAMES_IN_FLIGHT,
+			.pSetLayouts = vkBindlessLayouts,
+		};
+		if (VK_SUCCESS != vkAllocateDescriptorSets(vkDevice, &vkdsaInfoBindless, bindless.sets))
+		{
+			eprintf("Failed to allocate the bindless descriptor sets!\n");
+			return 1;
+		}
+	}
 
+	vkDepthFormat = pickDepthFormat();
+	vkSamples = pickSamples(opts.samples);
+	bool msaa = vkSamples != VK_SAMPLE_COUNT_1_BIT;
 	VkAttachmentDescription vkAttachmentDescriptions[] =
 	{
 		{
 			.format = vkFormatDesired->format,
 			.samples = VK_SAMPLE_COUNT_1_BIT,
-			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			// With MSAA the resolve writes every pixel, so there's nothing to clear
+			.loadOp = msaa ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_CLEAR,
 			.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
 			.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 			.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
 			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-			.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+			// Nobody presents offscreen images, but they could be copied out
+			.finalLayout = opts.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+		},
+		{
+			.format = vkDepthFormat,
+			.samples = vkSamples,
+			// Never leaves the render pass, so there's nothing to store
+			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+		},
+		{
+			// The samples, only there with MSAA, and dropped once the subpass resolves them into the first
+			.format = vkFormatDesired->format,
+			.samples = vkSamples,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
 		},
 	};
 	VkAttachmentReference vkAttachmentReferences[] =
+	{
+		{
+			.attachment = msaa ? 2 : 0,
+			.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		},
+	};
+	VkAttachmentReference vkResolveReferences[] =
 	{
 		{
 			.attachment = 0,
 			.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
 		},
 	};
+	VkAttachmentReference vkDepthReference =
+	{
+		.attachment = 1,
+		.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+	};
 	VkSubpassDescription vkSubpassDescriptions[] =
 	{
 		{
 			.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
 			.colorAttachmentCount = ARRAYSIZE(vkAttachmentReferences),
 			.pColorAttachments = vkAttachmentReferences,
+			.pResolveAttachments = msaa ? vkResolveReferences : 0,
+			.pDepthStencilAttachment = &vkDepthReference,
 		}
 	};
+	// The depth buffer is shared, so the last frame's depth tests have to finish before this one clears it.
+	// So is the multisampled target, its writes have to land before the clear writes over them
 	VkSubpassDependency subpassDependencies[] =
 	{
 		{
 			.srcSubpass = VK_SUBPASS_EXTERNAL,
 			.dstSubpass = 0,
-			.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-			.srcAccessMask = 0,
-			.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-			.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+				| VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+				| (msaa ? VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT : 0),
+			.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+				| VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+				| VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
 		}
 	};
 	VkRenderPassCreateInfo vkrpcInfo =
 	{
 		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-		.attachmentCount = ARRAYSIZE(vkAttachmentDescriptions),
+		.attachmentCount = msaa ? 3 : 2,
 		.pAttachments = vkAttachmentDescriptions,
 		.subpassCount = ARRAYSIZE(vkSubpassDescriptions),
 		.pSubpasses = vkSubpassDescriptions,
 		.dependencyCount = ARRAYSIZE(subpassDependencies),
 		.pDependencies = subpassDependencies,
 	};
-	VkRenderPass vkRenderPass;
-	if (VK_SUCCESS != vkCreateRenderPass(vkDevice, &vkrpcInfo, 0, &vkRenderPass))
+	if (0 != createDynamicRendering(dynamicRenderingSupported, vkFormatDesired->format))
+		return 1;
+	if (!dynamicRendering.enabled && VK_SUCCESS != vkCreateRenderPass(vkDevice, &vkrpcInfo, 0, &vkRenderPass))
 	{
 		eprintf("Failed to create render pass!\n");
 		return 1;
 	
 
 	}
-	int swapErr = createSwapchain(vkSurface, &vkSurfaceCaps, vkFormatDesired, vkExtentDesired, vkRenderPass);
+	int swapErr = opts.headless
+		? createOffscreenTargets(vkFormatDesired->format, vkExtentDesired, vkRenderPass)
+		: createSwapchain(vkSurface, &vkSurfaceCaps, vkFormatDesired, VK_NULL_HANDLE);
 	if (0 != swapErr)
 	{
 		eprintf("Swapchain creation failed!\n");
@@ -619,10 +6731,18 @@ int main(int argc, char **argv)
 	}
 	eprintf("Finally created the swap chain + views! (My god...)\n");
 
-	size_t shadervlen, shaderflen;
-	void *shaderv = readfile("vertex.spv", &shadervlen);
-	void *shaderf = readfile("fragment.spv", &shaderflen);
-	if (shaderv == NULL || shaderf == NULL)
+	// The modules are made straight from the mapped pages, and the files let go once they exist
+	struct MappedFile shaderv, shaderf, shaderi, shaderc, shaderov, shaderof, shadermf;
+	struct MappedFile shaderbv = { 0 }, shaderbf = { 0 };
+	if (0 != mapFile("vertex.spv", &shaderv)
+		|| 0 != mapFile("fragment.spv", &shaderf)
+		|| 0 != mapFile("instanced-vertex.spv", &shaderi)
+		|| 0 != mapFile("cull-compute.spv", &shaderc)
+		|| 0 != mapFile("overdraw-vertex.spv", &shaderov)
+		|| 0 != mapFile("overdraw-fragment.spv", &shaderof)
+		|| 0 != mapFile("material-fragment.spv", &shadermf)
+		// Without descriptor indexing these wouldn't even make it through vkCreateShaderModule
+		|| (bindless.supported && (0 != mapFile("bindless-vertex.spv", &shaderbv) || 0 != mapFile("bindless-fragment.spv", &shaderbf))))
 	{
 		eprintf("Failed to read shaders. Sadge...\n");
 		return 1;
@@ -631,18 +6751,95 @@ int main(int argc, char **argv)
 	VkShaderModuleCreateInfo vksmcInfoVertex =
 	{
 		.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-		.codeSize = shadervlen,
-		.pCode = shaderv,
+		.codeSize = shaderv.len,
+		.pCode = shaderv.data,
 	};
 	VkShaderModuleCreateInfo vksmcInfoFragment =
 	{
-		.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-		.codeSize = shaderflen,
-		.pCode = shaderf,
-	};
-
-	VkShaderModule shaderModuleVertex;
-	VkShaderModule shaderModuleFragment;
+		.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+		.codeSize = shaderf.len,
+		.pCode = shaderf.data,
+	};
+	VkShaderModuleCreateInfo vksmcInfoInstanced =
+	{
+		.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+		.codeSize = shaderi.len,
+		.pCode = shaderi.data,
+	};
+	VkShaderModuleCreateInfo vksmcInfoCull =
+	{
+		.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+		.codeSize = shaderc.len,
+		.pCode = shaderc.data,
+	};
+	VkShaderModuleCreateInfo vksmcInfoOverdrawVertex =
+	{
+		.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+		.codeSize = shaderov.len,
+		.pCode = shaderov.data,
+	};
+	VkShaderModuleCreateInfo vksmcInfoOverdrawFragment =
+	{
+		.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+		.codeSize = shaderof.len,
+		.pCode = shaderof.data,
+	};
+	VkShaderModuleCreateInfo vksmcInfoMaterial =
+	{
+		.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+		.codeSize = shadermf.len,
+		.pCode = shadermf.data,
+	};
+	VkShaderModuleCreateInfo vksmcInfoBindlessVertex =
+	{
+		.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+		.codeSize = shaderbv.len,
+		.pCode = shaderbv.data,
+	};
+	VkShaderModuleCreateInfo vksmcInfoBindlessFragment =
+	{
+		.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+		.codeSize = shaderbf.len,
+		.pCode = shaderbf.data,
+	};
+
+	VkShaderModule shaderModuleVertex;
+	VkShaderModule shaderModuleFragment;
+	VkShaderModule shaderModuleInstanced;
+	VkShaderModule shaderModuleCull;
+	VkShaderModule shaderModuleOverdrawVertex;
+	VkShaderModule shaderModuleOverdrawFragment;
+	VkShaderModule shaderModuleMaterial;
+	VkShaderModule shaderModuleBindlessVertex = VK_NULL_HANDLE;
+	VkShaderModule shaderModuleBindlessFragment = VK_NULL_HANDLE;
+	if (VK_SUCCESS != vkCreateShaderModule(vkDevice, &vksmcInfoMaterial, 0, &shaderModuleMaterial))
+	{
+		eprintf("Failed to create material fragment shader module!\n");
+		return 1;
+	}
+	if (bindless.supported
+		&& (VK_SUCCESS != vkCreateShaderModule(vkDevice, &vksmcInfoBindlessVertex, 0, &shaderModuleBindlessVertex)
+			|| VK_SUCCESS != vkCreateShaderModule(vkDevice, &vksmcInfoBindlessFragment, 0, &shaderModuleBindlessFragment)))
+	{
+		eprintf("Failed to create bindless shader modules!\n");
+		return 1;
+	}
+	if (VK_SUCCESS != vkCreateShaderModule(vkDevice, &vksmcInfoOverdrawVertex, 0, &shaderModuleOverdrawVertex)
+		|| VK_SUCCESS != vkCreateShaderModule(vkDevice, &vksmcInfoOverdrawFragment, 0, &shaderModuleOverdrawFragment))
+	{
+		eprintf("Failed to create overdraw shader modules!\n");
+		return 1;
+	}
+	if (VK_SUCCESS != vkCreateShaderModule(vkDevice, &vksmcInfoInstanced, 0, &shaderModuleInstanced))
+	{
+		eprintf("Failed to create instanced vertex shader module!\n");
+		return 1;
+	}
+	if (VK_SUCCESS != vkCreateShaderModule(vkDevice, &vksmcInfoCull, 0, &shaderModuleCull))
+	{
+		eprintf("Failed to create culling compute shader module!\n");
+		return 1;
+	}
 	if (VK_SUCCESS != vkCreateShaderModule(vkDevice, &vksmcInfoVertex, 0, &shaderModuleVertex))
 	{
 		eprintf("Failed to create vertex shader module!\n");
@@ -653,156 +6850,139 @@ int main(int argc, char **argv)
 		eprintf("Failed to create fragment shader module!\n");
 		return 1;
 	}
+	unmapFile(&shaderv);
+	unmapFile(&shaderf);
+	unmapFile(&shaderi);
+	unmapFile(&shaderc);
+	unmapFile(&shaderov);
+	unmapFile(&shaderof);
+	unmapFile(&shadermf);
+	unmapFile(&shaderbv);
+	unmapFile(&shaderbf);
 
 
-	VkDynamicState vkDynStates[] =
-	{
-		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_SCISSOR,
-	};
-	VkPipelineDynamicStateCreateInfo vkpdscInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
-		.dynamicStateCount = ARRAYSIZE(vkDynStates),
-		.pDynamicStates = vkDynStates,
-	};
-	VkPipelineVertexInputStateCreateInfo vkpviscInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-		.vertexBindingDescriptionCount = 0,
-		.pVertexBindingDescriptions = 0,
-		.vertexAttributeDescriptionCount = 0,
-		.pVertexAttributeDescriptions = 0,
-	};
-	VkPipelineInputAssemblyStateCreateInfo vkpiascInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-		.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-		.primitiveRestartEnable = VK_FALSE,
-	};
-	VkViewport vkViewports[] =
-	{
-		{
-			.x = 0,
-			.y = 0,
-			.width = (float)vkExtentDesired.width,
-			.height = (float)vkExtentDesired.height,
-			.minDepth = 0,
-			.maxDepth = 1,
-		}
-	};
-	VkRect2D vkScissors[] =
+	// One per uniform scheme, then the instanced ones, the material one, the overdraw layers and bindless last
+	struct PipelineDesc vkPipelineDescs[UNIFORM_SCHEMES_COUNT + 3 + OVERDRAW_PIPELINES_COUNT + 1];
+	for (uint32_t i = 0; i < UNIFORM_SCHEMES_COUNT; i++)
 	{
-		{
-			.offset = {0, 0},
-			.extent = vkExtentDesired,
-		}
-	};
-	VkPipelineViewportStateCreateInfo vkpvscInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-		.viewportCount = ARRAYSIZE(vkViewports),
-		.pViewports = vkViewports,
-		.scissorCount = ARRAYSIZE(vkScissors),
-		.pScissors = vkScissors,
-	};
-	VkPipelineRasterizationStateCreateInfo vkprscInfo =
+		pipelineDescDefaults(&vkPipelineDescs[i]);
+		vkPipelineDescs[i].layout = vkPipelineLayouts[i];
+		vkPipelineDescs[i].vertex = shaderModuleVertex;
+		vkPipelineDescs[i].fragment = shaderModuleFragment;
+		pipelineDescSpin(&vkPipelineDescs[i], i == UNIFORMS_PUSH ? 1 : i == UNIFORMS_STORAGE ? 2 : 0);
+	}
+	struct PipelineDesc *vkPipelineDescsInstanced = &vkPipelineDescs[UNIFORM_SCHEMES_COUNT];
+	pipelineDescDefaults(&vkPipelineDescsInstanced[0]);
+	vkPipelineDescsInstanced[0].layout = vkInstancedPipelineLayout;
+	vkPipelineDescsInstanced[0].vertex = shaderModuleInstanced;
+	vkPipelineDescsInstanced[0].fragment = shaderModuleFragment;
+	pipelineDescSpin(&vkPipelineDescsInstanced[0], VK_FALSE);
+	// Same shader with CULLED on, so it looks the instances up through the visible list
+	vkPipelineDescsInstanced[1] = vkPipelineDescsInstanced[0];
+	vkPipelineDescsInstanced[1].specValues[0] = VK_TRUE;
+	// Same vertices and uniforms as the per-draw ring, with the material on top
+	struct PipelineDesc *vkPipelineDescMaterial = &vkPipelineDescsInstanced[2];
+	pipelineDescDefaults(vkPipelineDescMaterial);
+	vkPipelineDescMaterial->layout = vkMaterialPipelineLayout;
+	vkPipelineDescMaterial->vertex = shaderModuleVertex;
+	vkPipelineDescMaterial->fragment = shaderModuleMaterial;
+	pipelineDescSpin(vkPipelineDescMaterial, 0);
+	// The overdraw layers make their own vertices, and the pre-pass has no fragment shader at all
+	struct PipelineDesc *vkPipelineDescsOverdraw = &vkPipelineDescsInstanced[3];
+	for (uint32_t i = 0; i < OVERDRAW_PIPELINES_COUNT; i++)
 	{
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-		.depthClampEnable = VK_FALSE,
-		.rasterizerDiscardEnable = VK_FALSE,
-		.polygonMode = VK_POLYGON_MODE_FILL,
-		.lineWidth = 1,
-		.depthBiasEnable = VK_FALSE,
-#if 0
-		// Would've been required if depth bias enabled
-		.depthBiasConstantFactor = 0,
-		.depthBiasClamp = 0,
-		.depthBiasSlopeFactor = 0,
-#endif
-	};
-	VkPipelineMultisampleStateCreateInfo vkpmscInfo =
+		pipelineDescDefaults(&vkPipelineDescsOverdraw[i]);
+		vkPipelineDescsOverdraw[i].layout = vkOverdrawPipelineLayout;
+		vkPipelineDescsOverdraw[i].vertex = shaderModuleOverdrawVertex;
+		vkPipelineDescsOverdraw[i].fragment = shaderModuleOverdrawFragment;
+		vkPipelineDescsOverdraw[i].stride = 0;
+		vkPipelineDescsOverdraw[i].attributesCount = 0;
+		memset(vkPipelineDescsOverdraw[i].attributes, 0, sizeof(vkPipelineDescsOverdraw[i].attributes));
+		vkPipelineDescsOverdraw[i].depthTest = VK_TRUE;
+		vkPipelineDescsOverdraw[i].depthWrite = VK_TRUE;
+	}
+	// Only the front layer matches what the pre-pass wrote, and there's no point writing it again
+	vkPipelineDescsOverdraw[OVERDRAW_AFTER_PREPASS].depthCompare = VK_COMPARE_OP_EQUAL;
+	vkPipelineDescsOverdraw[OVERDRAW_AFTER_PREPASS].depthWrite = VK_FALSE;
+	vkPipelineDescsOverdraw[OVERDRAW_PREPASS].fragment = VK_NULL_HANDLE;
+	vkPipelineDescsOverdraw[OVERDRAW_PREPASS].colorWriteMask = 0;
+	// The shading passes specialized for the first phase, and the rest of the run's shadings queued along with everything here
+	memcpy(vkOverdrawPipelineDescs, vkPipelineDescsOverdraw, sizeof(vkOverdrawPipelineDescs));
+	struct Shading vkShadings[MAX_SHADINGS];
+	uint32_t vkShadingsCount = shadingsForRun(vkShadings);
+	vkPipelineDescsOverdraw[OVERDRAW_COLOR] = overdrawShadingDesc(&vkShadings[0], false);
+	vkPipelineDescsOverdraw[OVERDRAW_AFTER_PREPASS] = overdrawShadingDesc(&vkShadings[0], true);
+	struct PipelineDesc vkShadingDescs[MAX_SHADINGS * 2];
+	uint32_t vkShadingDescsCount = 0;
+	for (uint32_t i = 1; i < vkShadingsCount; i++)
 	{
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-		.sampleShadingEnable = VK_FALSE,
-		.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
-		.minSampleShading = 1.0f,
-		.pSampleMask = 0,
-		.alphaToCoverageEnable = VK_FALSE,
-		.alphaToOneEnable = VK_FALSE,
-	};
-	// TODO: Depth and stenciling (ugh...)
-	// Ah yes. Color blending. My favorite...
-	VkPipelineColorBlendAttachmentState vkpcbaStates[] =
-	{
-		{
-			.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
-			.blendEnable = VK_FALSE,
-#if 0
-			// Would have been required if blending was enabled
-			.srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
-			.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
-			.colorBlendOp = VK_BLEND_OP_ADD,
-			.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
-			.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
-			.alphaBlendOp = VK_BLEND_OP_ADD,
-#endif
-		},
-	};
-	VkPipelineColorBlendStateCreateInfo vkpcbscInfo =
+		if (opts.benchOverdraw || !opts.depthPrepass)
+			vkShadingDescs[vkShadingDescsCount++] = overdrawShadingDesc(&vkShadings[i], false);
+		if (opts.benchOverdraw || opts.depthPrepass)
+			vkShadingDescs[vkShadingDescsCount++] = overdrawShadingDesc(&vkShadings[i], true);
+	}
+	struct PipelineDesc *vkPipelineDescBindless = &vkPipelineDescsOverdraw[OVERDRAW_PIPELINES_COUNT];
+	pipelineDescDefaults(vkPipelineDescBindless);
+	vkPipelineDescBindless->layout = vkBindlessPipelineLayout;
+	vkPipelineDescBindless->vertex = shaderModuleBindlessVertex;
+	vkPipelineDescBindless->fragment = shaderModuleBindlessFragment;
+	pipelineDescSpin(vkPipelineDescBindless, 0);
+	// There's no layout to build it with otherwise
+	uint32_t vkPipelineDescsCount = ARRAYSIZE(vkPipelineDescs) - (bindless.supported ? 0 : 1);
+	VkComputePipelineCreateInfo vkcpcInfo =
 	{
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
-		.attachmentCount = ARRAYSIZE(vkpcbaStates),
-		.pAttachments = vkpcbaStates,
-		.logicOpEnable = VK_FALSE,
-#if 0
-		// Would be required if logical operations were enabled
-		.logicOp = VK_LOGIC_OP_COPY,
-		.blendConstants = {0, 0, 0, 0},
-#endif
-	};
-
-	VkPipelineShaderStageCreateInfo vkpsscInfos[] = {
-		{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-			.stage = VK_SHADER_STAGE_VERTEX_BIT,
-			.module = shaderModuleVertex,
-			.pName = "main",
-		},
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.stage =
 		{
 			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-			.stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-			.module = shaderModuleFragment,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = shaderModuleCull,
 			.pName = "main",
 		},
+		.layout = vkCullPipelineLayout,
 	};
 
-	VkGraphicsPipelineCreateInfo vkgpcInfo =
+	bool pipelineCacheWarm = createPipelineCache(opts.pipelineCachePath);
+	if (0 != createPipelines())
+		return 1;
+	double pipelineStart = nowMs();
+	// All queued up front so the compile threads split them, then waited on in order
+	VkPipeline vkPipelines[ARRAYSIZE(vkPipelineDescs)] = { 0 };
+	for (uint32_t i = 0; i < vkPipelineDescsCount; i++)
+		pipelineGet(&vkPipelineDescs[i], false);
+	for (uint32_t i = 0; i < vkShadingDescsCount; i++)
+		pipelineGet(&vkShadingDescs[i], false);
+	for (uint32_t i = 0; i < vkPipelineDescsCount; i++)
 	{
-		.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-		.stageCount = ARRAYSIZE(vkpsscInfos),
-		.pStages = vkpsscInfos,
-		.pVertexInputState = &vkpviscInfo,
-		.pInputAssemblyState = &vkpiascInfo,
-		.pViewportState = &vkpvscInfo,
-		.pRasterizationState = &vkprscInfo,
-		.pMultisampleState = &vkpmscInfo,
-		.pDepthStencilState = 0,
-		.pColorBlendState = &vkpcbscInfo,
-		.pDynamicState = &vkpdscInfo,
-		.layout = vkPipelineLayout,
-		.renderPass = vkRenderPass,
-		.subpass = 0,
-		.basePipelineHandle = VK_NULL_HANDLE,
-		.basePipelineIndex = -1,
-	};
-
-	VkPipeline vkGraphicsPipeline;
-	if (VK_SUCCESS != vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &vkgpcInfo, 0, &vkGraphicsPipeline))
+		if (!(vkPipelines[i] = pipelineGet(&vkPipelineDescs[i], true)))
+		{
+			eprintf("Failed to create the graphics pipeline! AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA!\n");
+			return 1;
+		}
+	}
+	// The table keeps them for startPhase() to find
+	for (uint32_t i = 0; i < vkShadingDescsCount; i++)
+	{
+		if (!pipelineGet(&vkShadingDescs[i], true))
+		{
+			eprintf("Failed to create overdraw shading variant %u!\n", i);
+			return 1;
+		}
+	}
+	if (VK_SUCCESS != vkCreateComputePipelines(vkDevice, vkPipelineCache, 1, &vkcpcInfo, 0, &vkCullPipeline))
 	{
-		eprintf("Failed to create the graphics pipeline! AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA!\n");
+		eprintf("Failed to create the culling pipeline!\n");
 		return 1;
 	}
+	memcpy(vkGraphicsPipelineDescs, vkPipelineDescs, sizeof(vkGraphicsPipelineDescs));
+	memcpy(vkGraphicsPipelines, vkPipelines, sizeof(vkGraphicsPipelines));
+	memcpy(vkInstancedPipelines, &vkPipelines[UNIFORM_SCHEMES_COUNT], sizeof(vkInstancedPipelines));
+	vkMaterialPipeline = vkPipelines[UNIFORM_SCHEMES_COUNT + 2];
+	memcpy(vkOverdrawPipelines, &vkPipelines[UNIFORM_SCHEMES_COUNT + 3], sizeof(vkOverdrawPipelines));
+	vkBindlessPipeline = vkPipelines[ARRAYSIZE(vkPipelines) - 1];
+	printf("pipeline creation: %.3f ms (%s cache)\n", nowMs() - pipelineStart, pipelineCacheWarm ? "warm" : "cold");
+	if (opts.hotReload && 0 != startShaderReload(vkPipelineDescs, shaderModuleVertex, shaderModuleFragment))
+		return 1;
 	eprintf("I created the graphics pipeline and I wanna kill someone!\n");
 
 	VkCommandPoolCreateInfo vkpcInfo =
@@ -823,7 +7003,7 @@ int main(int argc, char **argv)
 		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
 		.commandPool = vkPool,
 		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-		.commandBufferCount = ARRAYSIZE(vkCommandBuffers),
+		.commandBufferCount = opts.framesInFlight,
 	};
 	if (VK_SUCCESS != vkAllocateCommandBuffers(vkDevice, &vkcbaInfo, vkCommandBuffers))
 	{
@@ -832,17 +7012,17 @@ int main(int argc, char **argv)
 	}
 	eprintf("I did a command buffer!\n");
 
-	/* 
- 	 * Because I happen to hate myself, I'm doing uniform buffers when I could've
-	 * gotten away with a push constant because these are familiar from opengl and
-	 * teaches me how Vulkan does buffer management unlike push constants.
-	 */
-	VkBuffer uniformBuffers[MAX_FRAMES_IN_FLIGHT] = { 0 };
-	VkDeviceMemory uniformMemories[MAX_FRAMES_IN_FLIGHT] = { 0 };
-	struct Unis { float time; } *uniformMemoriesMapped[MAX_FRAMES_IN_FLIGHT] = { 0 };
+	if (0 != createStagingRing(vkTransferQueueNodeIndex)
+		|| (opts.benchLoadPath && 0 != benchLoad(opts.benchLoadPath))
+		|| 0 != createMesh(opts.meshSubdivisions, vkQueueNodeIndex, vkPool)
+		|| 0 != createGpuTimers(vkQueueProps[vkQueueNodeIndex].timestampValidBits, opts.gpuCsvPath))
+		return 1;
+	bool firstDrawPending = true;
+
 	VkSemaphore imageAvailableSemaphores[MAX_FRAMES_IN_FLIGHT] = { 0 };
 	VkSemaphore renderFinishedSemaphores[MAX_FRAMES_IN_FLIGHT] = { 0 };
 	VkFence inFlightFences[MAX_FRAMES_IN_FLIGHT] = { 0 };
+	uint64_t frameValues[MAX_FRAMES_IN_FLIGHT] = { 0 }; // Timeline values instead of the fences
 	VkSemaphoreCreateInfo vksemcInfo =
 	{
 		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
@@ -852,7 +7032,7 @@ int main(int argc, char **argv)
 		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
 		.flags = VK_FENCE_CREATE_SIGNALED_BIT,
 	};
-	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	for (uint32_t i = 0; i < opts.framesInFlight; i++)
 	{
 		if (VK_SUCCESS != vkCreateSemaphore(vkDevice, &vksemcInfo, 0, &imageAvailableSemaphores[i])
 			|| VK_SUCCESS != vkCreateSemaphore(vkDevice, &vksemcInfo, 0, &renderFinishedSemaphores[i])
@@ -861,250 +7041,445 @@ int main(int argc, char **argv)
 			eprintf("Wasn't able to create synchronization primitive? What?\n");
 			return 1;
 		}
-
-		VkBufferCreateInfo vkbcInfo =
-		{
-			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-			.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			.size = sizeof(**uniformMemoriesMapped),
-			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-			.flags = 0,
-		};
-		if (VK_SUCCESS != vkCreateBuffer(vkDevice, &vkbcInfo, 0, &uniformBuffers[i]))
-		{
-			eprintf("Unable to create uniform buffer in flight!\n");
-			return 1;
-		}
-		VkMemoryRequirements vkMemReqs;
-		vkGetBufferMemoryRequirements(vkDevice, uniformBuffers[i], &vkMemReqs);
-		VkPhysicalDeviceMemoryProperties vkPhysDevMemProps;
-		vkGetPhysicalDeviceMemoryProperties(vkPhysDevice, &vkPhysDevMemProps);
-		uint32_t memoryTypeIdx;
-		uint32_t properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-		for (memoryTypeIdx = 0; memoryTypeIdx < vkPhysDevMemProps.memoryTypeCount; memoryTypeIdx++)
-		{
-			if ((vkMemReqs.memoryTypeBits & (memoryTypeIdx << 1)) || (vkPhysDevMemProps.memoryTypes[memoryTypeIdx].propertyFlags & properties))
-				break;
-		}
-		if (memoryTypeIdx >= vkPhysDevMemProps.memoryTypeCount)
-		{
-			eprintf("No physical memory available for mapable uniforms. Sad...\n");
-			return 1;
-		}
-		VkMemoryAllocateInfo vkmaInfo =
-		{
-			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-			.memoryTypeIndex = memoryTypeIdx,
-			.allocationSize = vkMemReqs.size,
-		};
-		if (VK_SUCCESS != vkAllocateMemory(vkDevice, &vkmaInfo, 0, &uniformMemories[i])
-			|| VK_SUCCESS != vkBindBufferMemory(vkDevice, uniformBuffers[i], uniformMemories[i], 0)
-			|| VK_SUCCESS != vkMapMemory(vkDevice, uniformMemories[i], 0, vkbcInfo.size, 0, (void **)&uniformMemoriesMapped[i]))
-		{
-			eprintf("Booooooo! Failed to map uniform buffer memories!\n");
-			return 1;
-		}
 	}
 
-	// Now the descriptors for the buffers. Ughhhhhhhhhhhhhhhhhhhh...
-	VkDescriptorPoolSize vkDescPoolSize =
-	{
-		.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-		.descriptorCount = MAX_FRAMES_IN_FLIGHT,
-	};
-	VkDescriptorPoolCreateInfo vkdpcInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-		.poolSizeCount = 1,
-		.pPoolSizes = &vkDescPoolSize,
-		.maxSets = MAX_FRAMES_IN_FLIGHT,
-
-	};
-	VkDescriptorPool vkDescriptorPool;
-	if (VK_SUCCESS != vkCreateDescriptorPool(vkDevice, &vkdpcInfo, 0, &vkDescriptorPool))
-	{
-		eprintf("Failed to create descriptor pool!\n");
-		return 1;
-	}
-	VkDescriptorSet vkDescSets[MAX_FRAMES_IN_FLIGHT];
-	VkDescriptorSetLayout vkDescLayouts[MAX_FRAMES_IN_FLIGHT] = { vkLayout, vkLayout, };
-	VkDescriptorSetAllocateInfo vkdsaInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-		.descriptorPool = vkDescriptorPool,
-		.descriptorSetCount = MAX_FRAMES_IN_FLIGHT,
-		.pSetLayouts = vkDescLayouts,
-	};
-	if (VK_SUCCESS != vkAllocateDescriptorSets(vkDevice, &vkdsaInfo, vkDescSets))
-	{
-		eprintf("Failed to alllocate descriptor sets!\n");
+	/* 
+ 	 * Because I happen to hate myself, I'm doing uniform buffers when I could've
+	 * gotten away with a push constant because these are familiar from opengl and
+	 * teaches me how Vulkan does buffer management unlike push constants.
+	 */
+	uint32_t phasesCount;
+	uint32_t phase = 0;
+	struct Phase *phases = createPhases(&phasesCount);
+	if (phases == NULL || 0 != startPhase(&phases[0], vkQueueNodeIndex, vkPool))
 		return 1;
-	}
-	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-	{
-		VkDescriptorBufferInfo bufInfo =
-		{
-			.buffer = uniformBuffers[i],
-			.offset = 0,
-			.range = sizeof(**uniformMemoriesMapped),
-		};
-		VkWriteDescriptorSet descriptorWrite =
-		{
-			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-			.dstSet = vkDescSets[i],
-			.dstBinding = 0,
-			.dstArrayElement = 0,
-			.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-			.descriptorCount = 1,
-			.pBufferInfo = &bufInfo,
-			.pImageInfo = 0,
-			.pTexelBufferView = 0,
-		};
-		vkUpdateDescriptorSets(vkDevice, 1, &descriptorWrite, 0, 0);
-	}
 
 	SDL_Event e;
 	bool quit = false;
 	VkQueue vkGraphicsQueue, vkPresentQueue;
 	vkGetDeviceQueue(vkDevice, vkQueueNodeIndex, 0, &vkGraphicsQueue);
 	vkGetDeviceQueue(vkDevice, vkQueueNodeIndex, 0, &vkPresentQueue);
-	int inFlight = 0;
+	uint32_t inFlight = 0;
+	uint32_t frameNumber = 0;
+	// Timings so headless runs (and --frames runs) can catch regressions in this loop
+	struct Samples frameTimes = { 0 };
+	struct Samples recordTimes = { 0 };
+	struct Samples submitCosts = { 0 };
+	struct Samples fenceLatencies = { 0 };
+	struct Samples waitTimes = { 0 };
+	struct Samples visibleRatios = { 0 };
+	struct Samples descriptorTimes = { 0 }; // Allocating and writing the frame's sets, transient uniforms only
+	double submitTimes[MAX_FRAMES_IN_FLIGHT] = { 0 };
+	/*
+	 * Input latency runs from when SDL queued the oldest input event a frame
+	 * saw to when we noticed that frame's fence. SDL stamps events with
+	 * SDL_GetTicks(), so their age gets moved over to the nowMs() clock.
+	 */
+	struct Samples inputLatencies = { 0 };
+	double inputTimes[MAX_FRAMES_IN_FLIGHT] = { 0 };
+	double pendingInput = 0;
+	struct Samples recreateTimes = { 0 };
+	bool resized = false;
+	double lastFrameStart = 0;
+	uint32_t phaseFrames = 0;
 	while (!quit)
 	{
-		while (SDL_PollEvent(&e))
+		double frameStart = nowMs();
+		if (phaseFrames > 0)
+			samplesPush(&frameTimes, frameStart - lastFrameStart);
+		lastFrameStart = frameStart;
+
+		// Cycle through a few sizes around the requested one, a resize every few frames
+		if (opts.benchResize && phaseFrames % 4 == 0)
+		{
+			uint32_t step = phaseFrames / 4 % 4;
+			SDL_SetWindowSize(window, (int)(opts.width / 2 + opts.width * step / 4), (int)(opts.height / 2 + opts.height * step / 4));
+		}
+		while (!opts.headless && SDL_PollEvent(&e))
 		{
 			switch (e.type)
 			{
 			case SDL_QUIT:
 				quit = true;
 				break;
+			case SDL_WINDOWEVENT:
+				// Not every platform bothers with VK_ERROR_OUT_OF_DATE_KHR
+				if (e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+					resized = true;
+				break;
+			case SDL_KEYDOWN:
+			case SDL_MOUSEMOTION:
+			case SDL_MOUSEBUTTONDOWN:
+				if (pendingInput == 0)
+					pendingInput = nowMs() - (double)(SDL_GetTicks() - e.common.timestamp);
+				break;
 			}
 		}
+		if (resized)
+		{
+			double recreateStart = nowMs();
+			swapErr = recreateSwapchain(window, vkSurface, &vkSurfaceCaps, vkFormatDesired, frameNumber);
+			if (swapErr > 0)
+			{
+				eprintf("Recreate swapchain failed!\n");
+				return swapErr;
+			}
+			else if (swapErr < 0)
+			{
+				// Minimized, so nothing to do until it comes back
+				SDL_Delay(10);
+				continue;
+			}
+			samplesPush(&recreateTimes, nowMs() - recreateStart);
+			resized = false;
+		}
+		if (shaderReload.thread && SDL_AtomicGet(&shaderReload.ready))
+			shaderReloadSwap(frameNumber);
 
 		uint32_t imageIndex;
-		struct Unis *unis = uniformMemoriesMapped[inFlight];
-		VkDescriptorSet descSet = vkDescSets[inFlight];
 		VkFence inFlightFence = inFlightFences[inFlight];
 		VkSemaphore renderFinishedSemaphore = renderFinishedSemaphores[inFlight];
 		VkSemaphore imageAvailableSemaphore = imageAvailableSemaphores[inFlight];
-		vkWaitForFences(vkDevice, 1, &inFlightFence, VK_TRUE, UINT64_MAX);
-		err = vkAcquireNextImageKHR(vkDevice, vkSwapchain, UINT64_MAX, imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
-		if (VK_ERROR_OUT_OF_DATE_KHR == err)
+		double waitStart = nowMs();
+		syncWait(inFlightFence, frameValues[inFlight]);
+		samplesPush(&waitTimes, nowMs() - waitStart);
+		// Nothing in flight uses this slot's sets anymore
+		descriptorPoolsReset(&frameDescriptorPools[inFlight]);
+		// Frames retire in order, so everything before this slot's last frame is done too
+		if (deletions.count)
+			processDeletions(frameNumber + 1 > opts.framesInFlight ? frameNumber + 1 - opts.framesInFlight : 0);
+		// This is when the CPU noticed the fence, which is only exact when we had to wait on it
+		if (submitTimes[inFlight] != 0)
 		{
-			swapErr = recreateSwapchain(vkSurface, &vkSurfaceCaps, vkFormatDesired, vkExtentDesired, vkRenderPass);
-			if (0 != swapErr)
+			samplesPush(&fenceLatencies, nowMs() - submitTimes[inFlight]);
+			if (firstDrawPending)
 			{
-				eprintf("Recreate swapchain failed after acquire!\n");
-				return swapErr;
+				printf("time to first draw: %.3f ms\n", nowMs() - mesh.uploadStart);
+				firstDrawPending = false;
+			}
+			submitTimes[inFlight] = 0;
+			if (inputTimes[inFlight] != 0)
+				samplesPush(&inputLatencies, nowMs() - inputTimes[inFlight]);
+			inputTimes[inFlight] = 0;
+			gpuTimersCollect(inFlight);
+			if (instances.mode == DRAW_CULLED)
+			{
+				uint32_t visible = instancesVisible(inFlight);
+				samplesPush(&visibleRatios, 100.0 * visible / instances.count);
+				if (window && frameNumber % 30 == 0)
+				{
+					char title[64];
+					snprintf(title, sizeof(title), "Khronos Tutorial (%u/%u visible)", visible, instances.count);
+					SDL_SetWindowTitle(window, title);
+				}
 			}
-			// Bring it back from the top now...
-			continue;
 		}
-		else if (VK_SUCCESS != err && VK_SUBOPTIMAL_KHR != err)
+		if (opts.headless)
 		{
-			eprintf("Can't acquire the next image, boss! %d\n", err);
-			return 1;
+			imageIndex = frameNumber % vkSwapchainImagesCount;
+		}
+		else
+		{
+			err = vkAcquireNextImageKHR(vkDevice, vkSwapchain, UINT64_MAX, imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+			if (VK_ERROR_OUT_OF_DATE_KHR == err)
+			{
+				resized = true;
+				// Bring it back from the top now...
+				continue;
+			}
+			else if (VK_SUCCESS != err && VK_SUBOPTIMAL_KHR != err)
+			{
+				eprintf("Can't acquire the next image, boss! %d\n", err);
+				return 1;
+			}
 		}
-		vkResetFences(vkDevice, 1, &inFlightFence);
 
+		// Get the culling going first so it overlaps with recording too
+		float time = SDL_GetTicks() / 1000.0f;
+		if (asyncCompute.enabled && 0 != submitAsyncCull(inFlight, time))
+			return 1;
 		VkCommandBuffer commandBuffer = vkCommandBuffers[inFlight];
-		vkResetCommandBuffer(commandBuffer, 0);
+		double descriptorsStart = nowMs();
+		if (0 != uniformsBeginFrame(inFlight))
+			return 1;
+		if (uniforms.scheme == UNIFORMS_TRANSIENT)
+			samplesPush(&descriptorTimes, nowMs() - descriptorsStart);
+		double recordStart = nowMs();
+		pickPipelineVariant(frameNumber);
+		if (0 != recordCommandBuffer(commandBuffer, imageIndex, inFlight, frameNumber, time))
+			return 1;
+		samplesPush(&recordTimes, nowMs() - recordStart);
 
-		VkCommandBufferBeginInfo vkcbbInfo =
-		{
-			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-			.flags = 0,
-			.pInheritanceInfo = 0,
-		};
-		if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffer, &vkcbbInfo))
+		VkSemaphore waitSemaphores[2];
+		VkPipelineStageFlags waitStages[ARRAYSIZE(waitSemaphores)];
+		uint32_t waitsCount = 0;
+		VkSemaphore signalSemaphores[] = {renderFinishedSemaphore};
+		// Offscreen images are never acquired or presented so there's nothing to wait on
+		if (!opts.headless)
 		{
-			eprintf("Beginning command buffer failed!\n");
-			return 1;
+			waitSemaphores[waitsCount] = imageAvailableSemaphore;
+			waitStages[waitsCount++] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 		}
-		VkClearValue vkClearColors[] =
-		{
-			{ .color = { .float32 = { 0, 0, 0, 1 } } }
-		};
-		VkRenderPassBeginInfo vkrpbInfo =
-		{
-			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-			.renderPass = vkRenderPass,
-			.framebuffer = vkFramebuffers[imageIndex],
-			.renderArea.offset = {0, 0},
-			.renderArea.extent = vkExtentDesired,
-			.clearValueCount = ARRAYSIZE(vkClearColors),
-			.pClearValues = vkClearColors,
-		};
-		unis->time = SDL_GetTicks() / 1000.0f;
-		vkCmdBeginRenderPass(commandBuffer, &vkrpbInfo, VK_SUBPASS_CONTENTS_INLINE);
-		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkGraphicsPipeline);
-		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkPipelineLayout, 0, 1, &descSet, 0, 0);
-		vkCmdSetViewport(commandBuffer, 0, ARRAYSIZE(vkViewports), vkViewports);
-		vkCmdSetScissor(commandBuffer, 0, ARRAYSIZE(vkScissors), vkScissors);
-		vkCmdDraw(commandBuffer, 3, 1, 0, 0);
-		vkCmdEndRenderPass(commandBuffer);
-		if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer))
+		// The indirect read is the first thing that needs the culling
+		if (asyncCompute.enabled)
 		{
-			eprintf("Failed to record the command buffer!\n");
-			return 1;
+			waitSemaphores[waitsCount] = asyncCompute.semaphores[inFlight];
+			waitStages[waitsCount++] = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
 		}
-
-		VkSemaphore waitSemaphores[] = {imageAvailableSemaphore};
-		VkSemaphore signalSemaphores[] = {renderFinishedSemaphore};
-		VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-		(void)waitSemaphores;
 		VkSubmitInfo vkSubmitInfo =
 		{
 			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-			.waitSemaphoreCount = ARRAYSIZE(waitSemaphores),
+			.waitSemaphoreCount = waitsCount,
 			.pWaitSemaphores = waitSemaphores,
 			.pWaitDstStageMask = waitStages,
 			.commandBufferCount = 1,
 			.pCommandBuffers = &commandBuffer,
-			.signalSemaphoreCount = ARRAYSIZE(signalSemaphores),
+			.signalSemaphoreCount = opts.headless ? 0 : ARRAYSIZE(signalSemaphores),
 			.pSignalSemaphores = signalSemaphores,
 		};
 
-		if (VK_SUCCESS != vkQueueSubmit(vkGraphicsQueue, 1, &vkSubmitInfo, inFlightFence))
+		double queueSubmitStart = nowMs();
+		if (VK_SUCCESS != syncSubmit(vkGraphicsQueue, &vkSubmitInfo, inFlightFence, &frameValues[inFlight]))
 		{
 			eprintf("Failed to submit queue!\n");
 			return 1;
 		}
+		submitTimes[inFlight] = nowMs();
+		samplesPush(&submitCosts, submitTimes[inFlight] - queueSubmitStart);
+		inputTimes[inFlight] = pendingInput;
+		pendingInput = 0;
 
-		VkSwapchainKHR vkSwapchains[] = {vkSwapchain};
-		VkResult vkPresentResults[ARRAYSIZE(vkSwapchains)];
-		VkPresentInfoKHR vkPresentInfo =
+		if (!opts.headless)
 		{
-			.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-			.waitSemaphoreCount = ARRAYSIZE(signalSemaphores),
-			.pWaitSemaphores = signalSemaphores, 
-			.swapchainCount = ARRAYSIZE(vkSwapchains),
-			.pSwapchains = vkSwapchains,
-			.pImageIndices = &imageIndex,
-			.pResults = vkPresentResults,
-		};
+			VkSwapchainKHR vkSwapchains[] = {vkSwapchain};
+			VkResult vkPresentResults[ARRAYSIZE(vkSwapchains)];
+			VkPresentInfoKHR vkPresentInfo =
+			{
+				.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+				.waitSemaphoreCount = ARRAYSIZE(signalSemaphores),
+				.pWaitSemaphores = signalSemaphores, 
+				.swapchainCount = ARRAYSIZE(vkSwapchains),
+				.pSwapchains = vkSwapchains,
+				.pImageIndices = &imageIndex,
+				.pResults = vkPresentResults,
+			};
 
-		err = vkQueuePresentKHR(vkPresentQueue, &vkPresentInfo);
-		if (VK_ERROR_OUT_OF_DATE_KHR == err || VK_SUBOPTIMAL_KHR == err)
+			err = vkQueuePresentKHR(vkPresentQueue, &vkPresentInfo);
+			if (VK_ERROR_OUT_OF_DATE_KHR == err || VK_SUBOPTIMAL_KHR == err)
+			{
+				// The next frame picks it up, this one still presented fine or not at all
+				resized = true;
+			}
+			else if (VK_SUCCESS != err || VK_SUCCESS != vkPresentInfo.pResults[0])
+			{
+				eprintf("Vk queue present failed! RIP!\n");
+				return 1;
+			}
+		}
+		inFlight = (inFlight + 1) % opts.framesInFlight;
+		frameNumber++;
+		phaseFrames++;
+		if (!quit && !(opts.frames && phaseFrames >= opts.frames))
+			continue;
+
+		// Drain whatever is still in flight so the last frames get counted too
+		for (uint32_t i = 0; i < opts.framesInFlight; i++)
 		{
-			swapErr = recreateSwapchain(vkSurface, &vkSurfaceCaps, vkFormatDesired, vkExtentDesired, vkRenderPass);
-			if (0 != swapErr)
+			syncWait(inFlightFences[i], frameValues[i]);
+			if (submitTimes[i] == 0)
+				continue;
+			samplesPush(&fenceLatencies, nowMs() - submitTimes[i]);
+			submitTimes[i] = 0;
+			if (inputTimes[i] != 0)
+				samplesPush(&inputLatencies, nowMs() - inputTimes[i]);
+			inputTimes[i] = 0;
+			gpuTimersCollect(i);
+			if (instances.mode == DRAW_CULLED)
+				samplesPush(&visibleRatios, 100.0 * instancesVisible(i) / instances.count);
+			if (firstDrawPending)
 			{
-				eprintf("Recreate swapchain failed after present!\n");
-				return swapErr;
+				printf("time to first draw: %.3f ms\n", nowMs() - mesh.uploadStart);
+				firstDrawPending = false;
 			}
 		}
-		else if (VK_SUCCESS != err || VK_SUCCESS != vkPresentInfo.pResults[0])
+		if (opts.frames)
 		{
-			eprintf("Vk queue present failed! RIP!\n");
+			struct Phase *p = &phases[phase];
+			printf("%s: %u frames at %ux%u, %u %s objects with %s uniforms recorded on %u worker threads\n",
+				opts.headless ? "headless" : "windowed", phaseFrames, vkExtentDesired.width, vkExtentDesired.height,
+				p->draws, drawModeNames[p->mode], uniformSchemeNames[p->scheme], p->threads);
+			printf("present mode %s, %u frames in flight, waiting on %s, %s\n",
+				opts.headless ? "none" : presentModeNames[vkPresentModeDesired], opts.framesInFlight, syncSchemeNames[p->sync],
+				dynamicRendering.enabled ? "dynamic rendering" : "render pass");
+			printf("setup: %.3f ms, uniforms in %u buffers and %u descriptor sets\n",
+				p->setupMs, uniforms.buffersCount, uniforms.setsCount);
+			if (p->mode == DRAW_CULLED)
+				printf("culling on %s queue family %u\n", p->async ? "the async compute" : "the graphics",
+					p->async ? asyncCompute.family : vkQueueNodeIndex);
+			if (p->mode == DRAW_OVERDRAW)
+				printf("%u full-screen layers, depth pre-pass %s, %u iterations, wobble %s, %s\n", p->draws, p->prepass ? "on" : "off",
+					p->shading.iterations, p->shading.wobble ? "on" : "off", p->shading.branching ? "branching at runtime" : "specialized");
+			if (p->mode == DRAW_PER_DRAW)
+				printf("%u materials%s, %u descriptor binds in the last frame\n", p->materials,
+					p->bindless ? " bound all at once" : "", descriptorBinds);
+			samplesReport("frame time (ms)", &frameTimes);
+			samplesReport("cpu record (ms)", &recordTimes);
+			samplesReport("cpu submit (ms)", &submitCosts);
+			samplesReport("submit->fence (ms)", &fenceLatencies);
+			samplesReport("cpu wait (ms)", &waitTimes);
+			if (visibleRatios.count)
+				samplesReport("visible (%)", &visibleRatios);
+			if (descriptorTimes.count)
+			{
+				samplesReport("descriptors (ms)", &descriptorTimes);
+				printf("descriptor pools: %u for %u sets a frame in flight, %u for the rest\n",
+					frameDescriptorPools[0].count, p->draws, uniforms.descriptors.count + instances.descriptors.count);
+			}
+			if (inputLatencies.count)
+				samplesReport("input->fence (ms)", &inputLatencies);
+			if (recreateTimes.count)
+				samplesReport("recreate (ms)", &recreateTimes);
+			// Reporting sorted the frame times, so the worst is last
+			if (opts.benchResize)
+				printf("worst frame while resizing: %.3f ms over %u recreations\n",
+					frameTimes.count ? frameTimes.values[frameTimes.count - 1] : 0, recreateTimes.count);
+			gpuTimersReport();
+			const struct GpuScope *scopes;
+			uint32_t scopesCount = gpuTimerResults(&scopes);
+			if (scopesCount)
+			{
+				printf("gpu last frame (ms):");
+				for (uint32_t i = 0; i < scopesCount; i++)
+					printf(" %s=%.3f", scopes[i].name, scopes[i].ms);
+				printf("\n");
+			}
+			gpuAllocatorReport();
+			transientTargetsReport();
+			texturesReport();
+			pipelinesReport();
+			deletionsReport();
+			// Reporting sorted them
+			p->frameP50 = samplesPercentile(frameTimes.values, frameTimes.count, 0.50);
+			p->recordP50 = samplesPercentile(recordTimes.values, recordTimes.count, 0.50);
+			p->submitP50 = samplesPercentile(submitCosts.values, submitCosts.count, 0.50);
+			p->visibleP50 = visibleRatios.count ? samplesPercentile(visibleRatios.values, visibleRatios.count, 0.50) : 100;
+			p->gpuP50 = gpuTimerP50("frame");
+			p->shadeP50 = p->mode == DRAW_OVERDRAW ? gpuTimerP50("draws") : 0;
+			p->waitP50 = samplesPercentile(waitTimes.values, waitTimes.count, 0.50);
+			p->descriptorsP50 = samplesPercentile(descriptorTimes.values, descriptorTimes.count, 0.50);
+			p->binds = descriptorBinds;
+		}
+		if (quit || ++phase == phasesCount)
+			break;
+
+		// Everything is drained, so the next phase can have the memory
+		endPhase(frameNumber);
+		processDeletions(frameNumber);
+		if (0 != startPhase(&phases[phase], vkQueueNodeIndex, vkPool))
 			return 1;
+		samplesReset(&frameTimes);
+		samplesReset(&recordTimes);
+		samplesReset(&submitCosts);
+		samplesReset(&fenceLatencies);
+		samplesReset(&waitTimes);
+		samplesReset(&visibleRatios);
+		samplesReset(&descriptorTimes);
+		samplesReset(&inputLatencies);
+		samplesReset(&recreateTimes);
+		samplesReset(&deletions.reclaimMs);
+		gpuTimersReset();
+		phaseFrames = 0;
+	}
+
+	if (phasesCount > 1 && phase == phasesCount)
+	{
+		printf("\n%8s %10s %9s %8s %8s %6s %8s %9s %8s %14s %14s %14s %14s %14s %14s %10s\n", "objects", "mode", "uniforms", "threads", "sync",
+			"async", "prepass", "materials", "bindless", "setup ms", "frame p50 ms", "record p50 ms", "submit p50 ms", "wait p50 ms", "gpu p50 ms",
+			"visible %");
+		for (uint32_t i = 0; i < phasesCount; i++)
+		{
+			printf("%8u %10s %9s %8u %8s %6s %8s %9u %8s %14.3f %14.3f %14.3f %14.3f %14.3f %14.3f %10.1f\n", phases[i].draws,
+				drawModeNames[phases[i].mode], uniformSchemeNames[phases[i].scheme], phases[i].threads, syncSchemeNames[phases[i].sync],
+				phases[i].async ? "yes" : "no", phases[i].prepass ? "yes" : "no", phases[i].materials, phases[i].bindless ? "yes" : "no",
+				phases[i].setupMs, phases[i].frameP50, phases[i].recordP50, phases[i].submitP50, phases[i].waitP50, phases[i].gpuP50,
+				phases[i].visibleP50);
+		}
+		// Async phases come right after the same work serialized on the graphics queue
+		for (uint32_t i = 1; i < phasesCount; i++)
+		{
+			if (!phases[i].async || phases[i - 1].async || phases[i - 1].draws != phases[i].draws)
+				continue;
+			printf("async compute at %u instances: frame p50 %.3f -> %.3f ms (%+.1f%%)\n", phases[i].draws,
+				phases[i - 1].frameP50, phases[i].frameP50, 100.0 * (phases[i].frameP50 - phases[i - 1].frameP50) / phases[i - 1].frameP50);
+		}
+		// The transient sets should cost the same per set however many there are
+		for (uint32_t i = 0; i < phasesCount; i++)
+		{
+			if (phases[i].scheme != UNIFORMS_TRANSIENT || phases[i].mode != DRAW_PER_DRAW)
+				continue;
+			printf("transient descriptors at %u draws: p50 %.3f ms a frame, %.3f us a set\n", phases[i].draws,
+				phases[i].descriptorsP50, 1000.0 * phases[i].descriptorsP50 / phases[i].draws);
+		}
+		// Same for the pre-pass, but it's the fragment work that changes, so go by the GPU time
+		for (uint32_t i = 1; i < phasesCount; i++)
+		{
+			if (!phases[i].prepass || phases[i - 1].prepass || phases[i - 1].draws != phases[i].draws || phases[i - 1].gpuP50 == 0)
+				continue;
+			printf("depth pre-pass at %u layers: gpu p50 %.3f -> %.3f ms (%+.1f%%)\n", phases[i].draws,
+				phases[i - 1].gpuP50, phases[i].gpuP50, 100.0 * (phases[i].gpuP50 - phases[i - 1].gpuP50) / phases[i - 1].gpuP50);
+		}
+		// And bindless after the same materials bound a set at a time, where it's the recording that should get cheaper
+		for (uint32_t i = 1; i < phasesCount; i++)
+		{
+			if (!phases[i].bindless || phases[i - 1].bindless || phases[i - 1].materials != phases[i].materials
+				|| phases[i - 1].draws != phases[i].draws || phases[i - 1].recordP50 == 0)
+				continue;
+			printf("bindless at %u materials over %u draws: record p50 %.3f -> %.3f ms (%+.1f%%), %u -> %u descriptor binds\n",
+				phases[i].materials, phases[i].draws, phases[i - 1].recordP50, phases[i].recordP50,
+				100.0 * (phases[i].recordP50 - phases[i - 1].recordP50) / phases[i - 1].recordP50, phases[i - 1].binds, phases[i].binds);
+		}
+		// Specialized shading right after the same shading branched on, where it's the GPU's shading pass that should get faster
+		for (uint32_t i = 1; i < phasesCount; i++)
+		{
+			const struct Phase *a = &phases[i - 1], *b = &phases[i];
+			if (b->mode != DRAW_OVERDRAW || b->shading.branching || !a->shading.branching || a->shading.iterations != b->shading.iterations
+				|| a->shading.wobble != b->shading.wobble || a->draws != b->draws || a->prepass != b->prepass || a->shadeP50 == 0)
+				continue;
+			printf("specialized at %u iterations, wobble %s, %u layers: shading gpu p50 %.3f -> %.3f ms (%+.1f%%)\n", b->shading.iterations,
+				b->shading.wobble ? "on" : "off", b->draws, a->shadeP50, b->shadeP50, 100.0 * (b->shadeP50 - a->shadeP50) / a->shadeP50);
+		}
+		// Every scheme at the same draw count side by side, by how long recording and the GPU took
+		for (uint32_t i = 0; opts.benchUniforms && i < phasesCount; i++)
+		{
+			if (phases[i].scheme != UNIFORMS_RING || phases[i].mode != DRAW_PER_DRAW || phases[i].materials)
+				continue;
+			printf("uniforms at %u draws, record/gpu p50 (ms):", phases[i].draws);
+			for (uint32_t j = 0; j < phasesCount; j++)
+			{
+				if (phases[j].mode == DRAW_PER_DRAW && !phases[j].materials && phases[j].draws == phases[i].draws
+					&& phases[j].threads == phases[i].threads && phases[j].sync == phases[i].sync)
+					printf(" %s %.3f/%.3f", uniformSchemeNames[phases[j].scheme], phases[j].recordP50, phases[j].gpuP50);
+			}
+			printf("\n");
 		}
-		inFlight = (inFlight + 1) % MAX_FRAMES_IN_FLIGHT;
 	}
+	endPhase(frameNumber);
+	retireRenderTargets(frameNumber);
+	stopShaderReload(frameNumber);
+	// The graphics pipelines all belong to the table
+	destroyPipelines(frameNumber);
+	deferPipeline(vkCullPipeline, frameNumber);
 
-	vkQueueWaitIdle(vkGraphicsQueue);
-	vkDeviceWaitIdle(vkDevice);
-	SDL_DestroyWindow(window);
+	// Uploads wait on themselves, so the frames cover everything left on the GPU
+	for (uint32_t i = 0; i < opts.framesInFlight; i++)
+		syncWait(inFlightFences[i], frameValues[i]);
+	for (uint32_t i = 0; i < opts.framesInFlight; i++)
+		destroyDescriptorPools(&frameDescriptorPools[i], frameNumber);
+	processDeletions(frameNumber);
+	destroyGpuTimers();
+	savePipelineCache(opts.pipelineCachePath);
+	if (window)
+		SDL_DestroyWindow(window);
 	SDL_Quit();
 
 	// This is only one of the many things we need to clean up.
@@ -0,0 +1,19 @@
+#version 450
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragUv;
+
+layout(location = 0) out vec4 outColor;
+
+// Set 0 is the uniforms in vertex.glsl, this one is bound whenever the material changes
+layout(std430, set = 1, binding = 0) readonly buffer Material {
+	vec4 tint;
+	uint textureIndex; // Only bindless-fragment.glsl needs this
+} material;
+layout(set = 1, binding = 1) uniform texture2D tex;
+layout(set = 1, binding = 2) uniform sampler samp;
+
+void main() {
+	vec3 texel = texture(sampler2D(tex, samp), fragUv).rgb;
+	outColor = vec4(mix(fragColor, material.tint.rgb, 0.5) * texel, 1.0);
+}
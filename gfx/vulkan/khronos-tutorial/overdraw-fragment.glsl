@@ -0,0 +1,34 @@
+#version 450
+
+layout(location = 0) in vec3 fragColor;
+
+layout(location = 0) out vec4 outColor;
+
+layout(push_constant) uniform Params {
+	uint layers;
+	float time;
+	uint iterations; // These two only with BRANCHING
+	uint wobble;
+} params;
+
+// Deliberately slow, so that shading a pixel more than once shows up in the GPU time
+layout(constant_id = 0) const uint ITERATIONS = 64;
+// Warp the pattern over time
+layout(constant_id = 1) const bool WOBBLE = true;
+// Read the two above from push constants and branch on them at runtime instead
+layout(constant_id = 2) const bool BRANCHING = false;
+
+void main() {
+	uint iterations = BRANCHING ? params.iterations : ITERATIONS;
+	bool wobble = BRANCHING ? params.wobble != 0 : WOBBLE;
+	vec2 p = gl_FragCoord.xy / 64.0;
+	float v = 0.0;
+	for (uint i = 0; i < iterations; i++) {
+		if (wobble)
+			p = fract(p * 1.7 + vec2(sin(p.y + params.time), cos(p.x - params.time)));
+		else
+			p = fract(p * 1.7 + p.yx);
+		v += sin(dot(p, vec2(12.9898, 78.233)));
+	}
+	outColor = vec4(fragColor * (0.75 + 0.25 * sin(v)), 1.0);
+}
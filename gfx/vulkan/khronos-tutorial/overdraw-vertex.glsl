@@ -0,0 +1,21 @@
+#version 450
+
+layout(location = 0) out vec3 fragColor;
+
+layout(push_constant) uniform Params {
+	uint layers;
+	float time;
+} params;
+
+// The pre-pass and the shading pass have to land on exactly the same depth for EQUAL to pass
+invariant gl_Position;
+
+void main() {
+	// One triangle that covers the whole screen, no vertex buffer needed
+	vec2 uv = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+	// Instance 0 is the farthest, so drawing in order never lets the depth test reject anything
+	float depth = 1.0 - float(gl_InstanceIndex + 1) / float(params.layers + 1);
+	gl_Position = vec4(2.0 * uv - 1.0, depth, 1.0);
+	float hue = float(gl_InstanceIndex) / float(params.layers);
+	fragColor = 0.5 + 0.5 * cos(6.28 * (hue + vec3(0.0, 0.33, 0.67)));
+}
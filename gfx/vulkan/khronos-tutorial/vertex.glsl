@@ -1,27 +1,50 @@
 #version 450
 
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
 layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragUv; // Across the triangle's bounding square, for material textures
 
-layout(binding = 0) uniform Unis {
+struct Unis {
 	float time;
-} uni;
+	float scale;
+	vec2 offset;
+};
+
+// Where the draw's uniforms come from: 0 the uniform buffer, 1 push constants, 2 the storage buffer at gl_InstanceIndex
+layout(constant_id = 0) const uint UNIS_SOURCE = 0;
+// Radians a second the triangle turns
+layout(constant_id = 1) const float TIME_SCALE = 3.14;
+// Blue follows the spin instead of the vertex colors
+layout(constant_id = 2) const bool BLUE_PULSE = true;
+
+// All three are declared whichever one gets read, so every uniform scheme's layout has all of them
+layout(binding = 0) uniform UniformUnis {
+	Unis unis;
+} uniformUnis;
 
-vec2 positions[3] = vec2[](
-	vec2(0.0, 0.5773502691896257),
-	vec2(-0.5, -0.28867513459481287),
-	vec2(0.5, -0.28867513459481287)
-);
+layout(std430, binding = 1) readonly buffer StorageUnis {
+	Unis unis[];
+} storageUnis;
 
-vec3 colors[3] = vec3[](
-	vec3(1.0, 0.0, 0.0),
-	vec3(0.0, 1.0, 0.0),
-	vec3(0.0, 0.0, 1.0)
-);
+layout(push_constant) uniform PushUnis {
+	Unis unis;
+} pushUnis;
 
 void main() {
-	float t = 3.14 * uni.time;
+	Unis uni;
+	if (UNIS_SOURCE == 1)
+		uni = pushUnis.unis;
+	else if (UNIS_SOURCE == 2)
+		uni = storageUnis.unis[gl_InstanceIndex];
+	else
+		uni = uniformUnis.unis;
+	float t = TIME_SCALE * uni.time;
 	mat2 rot = mat2(cos(t), -sin(t), sin(t), cos(t)); 
-	gl_Position = vec4(rot * positions[gl_VertexIndex], 0.0, 1.0);
-	fragColor = colors[gl_VertexIndex];
-	fragColor.b = sin(t);
+	gl_Position = vec4(uni.offset + uni.scale * (rot * inPosition), 0.0, 1.0);
+	fragColor = inColor;
+	if (BLUE_PULSE)
+		fragColor.b = sin(t);
+	fragUv = inPosition + 0.5;
 }